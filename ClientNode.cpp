@@ -8,24 +8,27 @@
 
  #include <iostream>
  #include <string>
- #include <sstream>
  #include <thread>
  #include <chrono>
  #include <cstdlib>
  #include <cctype>
- #include "../include/SocketConLib.h"
+ #include "../include/RcsClientLib.h"
  
  // Function prototypes
  void displayMenu();
- void getSensorStatus(SocketCon& socket);
- void getSensorType(SocketCon& socket);
- void controlRelay(SocketCon& socket);
- void getRelayState(SocketCon& socket);
- void automaticControl(SocketCon& socket);
- void getGyroData(SocketCon& socket);
- void getAccData(SocketCon& socket);
- void getTemperature(SocketCon& socket);
- void getKeypadData(SocketCon& socket);
+ void getSensorStatus(RcsClient& client);
+ void getSensorType(RcsClient& client);
+ void controlRelay(RcsClient& client);
+ void getRelayState(RcsClient& client);
+ void automaticControl(RcsClient& client);
+ void getGyroData(RcsClient& client);
+ void getAccData(RcsClient& client);
+ void getTemperature(RcsClient& client);
+ void getKeypadData(RcsClient& client);
+ void getAttitude(RcsClient& client);
+ void showDashboard(RcsClient& client);
+ void showHistory(RcsClient& client);
+ void measureLatency(RcsClient& client);
  void clearScreen();
  
  int main(int argc, char* argv[]) {
@@ -45,13 +48,12 @@
      std::cout << "Raspberry Pi Remote Control System - Client" << std::endl;
      std::cout << "Connecting to server at " << serverIP << ":" << serverPort << std::endl;
      
-     // Create socket connection
-     SocketCon socket(SocketCon::Mode::CLIENT, serverIP, serverPort);
-     if (!socket.init()) {
+     // Connect to the server
+     RcsClient client;
+     if (!client.connect(serverIP, serverPort)) {
          std::cerr << "Failed to initialize socket" << std::endl;
          return 1;
      }
-     std::string response;
      bool running = true;
      
      while (running) {
@@ -69,41 +71,57 @@
          
          switch (choice[0]) {
              case '1':
-                 getSensorStatus(socket);
+                 getSensorStatus(client);
                  break;
              case '2':
-                 getSensorType(socket);
+                 getSensorType(client);
                  break;
              case '3':
-                 controlRelay(socket);
+                 controlRelay(client);
                  break;
              case '4':
-                 getRelayState(socket);
+                 getRelayState(client);
                  break;
              case '5':
-                 automaticControl(socket);
+                 automaticControl(client);
                  break;
              case '6':
-                 getGyroData(socket);
+                 getGyroData(client);
                  break;
              case '7':
-                 getAccData(socket);
+                 getAccData(client);
                  break;
              case '8':
-                 getTemperature(socket);
+                 getTemperature(client);
                  break;
              case '9':
-                 getKeypadData(socket);
+                 getKeypadData(client);
+                 break;
+             case 'a':
+             case 'A':
+                 getAttitude(client);
+                 break;
+             case 'b':
+             case 'B':
+                 showDashboard(client);
+                 break;
+             case 'c':
+             case 'C':
+                 showHistory(client);
+                 break;
+             case 'd':
+             case 'D':
+                 measureLatency(client);
                  break;
              case '0':
              case 'q':
-             case 'Q':
+             case 'Q': {
                  std::cout << "Closing connection..." << std::endl;
-                 socket.send("close:");
-                 socket.receive(response);
-                 std::cout << "Server response: " << response << std::endl;
+                 RcsClient::Result<std::string> result = client.close().get();
+                 std::cout << "Server response: " << (result.raw.empty() ? result.error : result.raw) << std::endl;
                  running = false;
                  break;
+             }
              default:
                  std::cout << "Invalid choice. Please try again." << std::endl;
                  break;
@@ -116,7 +134,7 @@
          }
      }
      
-     socket.release();
+     client.disconnect();
      return 0;
  }
  
@@ -131,63 +149,46 @@
      std::cout << "7. Get Acceleration Data" << std::endl;
      std::cout << "8. Get Temperature" << std::endl;
      std::cout << "9. Get Keypad Data" << std::endl;
+     std::cout << "A. Get Attitude" << std::endl;
+     std::cout << "B. Show Dashboard" << std::endl;
+     std::cout << "C. Show Sample History" << std::endl;
+     std::cout << "D. Measure Sensor Latency" << std::endl;
      std::cout << "0. Exit" << std::endl;
      std::cout << "===================================" << std::endl;
  }
  
- void getSensorStatus(SocketCon& socket) {
-     std::string response;
-     
+ // Print why a request failed
+ template <typename T>
+ void printFailure(const RcsClient::Result<T>& result) {
+     std::cout << "Unexpected response: " << (result.raw.empty() ? result.error : result.raw) << std::endl;
+ }
+ 
+ void getSensorStatus(RcsClient& client) {
      std::cout << "Requesting sensor status..." << std::endl;
-     socket.send("sensorState:");
-     socket.receive(response);
+     RcsClient::Result<bool> state = client.getSensorState().get();
      
-     // Parse the response
-     if (response.find("sensorState") != std::string::npos) {
-         size_t pos = response.find(" ");
-         if (pos != std::string::npos) {
-             std::string state = response.substr(pos + 1);
-             std::cout << "Sensor State: " << (state == "1" ? "ON" : "OFF") << std::endl;
-         }
+     if (state.ok) {
+         std::cout << "Sensor State: " << (state.value ? "ON" : "OFF") << std::endl;
      } else {
-         std::cout << "Unexpected response: " << response << std::endl;
+         printFailure(state);
      }
  }
  
- void getSensorType(SocketCon& socket) {
-     std::string response;
-     
+ void getSensorType(RcsClient& client) {
      std::cout << "Requesting sensor type..." << std::endl;
-     socket.send("sensorType:");
-     socket.receive(response);
+     RcsClient::Result<std::string> type = client.getSensorType().get();
      
-     // Parse the response
-     if (response.find("sensorType") != std::string::npos) {
-         size_t pos = response.find(" ");
-         if (pos != std::string::npos) {
-             std::string type = response.substr(pos + 1);
-             std::cout << "Sensor Type: " << type << std::endl;
-         }
+     if (type.ok) {
+         std::cout << "Sensor Type: " << type.value << std::endl;
      } else {
-         std::cout << "Unexpected response: " << response << std::endl;
+         printFailure(type);
      }
  }
  
- void controlRelay(SocketCon& socket) {
-     std::string response;
-     
+ void controlRelay(RcsClient& client) {
      // First get current state
-     socket.send("relayState:");
-     socket.receive(response);
-     
-     bool currentState = false;
-     if (response.find("relay") != std::string::npos) {
-         size_t pos = response.find(" ");
-         if (pos != std::string::npos) {
-             std::string state = response.substr(pos + 1);
-             currentState = (state == "1");
-         }
-     }
+     RcsClient::Result<bool> state = client.getRelayState().get();
+     bool currentState = state.ok && state.value;
      
      std::cout << "Driver Status: " << (currentState ? "ON" : "OFF") << std::endl;
      std::cout << "Press " << (currentState ? "0 to switch it OFF" : "1 to switch it ON") << ": ";
@@ -196,53 +197,33 @@
      std::getline(std::cin, choice);
      
      if (!choice.empty() && (choice[0] == '0' || choice[0] == '1')) {
-         std::string command = "relay " + std::string(1, choice[0]) + ":";
-         socket.send(command);
-         socket.receive(response);
+         RcsClient::Result<bool> result = client.setRelay(choice[0] == '1').get();
          
-         if (response.find("relay ok") != std::string::npos) {
+         if (result.ok) {
              std::cout << "Relay state changed successfully." << std::endl;
          } else {
-             std::cout << "Failed to change relay state: " << response << std::endl;
+             std::cout << "Failed to change relay state: " << (result.raw.empty() ? result.error : result.raw) << std::endl;
          }
      } else {
          std::cout << "Invalid input. No changes made." << std::endl;
      }
  }
  
- void getRelayState(SocketCon& socket) {
-     std::string response;
-     
+ void getRelayState(RcsClient& client) {
      std::cout << "Requesting relay state..." << std::endl;
-     socket.send("relayState:");
-     socket.receive(response);
+     RcsClient::Result<bool> state = client.getRelayState().get();
      
-     // Parse the response
-     if (response.find("relay") != std::string::npos) {
-         size_t pos = response.find(" ");
-         if (pos != std::string::npos) {
-             std::string state = response.substr(pos + 1);
-             std::cout << "Driver Status: " << (state == "1" ? "ON" : "OFF") << std::endl;
-         }
+     if (state.ok) {
+         std::cout << "Driver Status: " << (state.value ? "ON" : "OFF") << std::endl;
      } else {
-         std::cout << "Unexpected response: " << response << std::endl;
+         printFailure(state);
      }
  }
  
- void automaticControl(SocketCon& socket) {
-     std::string response;
-     
+ void automaticControl(RcsClient& client) {
      // Get sensor type
-     socket.send("sensorType:");
-     socket.receive(response);
-     
-     std::string sensorType = "UNKNOWN";
-     if (response.find("sensorType") != std::string::npos) {
-         size_t pos = response.find(" ");
-         if (pos != std::string::npos) {
-             sensorType = response.substr(pos + 1);
-         }
-     }
+     RcsClient::Result<std::string> type = client.getSensorType().get();
+     std::string sensorType = type.ok ? type.value : "UNKNOWN";
      
      std::cout << "Sensor List:" << std::endl;
      std::cout << "Type: " << sensorType << std::endl;
@@ -256,9 +237,10 @@
          std::cout << "Invalid input. Automatic control canceled." << std::endl;
          return;
      }
+     bool driverOnWhen = (desiredState == "1");
      
      std::cout << "Right now the control is on. If the sensor is " 
-               << (desiredState == "1" ? "ON" : "OFF") 
+               << (driverOnWhen ? "ON" : "OFF") 
                << ", the driver will be ON. Press \"e\" to exit..." << std::endl;
      
      bool running = true;
@@ -273,26 +255,11 @@
      });
      
      // Main control loop
-     while (running) {
-         // Get sensor state
-         socket.send("sensorState:");
-         socket.receive(response);
-         
-         std::string sensorState = "";
-         if (response.find("sensorState") != std::string::npos) {
-             size_t pos = response.find(" ");
-             if (pos != std::string::npos) {
-                 sensorState = response.substr(pos + 1);
-             }
-         }
-         
+     while (running && client.isConnected()) {
          // If sensor state matches desired state, turn relay ON; otherwise, turn it OFF
-         if (sensorState == desiredState) {
-             socket.send("relay 1:");
-             socket.receive(response); // Consume response
-         } else {
-             socket.send("relay 0:");
-             socket.receive(response); // Consume response
+         RcsClient::Result<bool> sensor = client.getSensorState().get();
+         if (sensor.ok) {
+             client.setRelay(sensor.value == driverOnWhen).get();
          }
          
          // Wait a bit before checking again
@@ -308,80 +275,121 @@
      std::cout << "Automatic control has been stopped." << std::endl;
  }
  
- void getGyroData(SocketCon& socket) {
-     std::string response;
-     
+ void getGyroData(RcsClient& client) {
      std::cout << "Requesting gyro data..." << std::endl;
-     socket.send("gyro:");
-     socket.receive(response);
+     RcsClient::Result<RcsClient::Vector3> gyro = client.getGyro().get();
      
-     // Parse the response
-     if (response.find("gyro") != std::string::npos) {
-         std::istringstream iss(response.substr(5)); // Skip "gyro "
-         float x, y, z;
-         if (iss >> x >> y >> z) {
-             std::cout << "Gyro: x: " << x << " y: " << y << " z: " << z << " [deg/sec]" << std::endl;
-         }
+     if (gyro.ok) {
+         std::cout << "Gyro: x: " << gyro.value.x << " y: " << gyro.value.y << " z: " << gyro.value.z << " [deg/sec]" << std::endl;
      } else {
-         std::cout << "Unexpected response: " << response << std::endl;
+         printFailure(gyro);
      }
  }
  
- void getAccData(SocketCon& socket) {
-     std::string response;
-     
+ void getAccData(RcsClient& client) {
      std::cout << "Requesting acceleration data..." << std::endl;
-     socket.send("acc:");
-     socket.receive(response);
+     RcsClient::Result<RcsClient::Vector3> acc = client.getAcc().get();
      
-     // Parse the response
-     if (response.find("acc") != std::string::npos) {
-         std::istringstream iss(response.substr(4)); // Skip "acc "
-         float x, y, z;
-         if (iss >> x >> y >> z) {
-             std::cout << "Acceleration: x: " << x << " y: " << y << " z: " << z << " [m/s²]" << std::endl;
-         }
+     if (acc.ok) {
+         std::cout << "Acceleration: x: " << acc.value.x << " y: " << acc.value.y << " z: " << acc.value.z << " [m/s²]" << std::endl;
      } else {
-         std::cout << "Unexpected response: " << response << std::endl;
+         printFailure(acc);
      }
  }
  
- void getTemperature(SocketCon& socket) {
-     std::string response;
-     
+ void getTemperature(RcsClient& client) {
      std::cout << "Requesting temperature data..." << std::endl;
-     socket.send("temp:");
-     socket.receive(response);
+     RcsClient::Result<double> temp = client.getTemperature().get();
      
-     // Parse the response
-     if (response.find("temp") != std::string::npos) {
-         std::istringstream iss(response.substr(5)); // Skip "temp "
-         float temp;
-         if (iss >> temp) {
-             std::cout << "Temperature: " << temp << " C" << std::endl;
-         }
+     if (temp.ok) {
+         std::cout << "Temperature: " << temp.value << " C" << std::endl;
      } else {
-         std::cout << "Unexpected response: " << response << std::endl;
+         printFailure(temp);
      }
  }
  
- void getKeypadData(SocketCon& socket) {
-     std::string response;
-     
+ void getKeypadData(RcsClient& client) {
      std::cout << "Requesting keypad data..." << std::endl;
-     socket.send("key:");
-     socket.receive(response);
+     RcsClient::Result<std::string> keys = client.getKeys().get();
      
-     // Parse the response
-     if (response.find("key") != std::string::npos) {
-         size_t pos = response.find(" ");
-         if (pos != std::string::npos) {
-             std::string key = response.substr(pos + 1);
-             std::cout << "KEY: " << key << std::endl;
-         }
+     if (keys.ok) {
+         std::cout << "KEY: " << keys.value << std::endl;
+     } else {
+         printFailure(keys);
+     }
+ }
+ 
+ void getAttitude(RcsClient& client) {
+     std::cout << "Requesting attitude data..." << std::endl;
+     RcsClient::Result<RcsClient::Attitude> attitude = client.getAttitude().get();
+     
+     if (attitude.ok) {
+         std::cout << "Attitude: roll: " << attitude.value.roll << " pitch: " << attitude.value.pitch
+                   << " yaw: " << attitude.value.yaw << " [deg]" << std::endl;
+     } else {
+         printFailure(attitude);
+     }
+ }
+ 
+ void showDashboard(RcsClient& client) {
+     // Fetch everything in a single round trip
+     std::cout << "Requesting dashboard data..." << std::endl;
+     RcsClient::Result<RcsClient::Dashboard> dashboard = client.getDashboard().get();
+     
+     if (!dashboard.ok) {
+         printFailure(dashboard);
+         return;
+     }
+     
+     const RcsClient::Dashboard& d = dashboard.value;
+     std::cout << "Gyro: x: " << d.gyro.x << " y: " << d.gyro.y << " z: " << d.gyro.z << " [deg/sec]" << std::endl;
+     std::cout << "Acceleration: x: " << d.acc.x << " y: " << d.acc.y << " z: " << d.acc.z << " [m/s²]" << std::endl;
+     std::cout << "Temperature: " << d.temperature << " C" << std::endl;
+     std::cout << "Sensor State: " << (d.sensorOn ? "ON" : "OFF") << std::endl;
+     std::cout << "Driver Status: " << (d.relayOn ? "ON" : "OFF") << std::endl;
+ }
+ 
+ void showHistory(RcsClient& client) {
+     // The last second of samples; lines are printed as the chunks arrive
+     std::cout << "Requesting sample history..." << std::endl;
+     std::cout << "sample gyro_x gyro_y gyro_z acc_x acc_y acc_z temp time_ns" << std::endl;
+     RcsClient::Result<RcsClient::History> history = client.getHistory(200, [](const std::string& lines) {
+         std::cout << lines;
+     }).get();
+     
+     if (history.ok) {
+         std::cout << "Samples: " << history.value.sent << " (" << history.value.lost << " lost)" << std::endl;
      } else {
-         std::cout << "Unexpected response: " << response << std::endl;
+         printFailure(history);
+     }
+ }
+ 
+ void measureLatency(RcsClient& client) {
+     // Relate the Server Node's clock to ours, then see how old the gyro values are on arrival
+     std::cout << "Synchronizing clocks..." << std::endl;
+     RcsClient::Result<ClockSync> sync = client.syncClock().get();
+     if (!sync.ok) {
+         printFailure(sync);
+         return;
+     }
+     std::cout << "Clock offset: " << sync.value.offsetNs / 1000 << " us (round trip "
+               << sync.value.rttNs / 1000 << " us)" << std::endl;
+     
+     client.requestTimestamps(true);
+     for (int i = 0; i < 5; i++) {
+         RcsClient::Result<RcsClient::Vector3> gyro = client.getGyro().get();
+         int64_t receivedNs = ClockSync::localNowNs();
+         if (!gyro.ok) {
+             printFailure(gyro);
+             break;
+         }
+         // The sample time is on the Raspberry Pi's clock
+         int64_t ageNs = receivedNs - sync.value.toLocalNs(gyro.timestampNs);
+         std::cout << "Gyro: x: " << gyro.value.x << " y: " << gyro.value.y << " z: " << gyro.value.z
+                   << " age: " << ageNs / 1000 << " us" << std::endl;
+         std::this_thread::sleep_for(std::chrono::milliseconds(100));
      }
+     client.requestTimestamps(false);
  }
  
  void clearScreen() {
@@ -1,154 +1,42 @@
-#include "include/KeypadLib.h"
-#include "include/DigSensorLib.h"
-#include "include/RelayLib.h"
-#include "include/SocketConLib.h"
+#include "include/NodeServiceLib.h"
+#include "include/NodeServerLib.h"
 #include <iostream>
-#include <sstream>
 #include <string>
-#include <csignal>
-#include <thread>
-#include <chrono>
+#include <vector>
 
-// Global flag for signal handling
-volatile sig_atomic_t running = 1;
+// Threads executing commands; one per device is enough for them all to run at once
+const size_t WORKERS = 3;
 
-// Signal handler for graceful termination
-void signalHandler(int signum) {
-    std::cout << "Signal " << signum << " received. Terminating..." << std::endl;
-    running = 0;
-}
-
-// Function to continuously check for keypad input
-void keypadMonitor(Keypad& keypad) {
-    while (running) {
-        char key = keypad.getKey();
-        if (key == '#') {
-            std::cout << "Key sequence entered: " << keypad.getKeyBuffer() << std::endl;
-        }
-        // Small delay to prevent high CPU usage
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
-    }
-}
-
-// Process commands received from the server
-std::string processCommand(const std::string& command, DigSensor& sensor, Relay& relay, Keypad& keypad) {
-    std::stringstream response;
-    
-    if (command == "sensorState:") {
-        bool state = sensor.read();
-        response << "sensorState " << (state ? "1" : "0") << ":";
-    }
-    else if (command == "sensorType:") {
-        std::string type = sensor.getType();
-        response << "sensorType " << type << ":";
-    }
-    else if (command.substr(0, 6) == "relay ") {
-        // Extract the relay state from the command
-        if (command.length() >= 8) {
-            char stateChar = command[6];
-            bool state = (stateChar == '1');
-            
-            if (relay.set(state)) {
-                response << "relay ok:";
-            } else {
-                response << "relay err:";
-            }
-        } else {
-            response << "relay err:";
-        }
-    }
-    else if (command == "relayState:") {
-        bool state = relay.getState();
-        response << "relay " << (state ? "1" : "0") << ":";
-    }
-    else if (command == "key:") {
-        std::string keyBuffer = keypad.getKeyBuffer();
-        response << "key " << keyBuffer << ":";
-        // Clear the key buffer after sending
-        keypad.clearKeyBuffer();
-    }
-    else if (command == "close:") {
-        // Handle close command
-        response << "close ok:";
-        running = 0;
-    }
-    else {
-        // Unknown command
-        response << "error: unknown command:";
-    }
-    
-    return response.str();
-}
-
-int main() {
+int main(int argc, char* argv[]) {
     // Set up signal handling
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
-    
-    // Create and initialize the components
-    DigSensor sensor;
-    Relay relay;
-    Keypad keypad;
-    
-    sensor.init();
-    relay.init();
-    keypad.init();
-    
-    // Create socket server on port 7002
-    SocketCon server(SocketCon::Mode::SERVER, "", 7002);
-    
-    std::cout << "DigitalIO Node starting..." << std::endl;
-    
-    // Initialize the socket server
-    if (!server.init()) {
-        std::cerr << "Failed to initialize DigitalIO Node socket server" << std::endl;
-        // Clean up resources
-        sensor.release();
-        relay.release();
-        keypad.release();
-        return 1;
-    }
-    
-    std::cout << "DigitalIO Node started. Listening on port 7002..." << std::endl;
-    
-    // Start keypad monitoring in a separate thread
-    std::thread keypadThread(keypadMonitor, std::ref(keypad));
-    
-    // Main processing loop
-    while (running) {
-        // Wait for a command from the server
-        std::string command;
-        if (server.receive(command)) {
-            std::cout << "Received command: " << command << std::endl;
-            
-            // Process the command and send the response
-            std::string response = processCommand(command, sensor, relay, keypad);
-            std::cout << "Sending response: " << response << std::endl;
-            server.send(response);
-            
-            // Check if we received a close command
-            if (command == "close:") {
-                break;
-            }
-        } else {
-            // If receive failed, the connection might be closed
-            break;
+    NodeServer::handleSignals();
+    
+    // Relays of the bank, e.g. --relay-pins 27,22,23,24; one relay on pin 27 if none are given
+    std::vector<int> relayPins;
+    
+    // Optional real-time scheduling of the monitor threads
+    RtConfig realtime;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        std::string value = i + 1 < argc ? argv[++i] : "";
+        if (option == "--relay-pins" && Relay::parsePins(value, relayPins)) {
+            continue;
+        }
+        if (!Rt::parseOption(option, value, realtime)) {
+            std::cerr << "Usage: " << argv[0] << " [--relay-pins <pin>,...] [--rt-priority <1-99>] [--rt-cpu <n>]"
+                      << std::endl;
+            return 1;
         }
     }
+    Rt::configureProcess(realtime);
     
-    // Signal the keypad thread to stop and wait for it to finish
-    running = 0;
-    if (keypadThread.joinable()) {
-        keypadThread.join();
-    }
-    
-    // Clean up resources
-    server.release();
-    sensor.release();
-    relay.release();
-    keypad.release();
+    // The sensor, relay and keypad are monitored from the start, whenever the Server Node
+    // connects on port 7002. Tagged commands run on the workers, in order per device,
+    // so a slow command holds up only commands for the same device
+    DigitalIOService service(relayPins);
+    service.setRealtime(realtime);
+    NodeServer server("DigitalIO", 7002, service);
+    server.setWorkers(WORKERS, DigitalIOService::devicesOf);
     
-    std::cout << "DigitalIO Node terminated" << std::endl;
-    
-    return 0;
-}
\ No newline at end of file
+    return server.run();
+}
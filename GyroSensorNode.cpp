@@ -1,101 +1,45 @@
-#include "include/GyroLib.h"
-#include "include/SocketConLib.h"
+#include "include/NodeServiceLib.h"
+#include "include/NodeServerLib.h"
 #include <iostream>
-#include <sstream>
 #include <string>
-#include <csignal>
 #include <vector>
+#include <cstdlib>
 
-// Global flag for signal handling
-volatile sig_atomic_t running = 1;
-
-// Signal handler for graceful termination
-void signalHandler(int signum) {
-    std::cout << "Signal " << signum << " received. Terminating..." << std::endl;
-    running = 0;
-}
-
-// Process commands received from the server
-std::string processCommand(const std::string& command, Gyro& gyro) {
-    std::stringstream response;
-    
-    if (command == "temp:") {
-        double temp = gyro.getTemp();
-        response << "temp " << temp << ":";
-    }
-    else if (command == "gyro:") {
-        double x = gyro.getGyroX();
-        double y = gyro.getGyroY();
-        double z = gyro.getGyroZ();
-        response << "gyro " << x << " " << y << " " << z << ":";
-    }
-    else if (command == "acc:") {
-        double x = gyro.getAccX();
-        double y = gyro.getAccY();
-        double z = gyro.getAccZ();
-        response << "acc " << x << " " << y << " " << z << ":";
-    }
-    else if (command == "close:") {
-        // Handle close command
-        response << "close ok:";
-        running = 0;
-    }
-    else {
-        // Unknown command
-        response << "error: unknown command:";
-    }
-    
-    return response.str();
-}
-
-int main() {
+int main(int argc, char* argv[]) {
     // Set up signal handling
-    signal(SIGINT, signalHandler);
-    signal(SIGTERM, signalHandler);
-    
-    // Create and initialize the gyro sensor
-    Gyro gyro;
-    gyro.init();
-    
-    // Create socket server on port 7003
-    SocketCon server(SocketCon::Mode::SERVER, "", 7003);
-    
-    std::cout << "GyroSensor Node starting..." << std::endl;
-    
-    // Initialize the socket server
-    if (!server.init()) {
-        std::cerr << "Failed to initialize GyroSensor Node socket server" << std::endl;
-        return 1;
-    }
-    
-    std::cout << "GyroSensor Node started. Listening on port 7003..." << std::endl;
-    
-    // Main processing loop
-    while (running) {
-        // Wait for a command from the server
-        std::string command;
-        if (server.receive(command)) {
-            std::cout << "Received command: " << command << std::endl;
-            
-            // Process the command and send the response
-            std::string response = processCommand(command, gyro);
-            std::cout << "Sending response: " << response << std::endl;
-            server.send(response);
-            
-            // Check if we received a close command
-            if (command == "close:") {
-                break;
-            }
-        } else {
-            // If receive failed, the connection might be closed
-            break;
+    NodeServer::handleSignals();
+    
+    // Sensors to sample, e.g. --imu 1:0x68 --imu 1:0x69 --imu 3:0x68; one at 1:0x68 if none are given
+    std::vector<ImuConfig> imus;
+    RtConfig realtime;
+    
+    // Sampling rate kept up without demand, e.g. for readers of the shared memory board
+    int minRate = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        std::string value = i + 1 < argc ? argv[++i] : "";
+        ImuConfig imu;
+        if (option == "--imu" && GyroService::parseImu(value, imu)) {
+            imus.push_back(imu);
+        } else if (option == "--min-rate" && std::atoi(value.c_str()) > 0) {
+            minRate = std::atoi(value.c_str());
+        } else if (!Rt::parseOption(option, value, realtime)) {
+            std::cerr << "Usage: " << argv[0] << " [--imu <bus>:<address>]... [--min-rate <hz>]"
+                      << " [--rt-priority <1-99>] [--rt-cpu <n>]" << std::endl;
+            return 1;
         }
     }
+    Rt::configureProcess(realtime);
     
-    // Clean up resources
-    server.release();
+    // The sensors are sampled from the start, whenever the Server Node connects on port 7003;
+    // history replies are streamed with flow control, interleaved with the other replies
+    GyroService service(imus);
+    service.setRealtime(realtime);
+    service.setMinRate(minRate);
+    NodeServer server("GyroSensor", 7003, service);
     
-    std::cout << "GyroSensor Node terminated" << std::endl;
+    // Its subscribers are gone with it; a new Server Node sends its own demand
+    server.setDisconnectHandler([&service]() { service.clearDemand(); });
     
-    return 0;
-}
\ No newline at end of file
+    return server.run();
+}
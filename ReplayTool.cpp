@@ -0,0 +1,418 @@
+/**
+ * ReplayTool.cpp - Replays traffic recorded with ServerNode --capture
+ *
+ * client mode: plays the recorded client sessions against a running
+ * ServerNode and reports throughput, latency and replies that differ from
+ * the recording.
+ *
+ * node mode: stands in for the GyroSensor or DigitalIO Node, answering the
+ * ServerNode with the recorded replies and pushing the recorded events, so
+ * the server can be benchmarked without the hardware.
+ */
+
+#include "include/SocketConLib.h"
+#include "include/CaptureLib.h"
+#include "include/ProtocolLib.h"
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+
+typedef std::chrono::steady_clock Clock;
+
+// A message with the time it was recorded at
+struct TimedMessage {
+    uint64_t timeUs;
+    std::string message;
+};
+
+// One recorded client connection
+struct ClientSession {
+    std::vector<TimedMessage> requests;
+    std::vector<std::string> replies;
+};
+
+// A recorded node reply and how long the node took to give it
+struct RecordedReply {
+    std::string message;
+    uint64_t latencyUs;
+
+    // Chunks sent before the reply if it was streamed
+    std::vector<std::string> chunks;
+};
+
+// Results gathered from all client sessions
+struct ReplayResults {
+    std::mutex mutex;
+    std::vector<uint64_t> latenciesUs;
+    size_t differing = 0;
+    size_t failed = 0;
+};
+
+// Sleep until the given offset from start
+void sleepUntil(Clock::time_point start, uint64_t offsetUs) {
+    std::this_thread::sleep_until(start + std::chrono::microseconds(offsetUs));
+}
+
+// Latency at the given fraction of the sorted samples
+uint64_t percentile(const std::vector<uint64_t>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+// A reply without its times (stamps and "clock <ns>:"), which differ in every run
+std::string withoutTimes(const std::string& reply) {
+    uint64_t timestampNs;
+    std::string body;
+    if (Protocol::splitStamped(reply, timestampNs, body)) {
+        return withoutTimes(body);
+    }
+    if (Protocol::isBatch(reply)) {
+        std::vector<std::string> entries = Protocol::splitBatch(reply);
+        for (size_t i = 0; i < entries.size(); i++) {
+            entries[i] = withoutTimes(entries[i]);
+        }
+        return Protocol::makeBatch(entries);
+    }
+    if (reply.compare(0, 6, "clock ") == 0) {
+        return "clock:";
+    }
+    return reply;
+}
+
+// Play one recorded client session, one request at a time
+void replaySession(const ClientSession& session, const std::string& host, int port, bool realtime,
+                   Clock::time_point start, uint64_t firstUs, ReplayResults& results) {
+    SocketCon client(SocketCon::Mode::CLIENT, host, port);
+    if (!client.connect(2000)) {
+        std::lock_guard<std::mutex> lock(results.mutex);
+        results.failed += session.requests.size();
+        return;
+    }
+
+    std::vector<uint64_t> latencies;
+    size_t differing = 0;
+    size_t failed = 0;
+    for (size_t i = 0; i < session.requests.size(); i++) {
+        if (realtime) {
+            sleepUntil(start, session.requests[i].timeUs - firstUs);
+        }
+
+        // Events for subscribed topics and the chunks of a streamed reply arrive before the reply
+        Clock::time_point sent = Clock::now();
+        std::string reply;
+        bool ok = client.send(session.requests[i].message);
+        while (ok && (ok = client.receive(reply)) && (Protocol::isEvent(reply) || Protocol::isChunk(reply))) {
+        }
+        if (!ok) {
+            failed += session.requests.size() - i;
+            break;
+        }
+
+        latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - sent).count());
+        if (i >= session.replies.size() || withoutTimes(reply) != withoutTimes(session.replies[i])) {
+            differing++;
+        }
+    }
+    client.release();
+
+    std::lock_guard<std::mutex> lock(results.mutex);
+    results.latenciesUs.insert(results.latenciesUs.end(), latencies.begin(), latencies.end());
+    results.differing += differing;
+    results.failed += failed;
+}
+
+// Replay the recorded client sessions against a ServerNode
+int replayClients(CaptureReader& reader, const std::string& host, int port, bool realtime) {
+    // Requests are what the server received on a client connection, replies what it sent back
+    std::map<uint32_t, ClientSession> sessions;
+    std::map<uint32_t, bool> isClient;
+    uint64_t firstUs = UINT64_MAX;
+    size_t skipped = 0;
+    CaptureRecord record;
+    while (reader.next(record)) {
+        if (record.type == CaptureRecord::Type::OPEN) {
+            isClient[record.connection] = (record.message == "client");
+            continue;
+        }
+        if (!isClient[record.connection]) {
+            continue;
+        }
+
+        ClientSession& session = sessions[record.connection];
+        if (record.type == CaptureRecord::Type::RECEIVED) {
+            // Replaying close: would stop the server in the middle of the run
+            if (record.message == "close:") {
+                skipped++;
+                continue;
+            }
+            TimedMessage request = { record.timeUs, record.message };
+            session.requests.push_back(request);
+            firstUs = std::min(firstUs, record.timeUs);
+        } else if (record.type == CaptureRecord::Type::SENT && !Protocol::isEvent(record.message) &&
+                   !Protocol::isChunk(record.message) && session.replies.size() < session.requests.size()) {
+            session.replies.push_back(record.message);
+        }
+    }
+
+    size_t total = 0;
+    for (std::map<uint32_t, ClientSession>::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+        total += it->second.requests.size();
+    }
+    if (total == 0) {
+        std::cerr << "No client requests in the capture" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Replaying " << total << " requests from " << sessions.size() << " client sessions to "
+              << host << ":" << port << (realtime ? " at recorded timing" : " as fast as possible") << std::endl;
+    if (skipped > 0) {
+        std::cout << "Skipping " << skipped << " close: requests" << std::endl;
+    }
+
+    // Every session runs in its own thread, like the clients that were recorded
+    ReplayResults results;
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> threads;
+    for (std::map<uint32_t, ClientSession>::iterator it = sessions.begin(); it != sessions.end(); ++it) {
+        threads.push_back(std::thread(replaySession, std::cref(it->second), std::cref(host), port, realtime,
+                                      start, firstUs, std::ref(results)));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<uint64_t>& latencies = results.latenciesUs;
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "Requests:        " << latencies.size() << " answered, " << results.failed << " failed" << std::endl;
+    std::cout << "Total time:      " << seconds << " s" << std::endl;
+    std::cout << "Throughput:      " << (seconds > 0 ? latencies.size() / seconds : 0) << " requests/s" << std::endl;
+    std::cout << "Latency p50:     " << percentile(latencies, 0.50) << " us" << std::endl;
+    std::cout << "Latency p99:     " << percentile(latencies, 0.99) << " us" << std::endl;
+    std::cout << "Latency max:     " << (latencies.empty() ? 0 : latencies.back()) << " us" << std::endl;
+    std::cout << "Differing replies: " << results.differing << std::endl;
+    return results.failed == 0 ? 0 : 1;
+}
+
+// Push the recorded events to the server, then return
+void replayEvents(const std::vector<TimedMessage>& events, SocketCon& connection, std::mutex& sendMutex,
+                  bool realtime, Clock::time_point start, uint64_t firstUs, const std::atomic<bool>& stopping) {
+    for (size_t i = 0; i < events.size() && !stopping; i++) {
+        // Wait in short steps so a closing connection is not held up by a long gap
+        Clock::time_point due = start + std::chrono::microseconds(events[i].timeUs - firstUs);
+        while (realtime && !stopping && Clock::now() < due) {
+            std::this_thread::sleep_until(std::min(due, Clock::now() + std::chrono::milliseconds(100)));
+        }
+        std::lock_guard<std::mutex> lock(sendMutex);
+        if (!connection.send(events[i].message)) {
+            return;
+        }
+    }
+}
+
+// Stand in for a device node, answering with the recorded replies
+int replayNode(CaptureReader& reader, const std::string& name, int port, bool realtime) {
+    // On the server's link to the node, SENT records are requests and RECEIVED
+    // records are replies or events; tagged replies pair up with the request of
+    // the same tag, untagged ones (older captures) in order. The chunks of a
+    // streamed reply are kept with its final reply; the server's flow control
+    // messages need no answer and are left out
+    std::map<std::string, std::deque<RecordedReply> > replies;
+    std::vector<TimedMessage> events;
+    std::map<uint32_t, std::deque<TimedMessage> > outstanding;
+    std::map<std::pair<uint32_t, uint32_t>, TimedMessage> outstandingTagged;
+    std::map<std::pair<uint32_t, uint32_t>, std::vector<std::string> > streamedChunks;
+    std::map<uint32_t, bool> isNode;
+    uint64_t firstUs = UINT64_MAX;
+    size_t count = 0;
+    CaptureRecord record;
+    while (reader.next(record)) {
+        if (record.type == CaptureRecord::Type::OPEN) {
+            isNode[record.connection] = (record.message == name);
+            continue;
+        }
+        if (!isNode[record.connection] || record.type == CaptureRecord::Type::CLOSE) {
+            continue;
+        }
+        firstUs = std::min(firstUs, record.timeUs);
+
+        uint32_t tag = 0;
+        std::string body;
+        bool tagged = Protocol::splitTagged(record.message, tag, body);
+        std::pair<uint32_t, uint32_t> key(record.connection, tag);
+        if (record.type == CaptureRecord::Type::SENT) {
+            if (tagged && (body == Protocol::STREAM_MORE || body == Protocol::STREAM_STOP)) {
+                continue;
+            }
+            TimedMessage request = { record.timeUs, tagged ? body : record.message };
+            if (tagged) {
+                outstandingTagged[key] = request;
+            } else {
+                outstanding[record.connection].push_back(request);
+            }
+        } else if (Protocol::isEvent(record.message)) {
+            TimedMessage event = { record.timeUs, record.message };
+            events.push_back(event);
+        } else if (tagged && Protocol::isChunk(body)) {
+            streamedChunks[key].push_back(body);
+        } else if (tagged) {
+            std::map<std::pair<uint32_t, uint32_t>, TimedMessage>::iterator request = outstandingTagged.find(key);
+            if (request != outstandingTagged.end()) {
+                RecordedReply reply = { body, record.timeUs - request->second.timeUs, streamedChunks[key] };
+                replies[request->second.message].push_back(reply);
+                outstandingTagged.erase(request);
+                streamedChunks.erase(key);
+                count++;
+            }
+        } else if (!outstanding[record.connection].empty()) {
+            TimedMessage request = outstanding[record.connection].front();
+            outstanding[record.connection].pop_front();
+            RecordedReply reply = { record.message, record.timeUs - request.timeUs, std::vector<std::string>() };
+            replies[request.message].push_back(reply);
+            count++;
+        }
+    }
+
+    if (count == 0 && events.empty()) {
+        std::cerr << "No traffic of the " << name << " Node in the capture" << std::endl;
+        return 1;
+    }
+    std::cout << "Loaded " << count << " replies to " << replies.size() << " distinct requests and "
+              << events.size() << " events of the " << name << " Node" << std::endl;
+
+    SocketCon server(SocketCon::Mode::SERVER, "", port);
+    if (!server.listen()) {
+        std::cerr << "Failed to listen on port " << port << std::endl;
+        return 1;
+    }
+    std::cout << "Replaying " << name << " Node on port " << port << "..." << std::endl;
+
+    // Serve one server connection at a time, like the real node
+    bool closing = false;
+    while (!closing) {
+        std::unique_ptr<SocketCon> connection = server.accept();
+        if (!connection) {
+            break;
+        }
+
+        std::mutex sendMutex;
+        std::atomic<bool> stopping(false);
+        Clock::time_point start = Clock::now();
+        std::thread eventThread(replayEvents, std::cref(events), std::ref(*connection), std::ref(sendMutex),
+                                realtime, start, firstUs, std::cref(stopping));
+
+        std::string message;
+        while (connection->receive(message)) {
+            // Answer tagged requests with the same tag, like the real node
+            uint32_t tag = 0;
+            std::string command;
+            bool tagged = Protocol::splitTagged(message, tag, command);
+            if (!tagged) {
+                command = message;
+            }
+
+            // Recorded streams are sent in one go, so acknowledgements need no answer
+            if (tagged && (command == Protocol::STREAM_MORE || command == Protocol::STREAM_STOP)) {
+                continue;
+            }
+
+            std::string response = "error: unknown command:";
+            uint64_t latencyUs = 0;
+            std::vector<std::string> chunks;
+            if (command == "close:") {
+                response = "close ok:";
+                closing = true;
+            } else {
+                std::map<std::string, std::deque<RecordedReply> >::iterator found = replies.find(command);
+                if (found != replies.end()) {
+                    // Cycle through the recorded replies so the tool can run longer than the recording
+                    RecordedReply reply = found->second.front();
+                    found->second.pop_front();
+                    found->second.push_back(reply);
+                    response = reply.message;
+                    latencyUs = reply.latencyUs;
+                    chunks = reply.chunks;
+                }
+            }
+
+            if (realtime && latencyUs > 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(latencyUs));
+            }
+            std::lock_guard<std::mutex> lock(sendMutex);
+            bool sent = true;
+            for (size_t i = 0; i < chunks.size() && sent; i++) {
+                sent = connection->send(tagged ? Protocol::makeTagged(tag, chunks[i]) : chunks[i]);
+            }
+            if (!sent || !connection->send(tagged ? Protocol::makeTagged(tag, response) : response) || closing) {
+                break;
+            }
+        }
+
+        stopping = true;
+        connection->shutdown();
+        eventThread.join();
+        connection->release();
+    }
+
+    server.release();
+    std::cout << name << " Node replay finished" << std::endl;
+    return 0;
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <capture> client [host] [port] [--realtime]" << std::endl;
+    std::cerr << "       " << program << " <capture> node <GyroSensor|DigitalIO> [port] [--realtime]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    // A server that goes away must end the replay, not kill it
+    signal(SIGPIPE, SIG_IGN);
+
+    // Positional arguments, with --realtime allowed anywhere
+    std::vector<std::string> args;
+    bool realtime = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--realtime") {
+            realtime = true;
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    CaptureReader reader;
+    if (!reader.open(args[0])) {
+        return 1;
+    }
+
+    if (args[1] == "client") {
+        std::string host = args.size() > 2 ? args[2] : "127.0.0.1";
+        int port = args.size() > 3 ? std::atoi(args[3].c_str()) : 7001;
+        return replayClients(reader, host, port, realtime);
+    }
+
+    if (args[1] == "node" && args.size() > 2 && (args[2] == "GyroSensor" || args[2] == "DigitalIO")) {
+        int port = args.size() > 3 ? std::atoi(args[3].c_str()) : (args[2] == "GyroSensor" ? 7003 : 7002);
+        return replayNode(reader, args[2], port, realtime);
+    }
+
+    printUsage(argv[0]);
+    return 1;
+}
@@ -1,7 +1,30 @@
 #include "include/SocketConLib.h"
+#include "include/ResponseCacheLib.h"
+#include "include/ProtocolLib.h"
+#include "include/EventLoopLib.h"
+#include "include/TaskLib.h"
+#include "include/TelemetryLib.h"
+#include "include/BrokerLib.h"
+#include "include/CaptureLib.h"
+#include "include/NodeServiceLib.h"
+#include "include/RtLib.h"
+#include "include/WorkerPoolLib.h"
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <chrono>
 #include <csignal>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <unistd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -15,36 +38,1069 @@ void signalHandler(int signum) {
     running = 0;
 }
 
-int main() {
+// Round-trip times of the requests of one priority class, in microseconds;
+// percentiles are taken over the most recent requests
+class LaneLatency {
+public:
+    LaneLatency() : next(0), count(0), maxUs(0) {
+    }
+    
+    void record(std::chrono::steady_clock::duration elapsed) {
+        uint32_t us = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+        if (recent.size() < RECENT) {
+            recent.push_back(us);
+        } else {
+            recent[next] = us;
+            next = (next + 1) % RECENT;
+        }
+        count++;
+        maxUs = std::max(maxUs, us);
+    }
+    
+    // "<requests> <p50> <p99> <max>"
+    std::string format() const {
+        std::vector<uint32_t> sorted(recent);
+        std::sort(sorted.begin(), sorted.end());
+        std::ostringstream out;
+        out << count << " " << (sorted.empty() ? 0 : sorted[sorted.size() / 2]) << " "
+            << (sorted.empty() ? 0 : sorted[sorted.size() * 99 / 100]) << " " << maxUs;
+        return out.str();
+    }
+    
+private:
+    static const size_t RECENT = 1024;
+    
+    std::vector<uint32_t> recent;
+    size_t next;
+    uint64_t count;
+    uint32_t maxUs;
+};
+
+// Connection to one of the device nodes, shared by all client sessions.
+// The link attaches in the background and re-attaches whenever the node goes away,
+// so the nodes can be started in any order. Requests are tagged and pipelined on
+// the connection, and the node may answer them in any order; events the node
+// pushes in between go to the broker. All methods except start() and stop() run
+// on the event loop thread.
+// Requests wait in one lane per priority class. Control commands are sent at
+// once; reads are limited to READ_WINDOW on the connection, so a control
+// command never queues behind more than that many reads, however many clients
+// poll. Status reads go before bulk ones, but every STATUS_PER_BULK-th read
+// slot goes to a waiting bulk request so that bulk is not starved.
+// Every request has a deadline. A node that stops answering (e.g. wedged on
+// the I2C bus) therefore costs each request at most the deadline; after
+// BREAKER_TIMEOUTS timeouts in a row the link opens its circuit breaker and
+// fails requests at once. A heartbeat ping every HEARTBEAT_MS detects a hang
+// without client traffic, and its first answer closes the breaker again.
+// Streamed replies are passed on to the client chunk by chunk. A chunk is
+// acknowledged to the node only once the client has taken it, so a slow
+// client holds up its own stream, never the link, and each stream keeps at
+// most Protocol::STREAM_WINDOW chunks in this process.
+// Settings given with configure() are sent again whenever the link re-attaches,
+// so a restarted node gets them back.
+// With a capture writer, every connection to the node is recorded under its name.
+// In the all-in-one build the link instead wraps a node service running in this
+// process and calls it directly, without a socket. Commands the service may
+// have to wait for (NodeService::mayBlock) run on a helper thread instead of
+// the loop thread, so no client waits for another client's sensor to wake up.
+class NodeLink {
+public:
+    NodeLink(const std::string& name, int port, EventLoop& loop, Broker& broker, CaptureWriter* capture)
+        : name(name), port(port), loop(loop), broker(broker), capture(capture), service(NULL),
+          nextTag(0), deadlineMs(DEFAULT_DEADLINE_MS), readsInFlight(0), statusSinceBulk(0), timeouts(0),
+          breakerOpen(false), probing(false), heartbeatTimer(0), attached(false), stopping(false) {
+    }
+    
+    NodeLink(const std::string& name, NodeService& service, EventLoop& loop, Broker& broker)
+        : name(name), port(0), loop(loop), broker(broker), capture(NULL), service(&service),
+          nextTag(0), deadlineMs(DEFAULT_DEADLINE_MS), readsInFlight(0), statusSinceBulk(0), timeouts(0),
+          breakerOpen(false), probing(false), heartbeatTimer(0), attached(false), stopping(false) {
+    }
+    
+    ~NodeLink() {
+        stop();
+    }
+    
+    // Start attaching to the node in the background, or start the in-process service
+    void start() {
+        if (service != NULL) {
+            // Events come from the service's threads; the broker lives on the loop thread
+            service->start([this](const std::string& event) {
+                loop.post([this, event]() {
+                    broker.publish(Protocol::topicOf(event), event);
+                });
+            });
+            blocking.reset(new WorkerPool(1));
+            std::cout << name << " service running in-process" << std::endl;
+            return;
+        }
+        heartbeatTimer = loop.runAfter(HEARTBEAT_MS, [this]() {
+            heartbeat();
+        });
+        connector = std::thread(&NodeLink::connectLoop, this);
+    }
+    
+    // Set how long a request may take before it fails with a timeout
+    void setDeadline(int ms) {
+        deadlineMs = ms;
+    }
+    
+    // Stop attaching and close the connection, or stop the in-process service
+    void stop() {
+        if (service != NULL) {
+            blocking.reset();
+            service->stop();
+            return;
+        }
+        loop.cancelTimer(heartbeatTimer);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (connector.joinable()) {
+            connector.join();
+        }
+        // Keep the connection alive while the reader finishes
+        std::shared_ptr<SocketCon> current = socket;
+        if (current) {
+            current->release();
+        }
+    }
+    
+    // Send a command and wait for the node's response
+    Task<std::string> request(std::string command) {
+        Protocol::Priority priority = Protocol::priorityOf(command);
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        
+        // The in-process services mostly answer from memory, so they are called on the loop
+        // thread; a command that may wait for a device goes to the helper thread
+        if (service != NULL) {
+            std::string response;
+            if (blocking && service->mayBlock(command)) {
+                response = co_await handleOffLoop(command);
+            } else {
+                response = service->handle(command);
+            }
+            latency[static_cast<int>(priority)].record(std::chrono::steady_clock::now() - begin);
+            co_return response;
+        }
+        
+        // Fail fast instead of stalling the client while the node is away
+        if (!socket) {
+            co_return "error: " + name + " Node unavailable:";
+        }
+        
+        // Do not let clients wait out the deadline of a node known to hang
+        if (breakerOpen) {
+            co_return "error: " + name + " Node not responding:";
+        }
+        
+        std::string response = co_await exchange(command, priority);
+        latency[static_cast<int>(priority)].record(std::chrono::steady_clock::now() - begin);
+        co_return response;
+    }
+    
+    // Send a streamed command, passing its chunks on to the client as they arrive, and return the final reply
+    Task<std::string> requestStream(std::string command, std::shared_ptr<SocketCon> client) {
+        Protocol::Priority priority = Protocol::priorityOf(command);
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        
+        if (service != NULL) {
+            std::unique_ptr<ReplyStream> stream = service->openStream(command);
+            if (!stream) {
+                co_return service->handle(command);
+            }
+            // Waiting for each send keeps one chunk in memory however slow the client is
+            std::string chunk;
+            while (stream->next(chunk)) {
+                std::string message = Protocol::makeChunk(chunk);
+                if (!co_await client->send(loop, message)) {
+                    break;
+                }
+            }
+            latency[static_cast<int>(priority)].record(std::chrono::steady_clock::now() - begin);
+            co_return stream->end();
+        }
+        
+        if (!socket) {
+            co_return "error: " + name + " Node unavailable:";
+        }
+        if (breakerOpen) {
+            co_return "error: " + name + " Node not responding:";
+        }
+        
+        std::string response = co_await exchange(command, priority, client);
+        latency[static_cast<int>(priority)].record(std::chrono::steady_clock::now() - begin);
+        co_return response;
+    }
+    
+    // Send a command that configures the node, e.g. "demand 50 0:", now and after every re-attach;
+    // a later command with the same key replaces it
+    void configure(const std::string& key, const std::string& command) {
+        settings[key] = command;
+        if (service != NULL) {
+            service->handle(command);
+        } else if (socket) {
+            spawn(applySetting(command));
+        }
+    }
+    
+    // Latency per priority class: "<node> control <requests> <p50 us> <p99 us> <max us> status ... bulk ..."
+    std::string laneReport() const {
+        const char* const names[Protocol::PRIORITIES] = { "control", "status", "bulk" };
+        std::string report = name;
+        for (int i = 0; i < Protocol::PRIORITIES; i++) {
+            report += std::string(" ") + names[i] + " " + latency[i].format();
+        }
+        return report;
+    }
+    
+private:
+    // Time to spend in one connect() call before checking for shutdown
+    static const int ATTACH_TIMEOUT_MS = 500;
+    
+    // Reads that may be outstanding on the node connection
+    static const int READ_WINDOW = 4;
+    
+    // Status reads sent in a row before a waiting bulk request gets a slot
+    static const int STATUS_PER_BULK = 8;
+    
+    // Time a request may take, from queuing to the reply, unless set with setDeadline()
+    static const int DEFAULT_DEADLINE_MS = 250;
+    
+    // Interval between heartbeat pings
+    static const int HEARTBEAT_MS = 1000;
+    
+    // Timeouts in a row that open the circuit breaker
+    static const int BREAKER_TIMEOUTS = 3;
+    
+    // A request waiting in its lane or for the node's reply
+    struct Queued {
+        std::string command;
+        Protocol::Priority priority;
+        uint32_t tag;
+        EventLoop::TimerId deadline;
+        Completion<std::string> reply;
+        
+        // Where the chunks of a streamed reply go
+        std::shared_ptr<SocketCon> client;
+    };
+    
+    // Answer a command of the in-process service on the helper thread; the reply is delivered on the loop thread
+    Completion<std::string> handleOffLoop(const std::string& command) {
+        Completion<std::string> reply;
+        blocking->submit(std::vector<std::string>(), [this, command, reply]() {
+            std::string response = service->handle(command);
+            loop.post([reply, response]() {
+                reply.set(response);
+            });
+        });
+        return reply;
+    }
+    
+    // Queue a request with a deadline and wait for the reply or the timeout
+    Task<std::string> exchange(std::string command, Protocol::Priority priority,
+                               std::shared_ptr<SocketCon> client = nullptr) {
+        Queued queued = { command, priority, nextTag++, 0, Completion<std::string>(), client };
+        uint32_t tag = queued.tag;
+        queued.deadline = loop.runAfter(deadlineMs, [this, tag]() {
+            expire(tag);
+        });
+        lanes[static_cast<int>(priority)].push_back(queued);
+        dispatch();
+        std::string response = co_await queued.reply;
+        co_return response;
+    }
+    
+    // Fail a request whose deadline passed, wherever it is waiting
+    void expire(uint32_t tag) {
+        Queued expired;
+        std::map<uint32_t, Queued>::iterator found = waiting.find(tag);
+        if (found != waiting.end()) {
+            expired = found->second;
+            waiting.erase(found);
+            if (expired.priority != Protocol::Priority::CONTROL) {
+                // The node is still working on the read, so its slot stays taken until the reply comes
+                expiredReads.insert(tag);
+            }
+        } else {
+            bool queued = false;
+            for (int i = 0; i < Protocol::PRIORITIES && !queued; i++) {
+                for (std::deque<Queued>::iterator it = lanes[i].begin(); it != lanes[i].end(); ++it) {
+                    if (it->tag == tag) {
+                        expired = *it;
+                        lanes[i].erase(it);
+                        queued = true;
+                        break;
+                    }
+                }
+            }
+            if (!queued) {
+                return;
+            }
+        }
+        
+        timeouts++;
+        if (!breakerOpen && timeouts >= BREAKER_TIMEOUTS) {
+            breakerOpen = true;
+            std::cerr << name << " Node not responding; failing requests until it answers again" << std::endl;
+            failQueued("error: " + name + " Node not responding:");
+        }
+        dispatch();
+        expired.reply.set("error: " + name + " Node timeout:");
+    }
+    
+    // Pass a chunk of a streamed reply on to its client, and acknowledge it to the node once sent
+    void forwardChunk(uint32_t tag, const std::string& chunk) {
+        std::map<uint32_t, Queued>::iterator found = waiting.find(tag);
+        if (found == waiting.end() || !found->second.client) {
+            // The request expired or was not a stream; the node ends it with its final reply
+            socket->sendAsync(loop, Protocol::makeTagged(tag, Protocol::STREAM_STOP));
+            return;
+        }
+        
+        // The node is making progress, so the deadline starts over for the next chunk
+        loop.cancelTimer(found->second.deadline);
+        found->second.deadline = loop.runAfter(deadlineMs, [this, tag]() {
+            expire(tag);
+        });
+        
+        std::shared_ptr<SocketCon> node = socket;
+        found->second.client->sendAsync(loop, chunk, [this, node, tag](bool ok) {
+            // A client that went away gets no more chunks
+            if (node == socket) {
+                node->sendAsync(loop, Protocol::makeTagged(tag, ok ? Protocol::STREAM_MORE : Protocol::STREAM_STOP));
+            }
+        });
+    }
+    
+    // Send one setting; a node that is away gets it when the link attaches again
+    Task<void> applySetting(std::string command) {
+        std::string response = co_await request(command);
+        if (response.compare(0, 5, "error") == 0) {
+            std::cerr << name << " Node did not take " << command << " " << response << std::endl;
+        }
+    }
+    
+    // Fail every request that is still waiting in a lane
+    void failQueued(const std::string& error) {
+        std::vector<Completion<std::string> > failed;
+        for (int i = 0; i < Protocol::PRIORITIES; i++) {
+            for (size_t j = 0; j < lanes[i].size(); j++) {
+                loop.cancelTimer(lanes[i][j].deadline);
+                failed.push_back(lanes[i][j].reply);
+            }
+            lanes[i].clear();
+        }
+        for (size_t i = 0; i < failed.size(); i++) {
+            failed[i].set(error);
+        }
+    }
+    
+    // Ping the node now and then; a hung node is noticed without client traffic
+    void heartbeat() {
+        if (socket && !probing) {
+            probing = true;
+            spawn(probe());
+        }
+        heartbeatTimer = loop.runAfter(HEARTBEAT_MS, [this]() {
+            heartbeat();
+        });
+    }
+    
+    // One heartbeat; the reply or timeout updates the breaker like any request
+    Task<void> probe() {
+        co_await exchange("ping:", Protocol::Priority::CONTROL);
+        probing = false;
+    }
+    
+    // Send waiting requests, most urgent lane first, as far as the read window allows
+    void dispatch() {
+        std::deque<Queued>& control = lanes[static_cast<int>(Protocol::Priority::CONTROL)];
+        std::deque<Queued>& status = lanes[static_cast<int>(Protocol::Priority::STATUS)];
+        std::deque<Queued>& bulk = lanes[static_cast<int>(Protocol::Priority::BULK)];
+        
+        while (socket) {
+            std::deque<Queued>* lane = NULL;
+            if (!control.empty()) {
+                lane = &control;
+            } else if (readsInFlight >= READ_WINDOW) {
+                break;
+            } else if (!status.empty() && (bulk.empty() || statusSinceBulk < STATUS_PER_BULK)) {
+                lane = &status;
+                statusSinceBulk++;
+            } else if (!bulk.empty()) {
+                lane = &bulk;
+                statusSinceBulk = 0;
+            } else {
+                break;
+            }
+            
+            Queued next = lane->front();
+            lane->pop_front();
+            if (next.priority != Protocol::Priority::CONTROL) {
+                readsInFlight++;
+            }
+            
+            // Tag the request so the node may answer requests out of order
+            waiting[next.tag] = next;
+            socket->sendAsync(loop, Protocol::makeTagged(next.tag, next.command));
+        }
+    }
+    
+    // Keep a connection to the node open for as long as the link runs
+    void connectLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::cout << "Waiting for " << name << " Node on port " << port << "..." << std::endl;
+        
+        while (!stopping) {
+            if (attached) {
+                wake.wait(lock);
+                continue;
+            }
+            
+            // Connect without holding the lock so stop() is not delayed
+            lock.unlock();
+            std::shared_ptr<SocketCon> candidate(new SocketCon(SocketCon::Mode::CLIENT, "127.0.0.1", port));
+            bool connected = candidate->connect(ATTACH_TIMEOUT_MS);
+            lock.lock();
+            
+            if (connected && !stopping) {
+                if (capture != NULL) {
+                    candidate->setCapture(capture, name);
+                }
+                
+                // Hand the connection over to the loop thread
+                attached = true;
+                loop.post([this, candidate]() {
+                    spawn(readReplies(candidate));
+                });
+            }
+        }
+    }
+    
+    // Use a connection established by the connector until the node goes away
+    Task<void> readReplies(std::shared_ptr<SocketCon> connection) {
+        socket = connection;
+        timeouts = 0;
+        breakerOpen = false;
+        std::cout << "Connected to " << name << " Node" << std::endl;
+        for (std::map<std::string, std::string>::iterator it = settings.begin(); it != settings.end(); ++it) {
+            spawn(applySetting(it->second));
+        }
+        
+        std::string response;
+        while (co_await connection->receive(loop, response)) {
+            if (Protocol::isEvent(response)) {
+                // Not a reply: hand it to the subscribers. Events can be frequent and binary, so they are not logged
+                broker.publish(Protocol::topicOf(response), response);
+                continue;
+            }
+            
+            uint32_t tag = 0;
+            std::string body;
+            bool tagged = Protocol::splitTagged(response, tag, body);
+            if (tagged && Protocol::isChunk(body)) {
+                // Chunks can be many and large, so they are not logged
+                forwardChunk(tag, body);
+                continue;
+            }
+            
+            std::cout << name << " response: " << response << std::endl;
+            if (!tagged) {
+                continue;
+            }
+            std::map<uint32_t, Queued>::iterator found = waiting.find(tag);
+            if (found != waiting.end()) {
+                Queued answered = found->second;
+                waiting.erase(found);
+                loop.cancelTimer(answered.deadline);
+                if (answered.priority != Protocol::Priority::CONTROL) {
+                    readsInFlight--;
+                }
+                
+                // Any answer shows the node is working again
+                timeouts = 0;
+                if (breakerOpen) {
+                    breakerOpen = false;
+                    std::cout << name << " Node responding again" << std::endl;
+                }
+                dispatch();
+                answered.reply.set(body);
+            } else if (expiredReads.erase(tag) > 0) {
+                // Late reply to an expired read: nobody waits for it, but it frees the slot
+                readsInFlight--;
+                dispatch();
+            }
+        }
+        
+        // Drop the broken connection, fail what is outstanding and let the connector attach again
+        socket->release();
+        socket.reset();
+        
+        std::vector<Completion<std::string> > failed;
+        for (std::map<uint32_t, Queued>::iterator it = waiting.begin(); it != waiting.end(); ++it) {
+            loop.cancelTimer(it->second.deadline);
+            failed.push_back(it->second.reply);
+        }
+        waiting.clear();
+        expiredReads.clear();
+        readsInFlight = 0;
+        failQueued("error: " + name + " Node disconnected:");
+        for (size_t i = 0; i < failed.size(); i++) {
+            failed[i].set("error: " + name + " Node disconnected:");
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            attached = false;
+        }
+        wake.notify_all();
+    }
+    
+    std::string name;
+    int port;
+    EventLoop& loop;
+    Broker& broker;
+    CaptureWriter* capture;
+    NodeService* service;
+    
+    // Runs the in-process service's commands that may block
+    std::unique_ptr<WorkerPool> blocking;
+    
+    // Owned by the loop thread; requests sent to the node and not yet answered are kept by tag
+    std::shared_ptr<SocketCon> socket;
+    std::map<uint32_t, Queued> waiting;
+    uint32_t nextTag;
+    int deadlineMs;
+    std::deque<Queued> lanes[Protocol::PRIORITIES];
+    int readsInFlight;
+    int statusSinceBulk;
+    LaneLatency latency[Protocol::PRIORITIES];
+    
+    // Reads that expired after they were sent; each keeps its slot in the read window until the node answers
+    std::set<uint32_t> expiredReads;
+    
+    // Settings by key, sent again on every attach
+    std::map<std::string, std::string> settings;
+    
+    // Circuit breaker and heartbeat, also on the loop thread
+    int timeouts;
+    bool breakerOpen;
+    bool probing;
+    EventLoop::TimerId heartbeatTimer;
+    
+    // Shared with the connector thread
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread connector;
+    bool attached;
+    bool stopping;
+};
+
+// Default response TTLs; values can be overridden with --ttl <command>=<ms>
+void configureCache(ResponseCache& cache) {
+    // The sensor type never changes
+    cache.setTtl("sensorType:", ResponseCache::FOREVER);
+    
+    // The gyro node refreshes its snapshot every 5 ms
+    cache.setTtl("gyro:", 5);
+    cache.setTtl("acc:", 5);
+    cache.setTtl("temp:", 5);
+    cache.setTtl("attitude:", 5);
+    
+    cache.setTtl("sensorState:", 10);
+    
+    // Relay changes go through this server and invalidate the entry
+    cache.setTtl("relayState:", 1000);
+    cache.setTtl("relaysState:", 1000);
+    
+    // key: clears the key buffer on the node, so it is never cached
+    cache.setTtl("key:", ResponseCache::NO_CACHE);
+    
+    // Stamped reads are cached like the plain ones; the stamp tells the client how old the value is
+    const char* const stampable[] = { "gyro:", "acc:", "temp:", "attitude:", "sensorState:", "relayState:",
+                                      "relaysState:" };
+    for (size_t i = 0; i < sizeof(stampable) / sizeof(stampable[0]); i++) {
+        cache.setTtl(Protocol::STAMP_PREFIX + stampable[i], cache.getTtl(stampable[i]));
+    }
+}
+
+// Drop cached responses that a write command makes stale
+void invalidateAfterWrite(const std::string& command, ResponseCache& cache) {
+    if (Protocol::isWrite(command)) {
+        cache.invalidate("relayState:");
+        cache.invalidate(Protocol::STAMP_PREFIX + "relayState:");
+        cache.invalidate("relaysState:");
+        cache.invalidate(Protocol::STAMP_PREFIX + "relaysState:");
+    }
+}
+
+// Forward commands that belong to one node in a single round trip, answering
+// what we can from the cache. The responses are returned in command order.
+Task<std::vector<std::string> > forwardToNode(NodeLink& link, std::vector<std::string> commands,
+                                              ResponseCache& cache) {
+    std::vector<std::string> responses(commands.size());
+    std::vector<size_t> toSend;
+    std::vector<bool> mustComplete(commands.size(), false);
+    std::vector<std::pair<size_t, Completion<std::string> > > pending;
+    
+    // A write changes what later reads in the same group see, so such groups bypass the cache
+    bool hasWrite = false;
+    for (size_t i = 0; i < commands.size(); i++) {
+        hasWrite = hasWrite || Protocol::isWrite(commands[i]);
+    }
+    
+    for (size_t i = 0; i < commands.size(); i++) {
+        if (hasWrite) {
+            toSend.push_back(i);
+            continue;
+        }
+        
+        Completion<std::string> fetched;
+        ResponseCache::Lookup result = cache.acquire(commands[i], responses[i], fetched.setter());
+        
+        if (result == ResponseCache::Lookup::PENDING) {
+            pending.push_back(std::make_pair(i, fetched));
+        } else if (result != ResponseCache::Lookup::HIT) {
+            mustComplete[i] = (result == ResponseCache::Lookup::FETCH);
+            toSend.push_back(i);
+        }
+    }
+    
+    if (!toSend.empty()) {
+        std::vector<std::string> requests;
+        for (size_t i = 0; i < toSend.size(); i++) {
+            requests.push_back(commands[toSend[i]]);
+        }
+        
+        // Send a lone command as is and several as one batch
+        std::string request = requests.size() == 1 ? requests[0] : Protocol::makeBatch(requests);
+        std::string reply = co_await link.request(request);
+        std::vector<std::string> replies;
+        if (requests.size() == 1) {
+            replies.push_back(reply);
+        } else if (Protocol::isBatch(reply)) {
+            replies = Protocol::splitBatch(reply);
+        }
+        
+        for (size_t i = 0; i < toSend.size(); i++) {
+            size_t index = toSend[i];
+            if (replies.size() == requests.size()) {
+                responses[index] = replies[i];
+            } else {
+                responses[index] = reply.substr(0, 5) == "error" ? reply : "error: malformed batch reply:";
+            }
+            
+            if (mustComplete[index]) {
+                // Error replies are passed on but never cached
+                cache.complete(commands[index], responses[index], responses[index].substr(0, 5) != "error");
+            }
+            invalidateAfterWrite(commands[index], cache);
+        }
+    }
+    
+    // Collect the responses fetched by other sessions
+    for (size_t i = 0; i < pending.size(); i++) {
+        responses[pending[i].first] = co_await pending[i].second;
+    }
+    
+    co_return responses;
+}
+
+// Process a command from a client by answering it from the cache or forwarding it
+Task<std::string> processCommand(std::string command, NodeLink& gyroLink,
+                                 NodeLink& digitalIOLink, ResponseCache& cache) {
+    if (Protocol::isBatch(command)) {
+        std::vector<std::string> commands = Protocol::splitBatch(command);
+        std::vector<std::string> responses(commands.size(), "error: unknown command:");
+        
+        // Group the entries by the node that handles them
+        std::vector<size_t> gyroIndices, digitalIOIndices;
+        std::vector<std::string> gyroCommands, digitalIOCommands;
+        for (size_t i = 0; i < commands.size(); i++) {
+            Protocol::Route route = Protocol::routeOf(commands[i]);
+            if (route == Protocol::Route::GYRO) {
+                gyroIndices.push_back(i);
+                gyroCommands.push_back(commands[i]);
+            } else if (route == Protocol::Route::DIGITAL_IO) {
+                digitalIOIndices.push_back(i);
+                digitalIOCommands.push_back(commands[i]);
+            }
+        }
+        
+        // Query both nodes at the same time
+        Completion<std::vector<std::string> > gyroResponses = start(forwardToNode(gyroLink, gyroCommands, cache));
+        std::vector<std::string> replies = co_await forwardToNode(digitalIOLink, digitalIOCommands, cache);
+        for (size_t i = 0; i < replies.size(); i++) {
+            responses[digitalIOIndices[i]] = replies[i];
+        }
+        replies = co_await gyroResponses;
+        for (size_t i = 0; i < replies.size(); i++) {
+            responses[gyroIndices[i]] = replies[i];
+        }
+        
+        co_return Protocol::makeBatch(responses);
+    }
+    
+    // Determine which node should receive the command
+    std::vector<std::string> commands(1, command);
+    std::vector<std::string> responses(1, "error: unknown command:");
+    switch (Protocol::routeOf(command)) {
+        case Protocol::Route::GYRO:
+            responses = co_await forwardToNode(gyroLink, commands, cache);
+            break;
+        case Protocol::Route::DIGITAL_IO:
+            responses = co_await forwardToNode(digitalIOLink, commands, cache);
+            break;
+        default:
+            // Unknown command
+            break;
+    }
+    co_return responses[0];
+}
+
+// Readings carried by a telemetry frame, fetched through the cache like any client batch
+const char* const TELEMETRY_COMMANDS[] = { "gyro:", "acc:", "temp:", "sensorState:", "relayState:" };
+
+// Read count numbers from a reply of the form "<name> <v1> ... <vn>:"
+bool parseReading(const std::string& reply, const std::string& name, float* values, int count) {
+    if (reply.compare(0, name.size() + 1, name + " ") != 0) {
+        return false;
+    }
+    std::istringstream iss(reply.substr(name.size() + 1));
+    for (int i = 0; i < count; i++) {
+        if (!(iss >> values[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Publish one telemetry frame with the latest readings
+Task<void> publishTelemetry(TelemetryPublisher& publisher, bool& busy, NodeLink& gyroLink,
+                            NodeLink& digitalIOLink, ResponseCache& cache) {
+    std::vector<std::string> commands(TELEMETRY_COMMANDS, TELEMETRY_COMMANDS + 5);
+    std::string request = Protocol::makeBatch(commands);
+    std::string reply = co_await processCommand(request, gyroLink, digitalIOLink, cache);
+    std::vector<std::string> replies = Protocol::splitBatch(reply);
+    
+    TelemetryFrame frame;
+    frame.timestampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    if (replies.size() == commands.size()) {
+        frame.imuValid = parseReading(replies[0], "gyro", frame.gyro, 3) &&
+                         parseReading(replies[1], "acc", frame.acc, 3) &&
+                         parseReading(replies[2], "temp", &frame.temperature, 1);
+        
+        float sensorState = 0.0f, relayState = 0.0f;
+        frame.digitalIOValid = parseReading(replies[3], "sensorState", &sensorState, 1) &&
+                               parseReading(replies[4], "relay", &relayState, 1);
+        frame.sensorOn = sensorState != 0.0f;
+        frame.relayOn = relayState != 0.0f;
+    }
+    
+    publisher.publish(frame);
+    busy = false;
+}
+
+// Send queued events to a subscribed client until its queue runs empty. Only
+// one delivery runs per client, so a slow client holds at most one event in
+// the loop; the rest wait in its bounded queue.
+Task<void> deliverEvents(std::shared_ptr<Broker::Subscriber> subscriber, std::shared_ptr<SocketCon> client,
+                         EventLoop& loop) {
+    std::string event;
+    while (subscriber->next(event)) {
+        if (!co_await client->send(loop, event)) {
+            break;
+        }
+    }
+}
+
+// Tell the GyroSensor Node how fast the subscribers of an IMU topic need its frames
+void updateDemand(const std::string& topic, Broker& broker, NodeLink& gyroLink) {
+    size_t index = 0;
+    if (Protocol::imuOfTopic(topic, index)) {
+        gyroLink.configure("demand " + std::to_string(index),
+                           "demand " + std::to_string(broker.requestedRate(topic)) + " " + std::to_string(index) + ":");
+    }
+}
+
+// Handle "subscribe <topic> [drop-oldest|conflate|disconnect] [<hz>]:" and "unsubscribe <topic>:"
+std::string handleSubscription(const std::string& command, Broker& broker,
+                               const std::shared_ptr<Broker::Subscriber>& subscriber, NodeLink& gyroLink) {
+    std::istringstream iss(command.substr(0, command.size() - 1));
+    std::string verb, topic, option;
+    std::vector<std::string> options;
+    iss >> verb >> topic;
+    while (iss >> option) {
+        options.push_back(option);
+    }
+    if (topic.empty() || options.size() > 2 || command[command.size() - 1] != ':' ||
+        (verb == "unsubscribe" && !options.empty())) {
+        return "error: invalid " + verb + " command:";
+    }
+    
+    if (verb == "unsubscribe") {
+        if (!broker.unsubscribe(subscriber, topic)) {
+            return "error: not subscribed:";
+        }
+        updateDemand(topic, broker, gyroLink);
+        return "unsubscribe ok:";
+    }
+    
+    // A number is the rate the subscriber needs; IMU subscribers that name none get every frame
+    Broker::Overflow policy = Broker::Overflow::DROP_OLDEST;
+    int rate = 0;
+    for (size_t i = 0; i < options.size(); i++) {
+        bool number = options[i].find_first_not_of("0123456789") == std::string::npos;
+        if (number != (i + 1 == options.size()) && options.size() == 2) {
+            return "error: invalid " + verb + " command:";
+        }
+        if (number) {
+            rate = std::atoi(options[i].c_str());
+            if (rate <= 0) {
+                return "error: invalid rate:";
+            }
+        } else if (!Broker::parseOverflow(options[i], policy)) {
+            return "error: unknown overflow policy:";
+        }
+    }
+    size_t index = 0;
+    if (rate == 0 && Protocol::imuOfTopic(topic, index)) {
+        rate = GyroService::MAX_RATE_HZ;
+    }
+    broker.subscribe(subscriber, topic, policy, rate);
+    updateDemand(topic, broker, gyroLink);
+    return "subscribe ok:";
+}
+
+// Serve one client until it disconnects or the server shuts down
+Task<void> clientSession(std::shared_ptr<SocketCon> client, std::set<std::shared_ptr<SocketCon> >& clients,
+                         EventLoop& loop, NodeLink& gyroLink, NodeLink& digitalIOLink, ResponseCache& cache,
+                         Broker& broker) {
+    // Events reach the client through its own queue, next to the replies
+    std::shared_ptr<Broker::Subscriber> subscriber = broker.attach(
+        [client, &loop](const std::shared_ptr<Broker::Subscriber>& ready) {
+            spawn(deliverEvents(ready, client, loop));
+        },
+        [client](const std::shared_ptr<Broker::Subscriber>& slow) {
+            std::cout << "Subscriber too slow, disconnecting after " << slow->getDropped()
+                      << " dropped events" << std::endl;
+            client->shutdown();
+        });
+    
+    std::string command;
+    while (co_await client->receive(loop, command)) {
+        std::cout << "Received command from client: " << command << std::endl;
+        
+        if (command == "close:") {
+            // Forward close command to both nodes at the same time
+            Completion<std::string> gyroClosed = start(gyroLink.request(command));
+            std::string closed = co_await digitalIOLink.request(command);
+            closed = co_await gyroClosed;
+            
+            // Send response to client
+            closed = "close ok:";
+            co_await client->send(loop, closed);
+            
+            // Stop the whole server
+            running = 0;
+            break;
+        }
+        
+        std::string response;
+        if (command.compare(0, 10, "subscribe ") == 0 || command.compare(0, 12, "unsubscribe ") == 0) {
+            response = handleSubscription(command, broker, subscriber, gyroLink);
+        } else if (Protocol::isStreamed(command)) {
+            // Large replies go to the client chunk by chunk instead of as one message
+            NodeLink& link = Protocol::routeOf(command) == Protocol::Route::GYRO ? gyroLink : digitalIOLink;
+            response = co_await link.requestStream(command, client);
+        } else if (command == "clock:") {
+            // All nodes share the Pi's monotonic clock, so the server answers for them
+            response = "clock " + std::to_string(Rt::monotonicNs()) + ":";
+        } else if (command == "lanes:") {
+            // Forwarding latency per node and priority class
+            response = "lanes " + gyroLink.laneReport() + " " + digitalIOLink.laneReport() + ":";
+        } else {
+            response = co_await processCommand(command, gyroLink, digitalIOLink, cache);
+        }
+        if (!co_await client->send(loop, response)) {
+            break;
+        }
+    }
+    
+    // The client's IMU subscriptions no longer count towards the sampling rate
+    std::vector<std::string> topics = broker.topicsOf(subscriber);
+    broker.detach(subscriber);
+    for (size_t i = 0; i < topics.size(); i++) {
+        updateDemand(topics[i], broker, gyroLink);
+    }
+    std::cout << "Client disconnected" << std::endl;
+    client->release();
+    clients.erase(client);
+}
+
+// Accept clients and start a session for each one
+Task<void> acceptClients(SocketCon& server, std::set<std::shared_ptr<SocketCon> >& clients, EventLoop& loop,
+                         NodeLink& gyroLink, NodeLink& digitalIOLink, ResponseCache& cache, Broker& broker,
+                         CaptureWriter* capture) {
+    while (std::unique_ptr<SocketCon> accepted = co_await server.accept(loop)) {
+        std::cout << "Client connected" << std::endl;
+        std::shared_ptr<SocketCon> client(std::move(accepted));
+        if (capture != NULL) {
+            client->setCapture(capture, "client");
+        }
+        clients.insert(client);
+        spawn(clientSession(client, clients, loop, gyroLink, digitalIOLink, cache, broker));
+    }
+}
+
+int main(int argc, char* argv[]) {
     // Set up signal handling
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
     
+    // Writes to a client that has gone away must fail instead of killing the server
+    signal(SIGPIPE, SIG_IGN);
+    
+    // Configure the response cache
+    ResponseCache cache;
+    configureCache(cache);
+    EventLoop::Backend backend = EventLoop::Backend::IO_URING;
+    
+    // Telemetry is published only when an interval is given
+    int telemetryInterval = 0;
+    std::string telemetryGroup = Telemetry::DEFAULT_GROUP;
+    int telemetryPort = Telemetry::DEFAULT_PORT;
+    std::string telemetryInterface;
+    
+    // Events queued per subscriber before its overflow policy applies
+    int queueCapacity = 64;
+    
+    // Traffic is recorded for ReplayTool only when a capture file is given
+    std::string capturePath;
+    
+    // Request deadlines per node, e.g. --deadline GyroSensor=100
+    std::map<std::string, int> deadlines;
+#ifdef RCS_ALL_IN_ONE
+    
+    // IMUs of the in-process GyroSensor service; one at the default address if none are given
+    std::vector<ImuConfig> imus;
+    ImuConfig imu;
+    
+    // Scheduling of the in-process acquisition and control threads
+    RtConfig realtime;
+    
+    // Lowest sampling rate of the IMUs, kept up even without demand
+    int minRate = 0;
+    
+    // Relay pins of the in-process DigitalIO service; one relay at the default pin if none are given
+    std::vector<int> relayPins;
+#endif
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--epoll") {
+            backend = EventLoop::Backend::EPOLL;
+            continue;
+        }
+        
+        std::string value = i + 1 < argc ? argv[++i] : "";
+        size_t pos = value.find(option == "--ttl" || option == "--deadline" ? '=' : ':');
+        if (option == "--ttl" && pos != std::string::npos) {
+            // The stamped form of the command follows the plain one
+            cache.setTtl(value.substr(0, pos), std::atoi(value.c_str() + pos + 1));
+            cache.setTtl(Protocol::STAMP_PREFIX + value.substr(0, pos), std::atoi(value.c_str() + pos + 1));
+        } else if (option == "--telemetry" && std::atoi(value.c_str()) > 0) {
+            telemetryInterval = std::atoi(value.c_str());
+        } else if (option == "--telemetry-group" && pos != std::string::npos) {
+            telemetryGroup = value.substr(0, pos);
+            telemetryPort = std::atoi(value.c_str() + pos + 1);
+        } else if (option == "--telemetry-if" && !value.empty()) {
+            telemetryInterface = value;
+        } else if (option == "--queue" && std::atoi(value.c_str()) > 0) {
+            queueCapacity = std::atoi(value.c_str());
+        } else if (option == "--capture" && !value.empty()) {
+            capturePath = value;
+        } else if (option == "--deadline" && pos != std::string::npos && std::atoi(value.c_str() + pos + 1) > 0 &&
+                   (value.substr(0, pos) == "GyroSensor" || value.substr(0, pos) == "DigitalIO")) {
+            deadlines[value.substr(0, pos)] = std::atoi(value.c_str() + pos + 1);
+#ifdef RCS_ALL_IN_ONE
+        } else if (option == "--imu" && GyroService::parseImu(value, imu)) {
+            imus.push_back(imu);
+        } else if (option == "--min-rate" && std::atoi(value.c_str()) > 0) {
+            minRate = std::atoi(value.c_str());
+        } else if (option == "--relay-pins" && Relay::parsePins(value, relayPins)) {
+            continue;
+        } else if (Rt::parseOption(option, value, realtime)) {
+            continue;
+#endif
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--epoll] [--ttl <command>=<ms>]..."
+                      << " [--telemetry <ms>] [--telemetry-group <group>:<port>] [--telemetry-if <address>]"
+                      << " [--queue <events>] [--capture <file>] [--deadline <GyroSensor|DigitalIO>=<ms>]..."
+#ifdef RCS_ALL_IN_ONE
+                      << " [--imu <bus>:<address>]... [--min-rate <hz>] [--relay-pins <pin>,...]"
+                      << " [--rt-priority <1-99>] [--rt-cpu <n>]"
+#endif
+                      << std::endl;
+            return 1;
+        }
+    }
+    
     std::cout << "Server Node starting..." << std::endl;
     
-    // Connect to GyroSensor Node (localhost:7003)
-    SocketCon gyroClient(SocketCon::Mode::CLIENT, "127.0.0.1", 7003);
-    if (!gyroClient.init()) {
-        std::cerr << "Failed to connect to GyroSensor Node. Make sure it's running." << std::endl;
-        return 1;
+    // Record client and node traffic; the writer outlives every connection it records
+    CaptureWriter capture;
+    CaptureWriter* recorder = NULL;
+    if (!capturePath.empty()) {
+        if (!capture.open(capturePath)) {
+            return 1;
+        }
+        recorder = &capture;
+        std::cout << "Capturing traffic to " << capturePath << std::endl;
     }
-    std::cout << "Connected to GyroSensor Node" << std::endl;
     
-    // Connect to DigitalIO Node (localhost:7002)
-    SocketCon digitalIOClient(SocketCon::Mode::CLIENT, "127.0.0.1", 7002);
-    if (!digitalIOClient.init()) {
-        std::cerr << "Failed to connect to DigitalIO Node. Make sure it's running." << std::endl;
-        gyroClient.release();
-        return 1;
+    // All clients and both nodes are served from this loop
+    EventLoop loop(backend);
+    std::cout << "Event loop backend: "
+              << (loop.getBackend() == EventLoop::Backend::IO_URING ? "io_uring" : "epoll") << std::endl;
+    
+    // Events pushed by the nodes are fanned out to subscribed clients
+    Broker broker(queueCapacity);
+    
+#ifdef RCS_ALL_IN_ONE
+    // All-in-one build: the node services run in this process and are called directly
+    Rt::configureProcess(realtime);
+    GyroService gyroService(imus);
+    DigitalIOService digitalIOService(relayPins);
+    gyroService.setRealtime(realtime);
+    gyroService.setMinRate(minRate);
+    digitalIOService.setRealtime(realtime);
+    NodeLink gyroLink("GyroSensor", gyroService, loop, broker);
+    NodeLink digitalIOLink("DigitalIO", digitalIOService, loop, broker);
+#else
+    // Attach to GyroSensor Node (localhost:7003) and DigitalIO Node (localhost:7002)
+    // in the background; clients are served meanwhile
+    NodeLink gyroLink("GyroSensor", 7003, loop, broker, recorder);
+    NodeLink digitalIOLink("DigitalIO", 7002, loop, broker, recorder);
+#endif
+    if (deadlines.count("GyroSensor") > 0) {
+        gyroLink.setDeadline(deadlines["GyroSensor"]);
     }
-    std::cout << "Connected to DigitalIO Node" << std::endl;
+    if (deadlines.count("DigitalIO") > 0) {
+        digitalIOLink.setDeadline(deadlines["DigitalIO"]);
+    }
+    gyroLink.start();
+    digitalIOLink.start();
     
     // Create server socket on port 7001
     SocketCon server(SocketCon::Mode::SERVER, "", 7001);
-    if (!server.init()) {
+    if (!server.listen()) {
         std::cerr << "Failed to initialize Server Node socket server" << std::endl;
-        gyroClient.release();
-        digitalIOClient.release();
+        gyroLink.stop();
+        digitalIOLink.stop();
         return 1;
     }
     
@@ -52,88 +1108,59 @@ int main() {
     
     // Get the local IP address to display to the user
     char hostname[128];
-    struct sockaddr_in local_addr;
-    socklen_t addr_len = sizeof(local_addr);
-    
     gethostname(hostname, sizeof(hostname));
     std::cout << "Hostname: " << hostname << std::endl;
     
     std::cout << "The Client Node should connect to this server at <IP_ADDRESS>:7001" << std::endl;
     std::cout << "Replace <IP_ADDRESS> with the IP address of this Raspberry Pi" << std::endl;
     
-    // Main processing loop
-    while (running) {
-        // Wait for a command from the client
-        std::string command;
-        if (server.receive(command)) {
-            std::cout << "Received command from client: " << command << std::endl;
-            
-            // Determine which node should receive the command
-            if (command.substr(0, 5) == "gyro:" || 
-                command.substr(0, 5) == "temp:" || 
-                command.substr(0, 4) == "acc:") {
-                // Forward to GyroSensor Node
-                gyroClient.send(command);
-                
-                // Get response from GyroSensor Node
-                std::string response;
-                if (gyroClient.receive(response)) {
-                    // Forward response to client
-                    std::cout << "GyroSensor response: " << response << std::endl;
-                    server.send(response);
-                } else {
-                    server.send("error: GyroSensor Node disconnected:");
-                }
-            }
-            else if (command.substr(0, 12) == "sensorState:" || 
-                     command.substr(0, 11) == "sensorType:" || 
-                     command.substr(0, 6) == "relay " || 
-                     command.substr(0, 11) == "relayState:" || 
-                     command.substr(0, 4) == "key:") {
-                // Forward to DigitalIO Node
-                digitalIOClient.send(command);
-                
-                // Get response from DigitalIO Node
-                std::string response;
-                if (digitalIOClient.receive(response)) {
-                    // Forward response to client
-                    std::cout << "DigitalIO response: " << response << std::endl;
-                    server.send(response);
-                } else {
-                    server.send("error: DigitalIO Node disconnected:");
-                }
-            }
-            else if (command == "close:") {
-                // Forward close command to both nodes
-                gyroClient.send(command);
-                digitalIOClient.send(command);
-                
-                // Get responses
-                std::string gyroResponse, digitalIOResponse;
-                gyroClient.receive(gyroResponse);
-                digitalIOClient.receive(digitalIOResponse);
-                
-                // Send response to client
-                server.send("close ok:");
-                
-                // Exit the loop
-                running = 0;
-            }
-            else {
-                // Unknown command
-                server.send("error: unknown command:");
-            }
+    // Accept clients and serve each one in its own coroutine
+    std::set<std::shared_ptr<SocketCon> > clients;
+    spawn(acceptClients(server, clients, loop, gyroLink, digitalIOLink, cache, broker, recorder));
+    
+    // Publish readings to passive monitors at a fixed rate; a tick is skipped
+    // while the previous frame is still being gathered
+    TelemetryPublisher publisher(telemetryGroup, telemetryPort, telemetryInterface);
+    bool publishing = false;
+    std::function<void()> publishTick = [&]() {
+        if (!publishing) {
+            publishing = true;
+            spawn(publishTelemetry(publisher, publishing, gyroLink, digitalIOLink, cache));
+        }
+        loop.runAfter(telemetryInterval, publishTick);
+    };
+    if (telemetryInterval > 0) {
+        if (publisher.init()) {
+            std::cout << "Publishing telemetry to " << telemetryGroup << ":" << telemetryPort
+                      << " every " << telemetryInterval << " ms" << std::endl;
+            loop.runAfter(telemetryInterval, publishTick);
         } else {
-            // If receive failed, the connection might be closed
-            std::cout << "Client disconnected" << std::endl;
-            break;
+            std::cerr << "Failed to initialize telemetry publisher" << std::endl;
         }
     }
     
-    // Clean up resources
+    // Check for shutdown requests from signals and close: now and then
+    std::function<void()> checkRunning = [&]() {
+        if (!running) {
+            loop.stop();
+            return;
+        }
+        loop.runAfter(200, checkRunning);
+    };
+    loop.runAfter(200, checkRunning);
+    
+    loop.run();
+    
+    // Clean up resources; sessions still waiting for their client finish here
+    std::set<std::shared_ptr<SocketCon> > remaining = clients;
+    for (std::set<std::shared_ptr<SocketCon> >::iterator it = remaining.begin(); it != remaining.end(); ++it) {
+        (*it)->release();
+    }
     server.release();
-    gyroClient.release();
-    digitalIOClient.release();
+    gyroLink.stop();
+    digitalIOLink.stop();
+    publisher.release();
+    capture.close();
     
     std::cout << "Server Node terminated" << std::endl;
     
@@ -0,0 +1,80 @@
+#ifndef ATTITUDE_LIB_H
+#define ATTITUDE_LIB_H
+
+/**
+ * @brief Orientation estimator based on the Madgwick IMU filter
+ *
+ * This class fuses gyroscope and accelerometer readings into an orientation
+ * quaternion. The gyroscope is integrated for short-term accuracy and the
+ * accelerometer pulls roll and pitch back towards gravity to cancel drift.
+ * Without a magnetometer, yaw is relative to the start-up heading and drifts slowly.
+ */
+class Attitude {
+public:
+    /**
+     * @brief Constructor for the Attitude class
+     *
+     * @param beta Filter gain; higher values trust the accelerometer more
+     */
+    explicit Attitude(double beta = 0.1);
+
+    /**
+     * @brief Reset the orientation to the identity quaternion
+     *
+     * @return void
+     */
+    void reset();
+
+    /**
+     * @brief Advance the filter by one sample
+     *
+     * @param gx Gyroscope X-axis value in degrees per second
+     * @param gy Gyroscope Y-axis value in degrees per second
+     * @param gz Gyroscope Z-axis value in degrees per second
+     * @param ax Accelerometer X-axis value (any unit, it is normalised)
+     * @param ay Accelerometer Y-axis value (any unit, it is normalised)
+     * @param az Accelerometer Z-axis value (any unit, it is normalised)
+     * @param dt Time since the previous sample in seconds
+     * @return void
+     */
+    void update(double gx, double gy, double gz,
+                double ax, double ay, double az, double dt);
+
+    /**
+     * @brief Get the roll angle
+     *
+     * @return double Rotation about the X-axis in degrees
+     */
+    double getRoll() const;
+
+    /**
+     * @brief Get the pitch angle
+     *
+     * @return double Rotation about the Y-axis in degrees
+     */
+    double getPitch() const;
+
+    /**
+     * @brief Get the yaw angle
+     *
+     * @return double Rotation about the Z-axis in degrees
+     */
+    double getYaw() const;
+
+    /**
+     * @brief Get the orientation quaternion
+     *
+     * @param q Array receiving the components in w, x, y, z order
+     * @return void
+     */
+    void getQuaternion(double q[4]) const;
+
+private:
+    // Filter gain
+    double beta;
+
+    // Orientation quaternion (w, x, y, z)
+    double q0, q1, q2, q3;
+};
+
+#endif // ATTITUDE_LIB_H
@@ -0,0 +1,203 @@
+#ifndef BROKER_LIB_H
+#define BROKER_LIB_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Topic-based publish/subscribe broker with a bounded queue per subscriber
+ *
+ * Publishing never blocks: each subscriber has its own queue, and when a
+ * subscriber cannot keep up, the overflow policy of the topic decides what
+ * happens to its events. A policy only ever drops events of its own topic;
+ * other topics, other subscribers and the publisher are not affected.
+ *
+ * The broker is not thread-safe; it is meant to be used from the event loop thread.
+ */
+class Broker {
+public:
+    /**
+     * @brief What to do when an event arrives for a subscriber whose queue is full
+     */
+    enum class Overflow {
+        DROP_OLDEST,   ///< Drop the oldest queued event of the topic, or the new one if none is queued
+        CONFLATE,      ///< Keep only the latest event of the topic, queued in room of its own beyond the capacity
+        DISCONNECT     ///< Give up on the subscriber
+    };
+
+    /**
+     * @brief Event queue of one subscriber
+     *
+     * The owner takes events with next(). The ready callback is called when
+     * events arrive while the owner is idle, i.e. after next() returned false.
+     */
+    class Subscriber : public std::enable_shared_from_this<Subscriber> {
+    public:
+        /// Called with the subscriber whose state changed
+        typedef std::function<void(const std::shared_ptr<Subscriber>&)> Callback;
+
+        /**
+         * @brief Constructor for the Subscriber class
+         *
+         * @param capacity Maximum number of queued events, besides the latest event of each CONFLATE topic
+         * @param onReady Called when events are waiting and the owner is idle
+         * @param onOverflow Called once when a DISCONNECT topic overflows
+         */
+        Subscriber(size_t capacity, const Callback& onReady, const Callback& onOverflow);
+
+        /**
+         * @brief Take the oldest queued event
+         *
+         * @param message Receives the event message
+         * @return bool True if an event was taken, false if the queue is empty; the owner is idle then
+         */
+        bool next(std::string& message);
+
+        /**
+         * @brief Check whether the subscriber was given up because of an overflow
+         *
+         * @return bool True after a DISCONNECT overflow
+         */
+        bool hasOverflowed() const;
+
+        /**
+         * @brief Get the number of events dropped because the queue was full
+         *
+         * @return uint64_t The number of events
+         */
+        uint64_t getDropped() const;
+
+        /**
+         * @brief Get the number of queued events replaced by a later event of a CONFLATE topic
+         *
+         * @return uint64_t The number of events
+         */
+        uint64_t getConflated() const;
+
+    private:
+        friend class Broker;
+
+        // Queue an event according to the topic's overflow policy
+        void push(const std::string& topic, const std::string& message, Overflow policy);
+
+        struct Event {
+            std::string topic;
+            std::string message;
+
+            // Queued in the room a CONFLATE topic has beyond the capacity
+            bool reserved;
+        };
+
+        size_t capacity;
+        Callback onReady;
+        Callback onOverflow;
+        std::deque<Event> queue;
+
+        // Events in the queue that do not count against the capacity
+        size_t reserved;
+
+        // Subscribed topics and their overflow policies, and the event rates asked for
+        std::map<std::string, Overflow> topics;
+        std::map<std::string, int> rates;
+
+        bool idle;
+        bool overflowed;
+        uint64_t dropped;
+        uint64_t conflated;
+    };
+
+    /**
+     * @brief Constructor for the Broker class
+     *
+     * @param capacity Maximum number of queued events per subscriber, besides the latest event of each CONFLATE topic
+     */
+    explicit Broker(size_t capacity = 64);
+
+    /**
+     * @brief Create a subscriber
+     *
+     * @param onReady Called when events are waiting and the owner is idle
+     * @param onOverflow Called once when a DISCONNECT topic overflows
+     * @return std::shared_ptr<Subscriber> The subscriber, not yet subscribed to any topic
+     */
+    std::shared_ptr<Subscriber> attach(const Subscriber::Callback& onReady, const Subscriber::Callback& onOverflow);
+
+    /**
+     * @brief Remove a subscriber from all topics
+     *
+     * @param subscriber The subscriber
+     * @return void
+     */
+    void detach(const std::shared_ptr<Subscriber>& subscriber);
+
+    /**
+     * @brief Subscribe to a topic; subscribing again changes the policy and rate
+     *
+     * @param subscriber The subscriber
+     * @param topic The topic
+     * @param policy Overflow policy for events of this topic
+     * @param rateHz Events per second the subscriber needs, for publishers that adapt to demand; 0 if any
+     * @return void
+     */
+    void subscribe(const std::shared_ptr<Subscriber>& subscriber, const std::string& topic, Overflow policy,
+                   int rateHz = 0);
+
+    /**
+     * @brief Unsubscribe from a topic; events already queued are still delivered
+     *
+     * @param subscriber The subscriber
+     * @param topic The topic
+     * @return bool True if the subscriber was subscribed to the topic
+     */
+    bool unsubscribe(const std::shared_ptr<Subscriber>& subscriber, const std::string& topic);
+
+    /**
+     * @brief Queue an event for every subscriber of its topic
+     *
+     * @param topic The topic
+     * @param message The event message as delivered to subscribers
+     * @return size_t Number of subscribers the event was queued for
+     */
+    size_t publish(const std::string& topic, const std::string& message);
+
+    /**
+     * @brief Get the highest event rate the subscribers of a topic asked for
+     *
+     * @param topic The topic
+     * @return int Events per second; 0 if the topic has no subscribers or none asked for a rate
+     */
+    int requestedRate(const std::string& topic) const;
+
+    /**
+     * @brief Get the topics a subscriber is subscribed to
+     *
+     * @param subscriber The subscriber
+     * @return std::vector<std::string> The topics
+     */
+    std::vector<std::string> topicsOf(const std::shared_ptr<Subscriber>& subscriber) const;
+
+    /**
+     * @brief Parse the name of an overflow policy
+     *
+     * @param name "drop-oldest", "conflate" or "disconnect"
+     * @param policy Receives the policy
+     * @return bool True if the name is known
+     */
+    static bool parseOverflow(const std::string& name, Overflow& policy);
+
+private:
+    // Maximum number of queued events per subscriber
+    size_t capacity;
+
+    // Subscribers of each topic
+    std::map<std::string, std::set<std::shared_ptr<Subscriber> > > subscribers;
+};
+
+#endif // BROKER_LIB_H
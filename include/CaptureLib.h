@@ -0,0 +1,140 @@
+#ifndef CAPTURE_LIB_H
+#define CAPTURE_LIB_H
+
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+/**
+ * @brief One entry of a capture file
+ */
+struct CaptureRecord {
+    /**
+     * @brief What happened on the connection
+     */
+    enum class Type : uint8_t {
+        OPEN = 0,       ///< Connection started; message holds its label, e.g. "client" or "GyroSensor"
+        RECEIVED = 1,   ///< Message received by the recording process
+        SENT = 2,       ///< Message sent by the recording process
+        CLOSE = 3       ///< Connection ended
+    };
+
+    uint64_t timeUs = 0;        ///< Microseconds since the capture started
+    Type type = Type::OPEN;     ///< Kind of record
+    uint32_t connection = 0;    ///< Connection the record belongs to, numbered from 1
+    std::string message;        ///< Message payload, or the label for OPEN
+};
+
+/**
+ * @brief Records the messages of any number of connections into a binary file
+ *
+ * File layout: the 8-byte magic "RCSCAP1\n", then records of
+ *     varint time delta in microseconds, type byte, varint connection,
+ *     varint length, payload
+ * where varints are unsigned LEB128 and the time delta is relative to the
+ * previous record.
+ *
+ * The class is thread-safe.
+ */
+class CaptureWriter {
+public:
+    /**
+     * @brief Constructor for the CaptureWriter class
+     */
+    CaptureWriter();
+
+    /**
+     * @brief Destructor for the CaptureWriter class; closes the file
+     */
+    ~CaptureWriter();
+
+    /**
+     * @brief Create the capture file
+     *
+     * @param path File to write; an existing file is replaced
+     * @return bool True if successful, false otherwise
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Start recording a connection
+     *
+     * @param label Role of the connection, e.g. "client", "GyroSensor" or "DigitalIO"
+     * @return uint32_t Id to pass to record(), or 0 if the file is not open
+     */
+    uint32_t openConnection(const std::string& label);
+
+    /**
+     * @brief Append a record
+     *
+     * @param connection Id returned by openConnection()
+     * @param type RECEIVED, SENT or CLOSE
+     * @param message The message; empty for CLOSE
+     * @return void
+     */
+    void record(uint32_t connection, CaptureRecord::Type type, const std::string& message);
+
+    /**
+     * @brief Flush and close the file
+     *
+     * @return void
+     */
+    void close();
+
+private:
+    // Append a record; the caller holds the mutex
+    void write(uint32_t connection, CaptureRecord::Type type, const std::string& message);
+
+    std::mutex mutex;
+    std::FILE* file;
+    std::chrono::steady_clock::time_point start;
+    uint64_t lastUs;
+    uint32_t nextConnection;
+};
+
+/**
+ * @brief Reads a file written by CaptureWriter
+ */
+class CaptureReader {
+public:
+    /**
+     * @brief Constructor for the CaptureReader class
+     */
+    CaptureReader();
+
+    /**
+     * @brief Destructor for the CaptureReader class; closes the file
+     */
+    ~CaptureReader();
+
+    /**
+     * @brief Open a capture file
+     *
+     * @param path The file
+     * @return bool True if the file is a capture file, false otherwise
+     */
+    bool open(const std::string& path);
+
+    /**
+     * @brief Read the next record
+     *
+     * @param record Receives the record
+     * @return bool True if a record was read, false at the end of the file or on a truncated record
+     */
+    bool next(CaptureRecord& record);
+
+    /**
+     * @brief Close the file
+     *
+     * @return void
+     */
+    void close();
+
+private:
+    std::FILE* file;
+    uint64_t timeUs;
+};
+
+#endif // CAPTURE_LIB_H
@@ -0,0 +1,268 @@
+#ifndef COMMAND_TABLE_LIB_H
+#define COMMAND_TABLE_LIB_H
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <charconv>
+#include <cstddef>
+
+/**
+ * @brief Name of a command as a template argument, e.g. "gyro" for "gyro <n>:"
+ */
+template <size_t N>
+struct CommandName {
+    constexpr CommandName(const char (&text)[N]) : chars() {
+        for (size_t i = 0; i < N; i++) {
+            chars[i] = text[i];
+        }
+    }
+
+    constexpr std::string_view view() const {
+        return std::string_view(chars, N - 1);
+    }
+
+    char chars[N];
+};
+
+namespace CommandTableDetail {
+    // Take the next space-separated word off the arguments
+    inline bool nextWord(std::string_view& rest, std::string_view& word) {
+        size_t start = rest.find_first_not_of(' ');
+        if (start == std::string_view::npos) {
+            rest = std::string_view();
+            return false;
+        }
+        size_t end = rest.find(' ', start);
+        word = rest.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+        rest = end == std::string_view::npos ? std::string_view() : rest.substr(end);
+        return true;
+    }
+
+    // Numbers must use up the whole word; unsigned types take no sign
+    template <typename T>
+    bool parseValue(std::string_view word, T& value) {
+        static_assert(std::is_arithmetic_v<T>, "command arguments are numbers, bool, std::string or std::optional of them");
+        const char* end = word.data() + word.size();
+        std::from_chars_result result = std::from_chars(word.data(), end, value);
+        return result.ec == std::errc() && result.ptr == end;
+    }
+
+    inline bool parseValue(std::string_view word, bool& value) {
+        if (word != "0" && word != "1") {
+            return false;
+        }
+        value = word == "1";
+        return true;
+    }
+
+    inline bool parseValue(std::string_view word, std::string& value) {
+        value.assign(word.data(), word.size());
+        return true;
+    }
+
+    template <typename T>
+    bool parseArgument(std::string_view& rest, T& value) {
+        std::string_view word;
+        return nextWord(rest, word) && parseValue(word, value);
+    }
+
+    // A missing optional argument is left empty
+    template <typename T>
+    bool parseArgument(std::string_view& rest, std::optional<T>& value) {
+        std::string_view word;
+        value.reset();
+        if (!nextWord(rest, word)) {
+            return true;
+        }
+        T parsed;
+        if (!parseValue(word, parsed)) {
+            return false;
+        }
+        value = parsed;
+        return true;
+    }
+
+    // Parse every argument in order, then insist nothing is left over
+    template <typename... Args>
+    bool parseArguments(std::string_view rest, Args&... args) {
+        std::string_view word;
+        return (parseArgument(rest, args) && ...) && !nextWord(rest, word);
+    }
+
+    template <typename... Args, size_t... I>
+    bool parseTuple(std::string_view rest, std::tuple<Args...>& args, std::index_sequence<I...>) {
+        return parseArguments(rest, std::get<I>(args)...);
+    }
+
+    // Split "<name>:" or "<name> <arguments>:"
+    inline bool splitCommand(std::string_view command, std::string_view& name, std::string_view& arguments) {
+        if (command.empty() || command.back() != ':') {
+            return false;
+        }
+        command.remove_suffix(1);
+        size_t space = command.find(' ');
+        name = command.substr(0, space);
+        arguments = space == std::string_view::npos ? std::string_view() : command.substr(space);
+        return true;
+    }
+
+    // Class and parameters of a handler; the first Skip parameters are not parsed from the command
+    template <typename Handler>
+    struct HandlerTraits;
+
+    template <typename C, typename... P>
+    struct HandlerTraits<std::string (C::*)(P...)> {
+        typedef C Class;
+        typedef std::tuple<P...> Params;
+    };
+
+    template <typename C, typename... P>
+    struct HandlerTraits<std::string (C::*)(P...) const> {
+        typedef const C Class;
+        typedef std::tuple<P...> Params;
+    };
+
+    template <size_t Skip, typename Params, typename = std::make_index_sequence<std::tuple_size_v<Params> - Skip> >
+    struct Parsed;
+
+    template <size_t Skip, typename Params, size_t... I>
+    struct Parsed<Skip, Params, std::index_sequence<I...> > {
+        typedef std::tuple<std::decay_t<std::tuple_element_t<Skip + I, Params> >...> type;
+    };
+}
+
+/**
+ * @brief Get the name of a command
+ *
+ * @param command The command, e.g. "gyro 1:"
+ * @return std::string_view The name, e.g. "gyro"; empty if the command does not end with ':'
+ */
+inline std::string_view commandName(std::string_view command) {
+    std::string_view name, arguments;
+    return CommandTableDetail::splitCommand(command, name, arguments) ? name : std::string_view();
+}
+
+/**
+ * @brief Parse the arguments of a command of the form "<name> <arg>...:"
+ *
+ * Arguments are separated by spaces. Numbers are read by type (unsigned types
+ * take no sign), bool is "0" or "1" and std::string is one word. Trailing
+ * std::optional arguments may be left out.
+ *
+ * @param command The command, e.g. "history 2000 1:"
+ * @param name The expected name, e.g. "history"
+ * @param args Receive the arguments, e.g. uint64_t and std::optional<size_t>
+ * @return bool True if the command has the name and exactly the arguments, false otherwise
+ */
+template <typename... Args>
+bool parseCommand(std::string_view command, std::string_view name, Args&... args) {
+    std::string_view found, arguments;
+    return CommandTableDetail::splitCommand(command, found, arguments) && found == name &&
+           CommandTableDetail::parseArguments(arguments, args...);
+}
+
+/**
+ * @brief One entry of a CommandTable: a command name and the member function answering it
+ *
+ * The handler returns the reply. Its parameters, after the context the table
+ * passes on (see CommandTable::handle), are the command's arguments and are
+ * parsed as by parseCommand(). A command whose arguments do not parse is
+ * answered with Invalid.
+ *
+ * @code
+ * Command<"relay", &DigitalIOService::setRelay, "relay err:">   // std::string setRelay(bool on)
+ * @endcode
+ */
+template <CommandName Name, auto Handler, CommandName Invalid = "error: unknown command:">
+struct Command {
+    typedef CommandTableDetail::HandlerTraits<decltype(Handler)> Traits;
+
+    static_assert(Name.view().find_first_of(" :") == std::string_view::npos, "command names contain no space or colon");
+
+    static constexpr std::string_view name() {
+        return Name.view();
+    }
+
+    template <typename... Context>
+    static std::string call(typename Traits::Class& service, std::string_view arguments, Context&... context) {
+        typedef typename CommandTableDetail::Parsed<sizeof...(Context), typename Traits::Params>::type Args;
+        Args args;
+        if (!CommandTableDetail::parseTuple(arguments, args, std::make_index_sequence<std::tuple_size_v<Args> >())) {
+            return std::string(Invalid.view());
+        }
+        return std::apply([&](auto&... values) {
+            return (service.*Handler)(context..., std::move(values)...);
+        }, args);
+    }
+};
+
+/**
+ * @brief Commands of a service, declared as a list of Command entries
+ *
+ * The table is resolved at compile time: handle() compares the command's
+ * name against each entry's constant name in turn and calls the matching
+ * handler directly, with no map, std::function or virtual call in between.
+ * Names must be unique, which is checked when the table is compiled.
+ *
+ * @code
+ * typedef CommandTable<
+ *     Command<"sensorState", &DigitalIOService::sensorState>,
+ *     Command<"relay", &DigitalIOService::setRelay, "relay err:">
+ * > Commands;
+ * std::string reply = Commands::handle(*this, "relay 1:");
+ * @endcode
+ */
+template <typename... Commands>
+class CommandTable {
+public:
+    static_assert(sizeof...(Commands) > 0, "a command table needs at least one command");
+
+    /**
+     * @brief Answer a command
+     *
+     * @param service The object the handlers are called on
+     * @param command The command, e.g. "gyro 1:"
+     * @param context Passed to every handler ahead of the parsed arguments, e.g. a snapshot of readings
+     * @return std::string The handler's reply, or "error: unknown command:" if no entry has the command's name
+     */
+    template <typename Service, typename... Context>
+    static std::string handle(Service& service, std::string_view command, Context&... context) {
+        std::string_view name, arguments;
+        std::string reply = "error: unknown command:";
+        if (CommandTableDetail::splitCommand(command, name, arguments)) {
+            ((name == Commands::name() && (reply = Commands::call(service, arguments, context...), true)) || ...);
+        }
+        return reply;
+    }
+
+    /**
+     * @brief Check whether the table has a command
+     *
+     * @param name The command's name, e.g. "gyro"
+     * @return bool True if an entry has the name, false otherwise
+     */
+    static constexpr bool has(std::string_view name) {
+        return ((name == Commands::name()) || ...);
+    }
+
+private:
+    static constexpr bool uniqueNames() {
+        std::string_view names[] = { Commands::name()... };
+        for (size_t i = 0; i < sizeof...(Commands); i++) {
+            for (size_t j = i + 1; j < sizeof...(Commands); j++) {
+                if (names[i] == names[j]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    static_assert(uniqueNames(), "command names must be unique");
+};
+
+#endif // COMMAND_TABLE_LIB_H
@@ -1,6 +1,7 @@
 #ifndef DIG_SENSOR_LIB_H
 #define DIG_SENSOR_LIB_H
 
+#include "GpioLib.h"
 #include <string>
 
 /**
@@ -58,6 +59,9 @@ private:
     
     // Flag to track if the sensor is initialized
     bool initialized;
+    
+    // The sensor pin, claimed from the shared GPIO context
+    GpioLines line;
 };
 
 #endif // DIG_SENSOR_LIB_H
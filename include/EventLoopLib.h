@@ -0,0 +1,219 @@
+#ifndef EVENT_LOOP_LIB_H
+#define EVENT_LOOP_LIB_H
+
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+/**
+ * @brief Single-threaded event loop for non-blocking socket I/O
+ *
+ * All handlers run on the thread that calls run(). Two engines are available:
+ * - IO_URING: completion-based I/O through io_uring. Submissions are batched
+ *   into one io_uring_enter() per loop iteration, receives are multishot and
+ *   draw from a pool of buffers provided to the kernel, and small sends go out
+ *   from registered (fixed) buffers. Requires Linux 6.0 or newer.
+ * - EPOLL: readiness-based fallback for older kernels or when io_uring is
+ *   disabled.
+ *
+ * Sends on the same descriptor are delivered in the order they were queued.
+ */
+class EventLoop {
+public:
+    /**
+     * @brief I/O engine used by the loop
+     */
+    enum class Backend {
+        IO_URING,    ///< io_uring with multishot receive and registered buffers
+        EPOLL        ///< epoll readiness notifications
+    };
+
+    /// Called with received bytes; a length of 0 means the peer closed or an error occurred
+    typedef std::function<void(const char* data, size_t length)> DataHandler;
+
+    /// Called once a send has fully completed (true) or failed (false)
+    typedef std::function<void(bool ok)> SendHandler;
+
+    /// Called with each accepted descriptor, or -1 if accepting failed
+    typedef std::function<void(int fd)> AcceptHandler;
+
+    /// Deferred work
+    typedef std::function<void()> Task;
+
+    /// Identifier of a timer created with runAfter()
+    typedef uint64_t TimerId;
+
+    /**
+     * @brief Constructor for the EventLoop class
+     *
+     * @param preferred Engine to try first; falls back to EPOLL if io_uring is unavailable
+     */
+    explicit EventLoop(Backend preferred = Backend::IO_URING);
+
+    /**
+     * @brief Destructor for the EventLoop class
+     */
+    ~EventLoop();
+
+    /**
+     * @brief Get the engine in use
+     *
+     * @return Backend The engine selected at construction
+     */
+    Backend getBackend() const;
+
+    /**
+     * @brief Deliver incoming bytes on a connected socket until remove() or disconnect
+     *
+     * @param fd Connected socket
+     * @param handler Called for every chunk of received bytes
+     * @return void
+     */
+    void receive(int fd, const DataHandler& handler);
+
+    /**
+     * @brief Accept connections on a listening socket until remove()
+     *
+     * @param fd Listening socket
+     * @param handler Called for every accepted connection
+     * @return void
+     */
+    void accept(int fd, const AcceptHandler& handler);
+
+    /**
+     * @brief Queue bytes for sending on a connected socket
+     *
+     * @param fd Connected socket
+     * @param data Bytes to send; the loop keeps its own copy
+     * @param handler Optional completion handler
+     * @return void
+     */
+    void send(int fd, const std::string& data, const SendHandler& handler = SendHandler());
+
+    /**
+     * @brief Stop all activity on a descriptor
+     *
+     * No handler for the descriptor is called afterwards. Queued sends are not
+     * made; their handlers are returned so the caller can fail them once that
+     * is safe. The caller remains responsible for closing the descriptor.
+     *
+     * @param fd The descriptor
+     * @return std::vector<SendHandler> Handlers of the sends that were not made
+     */
+    std::vector<SendHandler> remove(int fd);
+
+    /**
+     * @brief Run a task once after a delay
+     *
+     * @param delayMs Delay in milliseconds
+     * @param task The task
+     * @return TimerId Identifier that can be passed to cancelTimer()
+     */
+    TimerId runAfter(int delayMs, const Task& task);
+
+    /**
+     * @brief Cancel a timer that has not fired yet
+     *
+     * @param id The timer
+     * @return void
+     */
+    void cancelTimer(TimerId id);
+
+    /**
+     * @brief Run a task on the loop thread; safe to call from any thread
+     *
+     * @param task The task
+     * @return void
+     */
+    void post(const Task& task);
+
+    /**
+     * @brief Process events until stop() is called
+     *
+     * @return void
+     */
+    void run();
+
+    /**
+     * @brief Make run() return; safe to call from any thread
+     *
+     * @return void
+     */
+    void stop();
+
+    /**
+     * @brief I/O engine interface implemented by the io_uring and epoll engines
+     */
+    class Engine;
+
+private:
+    friend class UringEngine;
+    friend class EpollEngine;
+
+    typedef std::chrono::steady_clock Clock;
+
+    // A queued send
+    struct Outgoing {
+        std::string data;
+        size_t offset;
+        SendHandler handler;
+    };
+
+    // Everything the loop knows about one descriptor
+    struct Watch {
+        DataHandler onData;
+        AcceptHandler onAccept;
+        std::deque<Outgoing> sendQueue;
+        bool sending = false;
+    };
+
+    /**
+     * @brief Hand the next queued send of a descriptor to the engine
+     *
+     * @param fd The descriptor
+     * @return void
+     */
+    void startSend(int fd);
+
+    // Callbacks from the engines
+    void onData(int fd, const char* data, size_t length);
+    void onAccept(int fd, int client);
+    void onSent(int fd, long result);
+    void onWake();
+
+    /**
+     * @brief Run due timers and posted tasks
+     *
+     * @return int Milliseconds until the next timer, or -1 if there is none
+     */
+    int runPending();
+
+    // The selected engine
+    std::unique_ptr<Engine> engine;
+    Backend backend;
+
+    // eventfd used to wake the loop from other threads
+    int wakeFd;
+
+    // Watched descriptors
+    std::map<int, Watch> watches;
+
+    // Timers ordered by deadline
+    std::map<std::pair<Clock::time_point, TimerId>, Task> timers;
+    std::map<TimerId, Clock::time_point> timerDeadlines;
+    TimerId nextTimerId;
+
+    // Tasks posted from other threads
+    std::mutex postMutex;
+    std::vector<Task> posted;
+    bool stopRequested;
+};
+
+#endif // EVENT_LOOP_LIB_H
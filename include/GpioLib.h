@@ -0,0 +1,139 @@
+#ifndef GPIO_LIB_H
+#define GPIO_LIB_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief The Raspberry Pi's GPIO controller, opened once per process
+ *
+ * Lines are driven through the GPIO character device (/dev/gpiochip0),
+ * whose line requests cover several pins at once. Where the character
+ * device is missing, the context falls back to wiringPi, set up once for
+ * all users instead of once per device.
+ */
+class GpioChip {
+public:
+    /**
+     * @brief Get the shared GPIO context, opening it on first use
+     *
+     * @return std::shared_ptr<GpioChip> The context, or nullptr if neither access method works
+     */
+    static std::shared_ptr<GpioChip> get();
+
+    /**
+     * @brief Destructor for the GpioChip class; closes the device
+     */
+    ~GpioChip();
+
+    /**
+     * @brief Check whether lines go through the character device
+     *
+     * @return bool True for the character device, false for the wiringPi fallback
+     */
+    bool isCharacterDevice() const;
+
+    GpioChip(const GpioChip&) = delete;
+    GpioChip& operator=(const GpioChip&) = delete;
+
+private:
+    friend class GpioLines;
+
+    explicit GpioChip(int fd);
+
+    // Character device, or -1 when wiringPi is used
+    int fd;
+};
+
+/**
+ * @brief A group of GPIO pins read and written together
+ *
+ * Bit i of the values passed to read() and write() belongs to the i-th pin
+ * given to request(). With the character device, a read or write of the whole
+ * group is a single system call.
+ */
+class GpioLines {
+public:
+    /**
+     * @brief Direction of the pins
+     */
+    enum class Direction {
+        IN,
+        OUT
+    };
+
+    /**
+     * @brief Internal resistor of input pins
+     */
+    enum class Bias {
+        NONE,
+        PULL_UP,
+        PULL_DOWN
+    };
+
+    /**
+     * @brief Constructor for the GpioLines class
+     */
+    GpioLines();
+
+    /**
+     * @brief Destructor for the GpioLines class; releases the pins
+     */
+    ~GpioLines();
+
+    /**
+     * @brief Claim pins and configure them
+     *
+     * @param pins BCM GPIO numbers, at most 64
+     * @param direction Direction of all pins
+     * @param bias Pull resistor of all pins
+     * @param values Initial levels of output pins, one bit per pin
+     * @return bool True if the pins were claimed, false otherwise
+     */
+    bool request(const std::vector<int>& pins, Direction direction, Bias bias = Bias::NONE, uint64_t values = 0);
+
+    /**
+     * @brief Read the levels of all pins
+     *
+     * @param values Receives one bit per pin, 1 for high
+     * @return bool True if successful, false otherwise
+     */
+    bool read(uint64_t& values);
+
+    /**
+     * @brief Set the levels of output pins
+     *
+     * @param values One bit per pin, 1 for high
+     * @param mask Pins to change; the others keep their level
+     * @return bool True if successful, false otherwise
+     */
+    bool write(uint64_t values, uint64_t mask);
+
+    /**
+     * @brief Return the pins to inputs (safe state) and give them up
+     *
+     * @return void
+     */
+    void release();
+
+    /**
+     * @brief Get the number of pins
+     *
+     * @return size_t The number of pins claimed
+     */
+    size_t size() const;
+
+    GpioLines(const GpioLines&) = delete;
+    GpioLines& operator=(const GpioLines&) = delete;
+
+private:
+    std::shared_ptr<GpioChip> chip;
+    std::vector<int> pins;
+
+    // Line request of the character device, or -1
+    int fd;
+};
+
+#endif // GPIO_LIB_H
@@ -1,18 +1,74 @@
 #ifndef GYRO_LIB_H
 #define GYRO_LIB_H
+#include "I2cBusLib.h"
 #include <cstdint>
+#include <memory>
+#include <vector>
+
+/// Number of 16-bit values in one raw MPU9250 frame: accelerometer XYZ, temperature, gyroscope XYZ
+const int IMU_RAW_VALUES = 7;
+
+/**
+ * @brief One coherent set of MPU9250 readings
+ *
+ * All fields come from a single burst read of the sensor's output registers,
+ * so the accelerometer, temperature and gyroscope values belong to the same
+ * sampling instant.
+ */
+struct ImuSample {
+    double accX;    ///< Accelerometer X-axis value in m/s^2
+    double accY;    ///< Accelerometer Y-axis value in m/s^2
+    double accZ;    ///< Accelerometer Z-axis value in m/s^2
+    double temp;    ///< Temperature value in degrees Celsius
+    double gyroX;   ///< Gyroscope X-axis value in degrees per second
+    double gyroY;   ///< Gyroscope Y-axis value in degrees per second
+    double gyroZ;   ///< Gyroscope Z-axis value in degrees per second
+    int16_t raw[IMU_RAW_VALUES];   ///< Register values the fields above were computed from
+    uint64_t timestampNs;          ///< Time the registers were read (Rt::monotonicNs())
+};
+
 /**
  * @brief Class for interfacing with the MPU9250 gyroscope/accelerometer sensor
  * 
  * This class provides methods to initialize and read data from the MPU9250 sensor
- * connected to the Raspberry Pi via I2C (GPIO pins 2 and 3)
+ * connected to the Raspberry Pi via I2C (GPIO pins 2 and 3 for bus 1). Several
+ * sensors can share a bus (addresses 0x68 and 0x69) or sit on further buses;
+ * all sensors on a bus share one I2cBus.
+ *
+ * After init() the sensor samples at DEFAULT_RATE_HZ. setSampleRate() changes
+ * the output data rate together with the low-pass filters, setStandby() turns
+ * off unused axes, and setLowPower() leaves only the accelerometer waking up
+ * now and then, which draws a few percent of the current of full operation.
  */
 class Gyro {
 public:
+    /// Bus and address of a sensor wired as in the original setup
+    static const int DEFAULT_BUS = 1;
+    static const int DEFAULT_ADDRESS = 0x68;
+
+    /// Output data rate set by init()
+    static const int DEFAULT_RATE_HZ = 200;
+
+    /// Rates setSampleRate() accepts; the internal sample clock runs at MAX_RATE_HZ
+    static const int MIN_RATE_HZ = 4;
+    static const int MAX_RATE_HZ = 1000;
+
+    /// Axes for setStandby(), combined with |
+    static const uint8_t STANDBY_ACC_X = 0x20;
+    static const uint8_t STANDBY_ACC_Y = 0x10;
+    static const uint8_t STANDBY_ACC_Z = 0x08;
+    static const uint8_t STANDBY_GYRO_X = 0x04;
+    static const uint8_t STANDBY_GYRO_Y = 0x02;
+    static const uint8_t STANDBY_GYRO_Z = 0x01;
+    static const uint8_t STANDBY_GYRO = 0x07;
+
     /**
      * @brief Constructor for the Gyro class
+     * 
+     * @param bus Bus number N of /dev/i2c-N
+     * @param address 7-bit address of the sensor: 0x68, or 0x69 with AD0 pulled high
      */
-    Gyro();
+    Gyro(int bus = DEFAULT_BUS, int address = DEFAULT_ADDRESS);
 
     /**
      * @brief Destructor for the Gyro class
@@ -26,6 +82,48 @@ public:
      */
     void init();
 
+    /**
+     * @brief Set the output data rate, leaving low-power mode if necessary
+     * 
+     * The rate is MAX_RATE_HZ divided by an integer, so it is rounded up to the
+     * next such rate. The gyroscope and accelerometer low-pass filters are set
+     * to the widest bandwidth below half the rate, so nothing aliases.
+     * 
+     * @param hz Samples per second, MIN_RATE_HZ to MAX_RATE_HZ
+     * @return bool True if the sensor was configured, false if it is not initialized or on error
+     */
+    bool setSampleRate(int hz);
+
+    /**
+     * @brief Put axes in standby; their registers keep the last value
+     * 
+     * @param axes STANDBY_* flags of the axes to turn off; 0 turns all axes on
+     * @return bool True if the sensor was configured, false if it is not initialized or on error
+     */
+    bool setStandby(uint8_t axes);
+
+    /**
+     * @brief Enter low-power (cycle) mode
+     * 
+     * The gyroscope is in standby and the accelerometer sleeps between single
+     * measurements taken at wakeHz. setSampleRate() returns to full operation;
+     * the gyroscope then takes WAKE_UP_MS to settle.
+     * 
+     * @param wakeHz Accelerometer measurements per second, rounded up to 0.24 * 2^n up to 500
+     * @return bool True if the sensor was configured, false if it is not initialized or on error
+     */
+    bool setLowPower(int wakeHz);
+
+    /**
+     * @brief Get the output data rate
+     * 
+     * @return int Samples per second, or 0 in low-power mode
+     */
+    int getSampleRate() const;
+
+    /// Start-up time of the gyroscope after standby or low-power mode
+    static const int WAKE_UP_MS = 35;
+
     /**
      * @brief Get gyroscope X-axis value
      * 
@@ -75,15 +173,81 @@ public:
      */
     double getTemp();
 
+    /**
+     * @brief Read all accelerometer, temperature and gyroscope values at once
+     * 
+     * Performs a single 14-byte burst read starting at ACCEL_XOUT_H, so the
+     * returned values form a consistent snapshot.
+     * 
+     * @param sample Reference to store the readings
+     * @return bool True if the read was successful, false otherwise
+     */
+    bool readSample(ImuSample& sample);
+
+    /**
+     * @brief Convert a raw register frame into physical units
+     * 
+     * @param raw Accelerometer XYZ, temperature and gyroscope XYZ register values
+     * @param sample Reference to store the readings, including a copy of the raw values
+     * @return void
+     */
+    static void convert(const int16_t raw[IMU_RAW_VALUES], ImuSample& sample);
+
+    /**
+     * @brief Read a sample from every sensor in one pass
+     * 
+     * The reads of all sensors on the same bus are batched into as few
+     * I2C_RDWR transactions as possible, so the cost per tick grows by one
+     * I2C message pair per sensor rather than by two system calls each.
+     * 
+     * @param gyros The sensors
+     * @param samples Resized to gyros.size(); receives the readings
+     * @param valid Resized to gyros.size(); whether each sensor was read
+     * @return size_t The number of sensors read successfully
+     */
+    static size_t readSamples(const std::vector<Gyro*>& gyros, std::vector<ImuSample>& samples,
+                              std::vector<bool>& valid);
+
+    /**
+     * @brief Get the bus number
+     * 
+     * @return int N of /dev/i2c-N
+     */
+    int getBus() const;
+
+    /**
+     * @brief Get the sensor address
+     * 
+     * @return int 7-bit I2C address
+     */
+    int getAddress() const;
+
 private:
-    // Handle for the I2C device
-    int i2c_fd;
+    // Shared bus the sensor is on; null until init() succeeds
+    std::shared_ptr<I2cBus> bus;
+    int busNumber;
+    uint8_t address;
+
+    // Output data rate, 0 in low-power mode, and the axes in standby
+    int rateHz;
+    uint8_t standby;
     
     // MPU9250 register addresses
-    static const int MPU9250_ADDRESS = 0x68;
     static const int ACCEL_XOUT_H = 0x3B;
     static const int GYRO_XOUT_H = 0x43;
     static const int TEMP_OUT_H = 0x41;
+    static const int SMPLRT_DIV = 0x19;
+    static const int CONFIG = 0x1A;
+    static const int ACCEL_CONFIG2 = 0x1D;
+    static const int LP_ACCEL_ODR = 0x1E;
+    static const int PWR_MGMT_1 = 0x6B;
+    static const int PWR_MGMT_2 = 0x6C;
+    
+    // PWR_MGMT_1 bit that makes the accelerometer cycle between sleep and one measurement
+    static const uint8_t CYCLE = 0x20;
+    
+    // ACCEL_CONFIG2 bit that bypasses the accelerometer low-pass filter, as required in cycle mode
+    static const uint8_t ACCEL_FCHOICE_B = 0x08;
     
     // Scaling factors for raw data
     static constexpr double GYRO_SCALE = 131.0;  // For +/- 250 deg/s range
@@ -96,6 +260,15 @@ private:
      * @return int16_t 16-bit signed integer read from the register
      */
     int16_t readRawValue(int reg_addr);
+
+    /**
+     * @brief Convert the 14-byte output block read from ACCEL_XOUT_H
+     * 
+     * @param data Accelerometer, temperature and gyroscope registers, big-endian
+     * @param sample Reference to store the readings
+     * @return void
+     */
+    static void decode(const uint8_t data[14], ImuSample& sample);
 };
 
 #endif // GYRO_LIB_H
@@ -0,0 +1,105 @@
+#ifndef I2C_BUS_LIB_H
+#define I2C_BUS_LIB_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Shared access to one Linux I2C bus (/dev/i2c-N)
+ *
+ * Every bus is opened once per process and shared by all devices on it;
+ * get() hands out the same instance for the same bus number. Transfers are
+ * serialized by a per-bus mutex, and every register access is a single
+ * I2C_RDWR transaction: the register-select write and the read are joined
+ * by a repeated start instead of two separate system calls, so no other
+ * master or thread can move the register pointer in between.
+ *
+ * Channels of an I2C multiplexer driven by the kernel (e.g. i2c-mux-pca954x)
+ * appear as buses of their own and are used the same way.
+ */
+class I2cBus {
+public:
+    /**
+     * @brief One register block read, as part of a batch
+     */
+    struct Read {
+        uint8_t address;   ///< 7-bit device address
+        uint8_t reg;       ///< First register to read
+        uint8_t* data;     ///< Receives the register values
+        uint16_t length;   ///< Number of bytes to read
+        bool ok;           ///< Set by readBatch(): whether this read succeeded
+    };
+
+    /**
+     * @brief Get the shared instance of a bus, opening it on first use
+     *
+     * @param number Bus number N of /dev/i2c-N
+     * @return std::shared_ptr<I2cBus> The bus, or nullptr if it cannot be opened
+     */
+    static std::shared_ptr<I2cBus> get(int number);
+
+    /**
+     * @brief Destructor for the I2cBus class; closes the device
+     */
+    ~I2cBus();
+
+    /**
+     * @brief Get the bus number
+     *
+     * @return int N of /dev/i2c-N
+     */
+    int getNumber() const;
+
+    /**
+     * @brief Write one register
+     *
+     * @param address 7-bit device address
+     * @param reg Register to write
+     * @param value Value to write
+     * @return bool True if the device acknowledged the write, false otherwise
+     */
+    bool writeRegister(uint8_t address, uint8_t reg, uint8_t value);
+
+    /**
+     * @brief Read consecutive registers in one transaction
+     *
+     * @param address 7-bit device address
+     * @param reg First register to read
+     * @param data Receives the register values
+     * @param length Number of bytes to read
+     * @return bool True if the read was successful, false otherwise
+     */
+    bool readRegisters(uint8_t address, uint8_t reg, uint8_t* data, uint16_t length);
+
+    /**
+     * @brief Perform several register reads in as few system calls as possible
+     *
+     * The reads are packed into I2C_RDWR calls of up to 21 reads each, so a
+     * whole sample tick of many devices costs one or two system calls and no
+     * device is read while another thread has the bus. If a packed call
+     * fails, its reads are retried one by one so that a single absent device
+     * does not fail the others.
+     *
+     * @param reads The reads; each entry's ok flag is updated
+     * @return size_t The number of successful reads
+     */
+    size_t readBatch(std::vector<Read>& reads);
+
+    I2cBus(const I2cBus&) = delete;
+    I2cBus& operator=(const I2cBus&) = delete;
+
+private:
+    I2cBus(int number, int fd);
+
+    // Run one I2C_RDWR call with the reads [first, first + count); the caller holds the mutex
+    bool transfer(std::vector<Read>& reads, size_t first, size_t count);
+
+    int number;
+    int fd;
+    std::mutex mutex;
+};
+
+#endif // I2C_BUS_LIB_H
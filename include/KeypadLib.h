@@ -1,6 +1,7 @@
 #ifndef KEYPAD_LIB_H
 #define KEYPAD_LIB_H
 
+#include "GpioLib.h"
 #include <string>
 #include <vector>
 
@@ -61,6 +62,8 @@ private:
     // GPIO pin numbers for rows and columns
     static const std::vector<int> ROW_PINS;    // GPIO pins for rows
     static const std::vector<int> COL_PINS;    // GPIO pins for columns
+    static const uint64_t ALL_ROWS;
+    static const uint64_t ALL_COLS;
     
     // Keypad layout
     static const char KEY_MAP[4][4];
@@ -71,17 +74,23 @@ private:
     // Flag to track if the keypad is initialized
     bool initialized;
     
+    // Row outputs and column inputs, each read or written as one group
+    GpioLines rows;
+    GpioLines cols;
+    
     /**
-     * @brief Set all row pins as output and set them to HIGH
+     * @brief Drive all rows low, their resting state
      * 
      * @return void
      */
-    void setAllRowsHigh();
+    void setAllRowsLow();
     
     /**
      * @brief Read the keypad
      * 
-     * Scans the keypad to detect pressed keys
+     * Scans the keypad to detect pressed keys. The rows rest low, so a scan
+     * while no key is down is a single read of all columns; only a pressed
+     * key costs one row write and one column read per row.
      * 
      * @return char The character associated with the pressed key, or '\0' if no key is pressed
      */
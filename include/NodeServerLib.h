@@ -0,0 +1,107 @@
+#ifndef NODE_SERVER_LIB_H
+#define NODE_SERVER_LIB_H
+
+#include "NodeServiceLib.h"
+#include "SocketConLib.h"
+#include "WorkerPoolLib.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief Socket server that makes a node process of a NodeService
+ *
+ * Starts the service, listens on the node's port and serves one Server Node
+ * connection at a time, waiting for the next one when it disconnects, until
+ * SIGINT, SIGTERM or a close: command ends the node. Replies are tagged like
+ * their commands, streamed replies (NodeService::openStream) are sent with
+ * flow control, and events from the service go to the connected Server Node.
+ *
+ * A node is then just the service and its options:
+ * @code
+ * DigitalIOService service;
+ * NodeServer server("DigitalIO", 7002, service);
+ * return server.run();
+ * @endcode
+ */
+class NodeServer {
+public:
+    /**
+     * @brief Devices a command uses, for running commands on workers (see DigitalIOService::devicesOf)
+     */
+    typedef std::function<std::vector<std::string>(const std::string& command)> DeviceMap;
+
+    /**
+     * @brief Constructor for the NodeServer class
+     *
+     * @param name Name of the node in log messages, e.g. "GyroSensor"
+     * @param port Port to listen on
+     * @param service The service answering the commands; configured, but not started yet
+     */
+    NodeServer(const std::string& name, int port, NodeService& service);
+
+    /**
+     * @brief Make SIGINT and SIGTERM end run() gracefully
+     *
+     * @return void
+     */
+    static void handleSignals();
+
+    /**
+     * @brief Run tagged commands on worker threads instead of the thread reading the connection
+     *
+     * Commands sharing a device run in order; untagged commands and close: wait
+     * for the commands in flight and run in arrival order.
+     *
+     * @param threads Number of workers
+     * @param devicesOf Devices a command uses
+     * @return void
+     */
+    void setWorkers(size_t threads, const DeviceMap& devicesOf);
+
+    /**
+     * @brief Set a function called whenever the Server Node disconnects
+     *
+     * @param handler The function, e.g. one forgetting the Server Node's demands
+     * @return void
+     */
+    void setDisconnectHandler(const std::function<void()>& handler);
+
+    /**
+     * @brief Start the service and serve Server Node connections until the node is ended
+     *
+     * @return int Exit code of the node: 0, or 1 if the port could not be opened
+     */
+    int run();
+
+    /**
+     * @brief Send a message to the Server Node, if one is connected
+     *
+     * @param message The message
+     * @return bool True if the message was sent, false otherwise
+     */
+    bool send(const std::string& message);
+
+private:
+    // Handle commands from one Server Node connection until it closes
+    void serveConnection(SocketCon& link);
+
+    // Handle a command and send the response, tagged like the command
+    void execute(bool tagged, uint32_t tag, const std::string& command);
+
+    std::string name;
+    int port;
+    NodeService& service;
+    std::unique_ptr<WorkerPool> workers;
+    DeviceMap devicesOf;
+    std::function<void()> disconnected;
+
+    // Connection to the Server Node; replies and events are sent under the mutex
+    // so that the service's threads can publish while a command is being served
+    SocketCon* connection;
+    std::mutex connectionMutex;
+};
+
+#endif // NODE_SERVER_LIB_H
@@ -0,0 +1,500 @@
+#ifndef NODE_SERVICE_LIB_H
+#define NODE_SERVICE_LIB_H
+
+#include "GyroLib.h"
+#include "AttitudeLib.h"
+#include "SampleStreamLib.h"
+#include "KeypadLib.h"
+#include "DigSensorLib.h"
+#include "RelayLib.h"
+#include "RtLib.h"
+#include "ValueBoardLib.h"
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <condition_variable>
+#include <optional>
+
+/**
+ * @brief A reply produced piece by piece instead of as one string
+ *
+ * Streams hold only their position, never the whole reply, so a reply of any
+ * size costs the node no more memory than one chunk.
+ */
+class ReplyStream {
+public:
+    /**
+     * @brief Destructor for the ReplyStream class
+     */
+    virtual ~ReplyStream() {}
+
+    /**
+     * @brief Produce the next part of the reply
+     *
+     * @param chunk Receives at most Protocol::CHUNK_SIZE bytes
+     * @return bool True if a chunk was produced, false once the reply is complete
+     */
+    virtual bool next(std::string& chunk) = 0;
+
+    /**
+     * @brief Get the final reply that ends the stream
+     *
+     * @return std::string The reply, e.g. "history 2000 0:"
+     */
+    virtual std::string end() = 0;
+};
+
+/**
+ * @brief Device logic of a node, independent of how commands reach it
+ *
+ * The GyroSensor and DigitalIO Nodes wrap a service in a NodeServer; the
+ * all-in-one build calls the services of both nodes directly from the
+ * Server Node and saves the loopback round trip of every request.
+ */
+class NodeService {
+public:
+    /**
+     * @brief Receives the events a service publishes, e.g. "event key 5:"; called from the service's threads
+     */
+    typedef std::function<void(const std::string& event)> EventSink;
+
+    /**
+     * @brief Destructor for the NodeService class
+     */
+    virtual ~NodeService() {}
+
+    /**
+     * @brief Initialize the hardware and start the background threads
+     *
+     * @param sink Where published events go
+     * @return void
+     */
+    virtual void start(const EventSink& sink) = 0;
+
+    /**
+     * @brief Stop the background threads and release the hardware
+     *
+     * @return void
+     */
+    virtual void stop() = 0;
+
+    /**
+     * @brief Answer a command or batch of commands
+     *
+     * Calls are serialized by the caller unless the service allows otherwise
+     * (see DigitalIOService::devicesOf).
+     *
+     * @param command The command, e.g. "gyro:"
+     * @return std::string The response, e.g. "gyro 0.1 0.2 0.3:"
+     */
+    virtual std::string handle(const std::string& command) = 0;
+
+    /**
+     * @brief Check whether handle() may have to wait for a device to answer a command
+     *
+     * Callers that must not block, such as an event loop, run such commands on
+     * another thread; all others are answered at once.
+     *
+     * @param command The command, e.g. "gyro:"
+     * @return bool True if handle() may wait, false if it returns at once
+     */
+    virtual bool mayBlock(const std::string& command) {
+        (void)command;
+        return false;
+    }
+
+    /**
+     * @brief Start a streamed reply (see Protocol::isStreamed)
+     *
+     * @param command The command, e.g. "history 2000:"
+     * @return std::unique_ptr<ReplyStream> The stream, or nullptr if the service does not stream the command
+     */
+    virtual std::unique_ptr<ReplyStream> openStream(const std::string& command) {
+        (void)command;
+        return nullptr;
+    }
+
+    /**
+     * @brief Set the scheduling of the service's threads; takes effect at start()
+     *
+     * @param config Priority and CPU of the acquisition and control threads
+     * @return void
+     */
+    void setRealtime(const RtConfig& config) {
+        realtime = config;
+    }
+
+    /**
+     * @brief Check whether a close: command was handled
+     *
+     * @return bool True once the node was asked to shut down
+     */
+    bool isClosing() const {
+        return closing;
+    }
+
+protected:
+    NodeService() : closing(false) {}
+
+    std::atomic<bool> closing;
+    RtConfig realtime;
+};
+
+/**
+ * @brief Where an MPU9250 is attached
+ */
+struct ImuConfig {
+    int bus;       ///< Bus number N of /dev/i2c-N
+    int address;   ///< 7-bit I2C address
+};
+
+/**
+ * @brief GyroSensor Node logic: samples any number of MPU9250s at up to 200 Hz,
+ * runs an orientation filter per sensor and publishes the raw frames
+ *
+ * Each sensor is sampled only as fast as someone needs it: at the rate the
+ * Server Node asks for on behalf of the sensor's subscribers
+ * ("demand <hz> [<n>]:"), at POLL_RATE_HZ for a while after a command read
+ * it, and at no less than setMinRate(). The rate is rounded up to 25, 50, 100
+ * or 200 Hz. Without any demand the sensor is put in low-power mode and not
+ * read at all; the first command reading it wakes it up and waits for a
+ * fresh sample. "gyroRate:" returns the rate of every sensor, 0 in low power.
+ *
+ * All sensors are read in one batched pass per tick (see Gyro::readSamples).
+ * Commands without an index ("gyro:") address the first sensor, "gyro <n>:"
+ * the n-th one counting from 0, and "imus:" returns the number of sensors.
+ * Sensor 0 publishes on the "imu" topic, sensor n on "imu<n>".
+ * "gyroTiming:" reports how precisely the sample period is kept.
+ *
+ * The last HISTORY_SAMPLES samples of every sensor (10 seconds at 200 Hz) are kept and streamed by
+ * "history <count>:" and "history <count> <n>:", one line
+ * "<sample number> <gyro x y z> <acc x y z> <temp> <time ns>" per sample. The final
+ * reply "history <sent> <lost>:" counts the samples that were overwritten
+ * before a slow reader got to them.
+ *
+ * The latest readings are also published in shared memory (GyroBoard) for
+ * local processes that read them without a round trip to any node.
+ */
+class GyroService : public NodeService {
+public:
+    /**
+     * @brief Constructor for the GyroService class
+     *
+     * @param imus The sensors, in index order; one sensor at the default bus and address if empty
+     */
+    explicit GyroService(const std::vector<ImuConfig>& imus = std::vector<ImuConfig>());
+
+    /**
+     * @brief Parse a sensor location of the form "<bus>:<address>", e.g. "1:0x69"
+     *
+     * @param spec The text to parse
+     * @param imu Receives the location
+     * @return bool True if the text is a valid location, false otherwise
+     */
+    static bool parseImu(const std::string& spec, ImuConfig& imu);
+
+    /**
+     * @brief Destructor for the GyroService class; stops the sampler
+     */
+    ~GyroService();
+
+    void start(const EventSink& sink) override;
+    void stop() override;
+    std::string handle(const std::string& command) override;
+    std::unique_ptr<ReplyStream> openStream(const std::string& command) override;
+
+    /**
+     * @brief Check whether a command reads a sensor in low power, which handle() wakes up and waits for
+     *
+     * @param command The command, e.g. "gyro 1:"
+     * @return bool True if handle() may wait up to WAKE_TIMEOUT_MS, false otherwise
+     */
+    bool mayBlock(const std::string& command) override;
+
+    /**
+     * @brief Keep every sensor sampled at least at a rate, e.g. for readers of the shared memory board
+     *
+     * @param hz Samples per second; 0 lets idle sensors go to low power
+     * @return void
+     */
+    void setMinRate(int hz);
+
+    /**
+     * @brief Forget the rates the Server Node asked for, e.g. when it disconnects
+     *
+     * @return void
+     */
+    void clearDemand();
+
+    /// Samples kept per sensor
+    static const size_t HISTORY_SAMPLES = 2000;
+
+    /// Highest sampling rate; subscribers that name no rate get it
+    static const int MAX_RATE_HZ = 200;
+
+    /// Rate of a sensor for POLL_HOLD_MS after a command read it
+    static const int POLL_RATE_HZ = 50;
+    static const int POLL_HOLD_MS = 5000;
+
+private:
+    class HistoryStream;
+
+    // One sensor snapshot together with the orientation estimated from it
+    struct Reading {
+        ImuSample sample;
+        double roll;
+        double pitch;
+        double yaw;
+
+        // Rate the sensor is sampled at, 0 in low power
+        int rateHz;
+    };
+
+    // State the sampler keeps per sensor
+    struct Imu {
+        Imu(const ImuConfig& config, uint32_t keyframeInterval);
+
+        Gyro gyro;
+        Attitude attitude;
+        SampleEncoder encoder;
+        std::string topic;
+        std::chrono::steady_clock::time_point last;
+
+        // Recent samples in a ring, and the number of samples ever recorded; guarded by the service's mutex
+        std::vector<ImuSample> history;
+        uint64_t recorded;
+
+        // Rate the subscribers need and the last time a command read the sensor; guarded by the service's mutex
+        int demandHz;
+        std::chrono::steady_clock::time_point polled;
+
+        // Whether init() succeeded; fixed once start() returns
+        bool available;
+
+        // Used by the sampler only: the rate in force (0 in low power), when the gyroscope
+        // has settled after waking up, the frames per stream block and, after a failed
+        // change of rate, when to try again
+        int rateHz;
+        std::chrono::steady_clock::time_point settled;
+        size_t blockFrames;
+        std::chrono::steady_clock::time_point retry;
+    };
+
+    // Sample the sensors and run the orientation filters until stopped
+    void samplingLoop();
+
+    // Bring every sensor to the rate its demand calls for; returns the highest rate in force, 0 if all
+    // are idle. seen receives the demand counter the rates were computed from, and retry the earliest
+    // time a failed change of rate is due again (time_point::max() if none failed)
+    int adjustRates(uint64_t& seen, std::chrono::steady_clock::time_point& retry);
+
+    // Take over a rate the sensor was switched to
+    void changeRate(size_t i, int rateHz, std::chrono::steady_clock::time_point now);
+
+    // Sensors a command reads, e.g. 1 for "stamped gyro 1:"
+    static void sensorsRead(const std::string& command, std::vector<size_t>& indices);
+
+    // Parse "<reading>:" or "<reading> <n>:", where reading is gyro, acc, temp or attitude
+    static bool parseReading(const std::string& command, size_t& index);
+
+    // Parse "history <count>:" or "history <count> <n>:"
+    static bool parseHistory(const std::string& command, uint64_t& count, size_t& index);
+
+    // Acquisition time of the value a command reports
+    static uint64_t acquiredAt(const std::string& command, const std::vector<Reading>& readings);
+
+    // Answer a command from a copy of the latest readings
+    std::string process(const std::string& command, const std::vector<Reading>& readings);
+
+    // Command table of process(); every handler gets the readings ahead of the command's arguments
+    struct Commands;
+    typedef std::vector<Reading> Readings;
+    std::string imusCommand(const Readings& readings);
+    std::string historyCommand(const Readings& readings, uint64_t count, std::optional<size_t> index);
+    std::string pingCommand(const Readings& readings);
+    std::string timingCommand(const Readings& readings);
+    std::string rateCommand(const Readings& readings);
+    std::string demandCommand(const Readings& readings, int hz, std::optional<size_t> index);
+    std::string closeCommand(const Readings& readings);
+    std::string gyroCommand(const Readings& readings, std::optional<size_t> index);
+    std::string accCommand(const Readings& readings, std::optional<size_t> index);
+    std::string tempCommand(const Readings& readings, std::optional<size_t> index);
+    std::string attitudeCommand(const Readings& readings, std::optional<size_t> index);
+
+    // Reading of sensor index (0 if none is given), or NULL if there is no such sensor
+    static const Reading* readingOf(const Readings& readings, std::optional<size_t> index);
+
+    std::vector<std::unique_ptr<Imu> > imus;
+    EventSink sink;
+    std::thread sampler;
+    std::atomic<bool> running;
+
+    // Latest reading per sensor, shared between the sampler and the command handler,
+    // and the sample histories and demands
+    std::mutex mutex;
+    std::vector<Reading> latest;
+    int minRateHz;
+
+    // Counts changes of demand, so the sampler does not sleep through one
+    uint64_t demands;
+
+    // Wakes an idle sampler when the demand changes, and commands waiting for a sensor to wake up after a pass
+    std::condition_variable demandChanged;
+    std::condition_variable sampled;
+
+    // Wake-up lateness of the sampler, and its current period; 0 while every sensor is idle
+    JitterHistogram samplerJitter;
+    std::atomic<int> periodUs;
+
+    // Latest readings for local readers; written by the sampler only
+    BoardWriter<GyroBoard> board;
+    GyroBoard boardRecord;
+};
+
+/**
+ * @brief DigitalIO Node logic: digital sensor, relay bank and keypad, publishing
+ * the "key", "sensor", "relay" and "relays" topics
+ *
+ * "relay <0|1> [<n>]:" and "relayState [<n>]:" switch and read one relay
+ * (relay 0 if no index is given). "relays <pattern>:" switches any number of
+ * relays in one GPIO write, e.g. "relays 1-0:" turns relay 0 on, leaves relay
+ * 1 alone and turns relay 2 off; "relaysState:" returns the pattern of the
+ * whole bank, e.g. "relays 100:" (see Relay::parsePattern). The "relay" topic
+ * follows relay 0, the "relays" topic publishes the pattern of every change.
+ *
+ * "ioTiming:" reports how precisely the sensor poll period is kept.
+ * The sensor and relay states are also published in shared memory
+ * (DigitalIOBoard), refreshed on every sensor poll and relay change.
+ */
+class DigitalIOService : public NodeService {
+public:
+    /**
+     * @brief Constructor for the DigitalIOService class
+     *
+     * @param relayPins BCM GPIO numbers of the relays, in relay order; one relay at Relay::DEFAULT_PIN if empty
+     */
+    explicit DigitalIOService(const std::vector<int>& relayPins = std::vector<int>());
+
+    /**
+     * @brief Destructor for the DigitalIOService class; stops the monitors
+     */
+    ~DigitalIOService();
+
+    void start(const EventSink& sink) override;
+    void stop() override;
+    std::string handle(const std::string& command) override;
+
+    /**
+     * @brief Get the devices a command uses
+     *
+     * handle() may run concurrently for commands that share no device;
+     * commands sharing a device must be handled one after another.
+     *
+     * @param command The command, e.g. "relayState:"
+     * @return std::vector<std::string> "sensor", "relay" and/or "keypad"; empty if none
+     */
+    static std::vector<std::string> devicesOf(const std::string& command);
+
+private:
+    // Publish every change of the sensor state
+    void sensorMonitor();
+
+    // Publish every key press
+    void keypadMonitor();
+
+    // Push an event, stamped with the time its payload was acquired, to the sink
+    void publish(const std::string& topic, const std::string& payload, uint64_t timestampNs);
+
+    // Update the shared memory board with the sensor state (poll, nonzero for on) or the states of all relays (!poll)
+    void publishBoard(bool poll, uint64_t states, uint64_t timestampNs);
+
+    // Switch the relays in mask, publish the changes and reply "<name> ok:" or "<name> err:"
+    std::string switchRelays(const std::string& name, uint64_t values, uint64_t mask);
+
+    // Command table of handle()
+    struct Commands;
+    std::string sensorStateCommand();
+    std::string sensorTypeCommand();
+    std::string relayCommand(bool on, std::optional<size_t> index);
+    std::string relayStateCommand(std::optional<size_t> index);
+    std::string relaysCommand(std::string pattern);
+    std::string relaysStateCommand();
+    std::string keyCommand();
+    std::string pingCommand();
+    std::string timingCommand();
+    std::string closeCommand();
+
+    DigSensor sensor;
+    Relay relay;
+    Keypad keypad;
+    EventSink sink;
+    std::thread sensorThread;
+    std::thread keypadThread;
+    std::atomic<bool> running;
+
+    // Wake-up lateness of the sensor monitor
+    JitterHistogram sensorJitter;
+
+    // Sensor and relay state for local readers; the monitor and the relay commands both update it
+    std::mutex boardMutex;
+    BoardWriter<DigitalIOBoard> board;
+    DigitalIOBoard boardRecord;
+};
+
+/**
+ * @brief Sends the streamed replies of one node connection with flow control
+ *
+ * Every stream sends Protocol::STREAM_WINDOW chunks right away and one more
+ * for every "more:" the Server Node returns; "stop:" ends it early. Used on
+ * the thread that reads the connection, which also passes on the
+ * acknowledgements.
+ */
+class ReplyStreamer {
+public:
+    /**
+     * @brief Constructor for the ReplyStreamer class
+     *
+     * @param send Sends one message to the Server Node
+     */
+    explicit ReplyStreamer(const std::function<bool(const std::string&)>& send);
+
+    /**
+     * @brief Start sending a stream in answer to a tagged request
+     *
+     * @param tag The request's tag
+     * @param stream The stream
+     * @return void
+     */
+    void open(uint32_t tag, std::unique_ptr<ReplyStream> stream);
+
+    /**
+     * @brief Handle "more:" or "stop:" for a stream
+     *
+     * @param tag The stream's tag
+     * @param command The untagged message
+     * @return bool True if the message was an acknowledgement or stop, false otherwise
+     */
+    bool control(uint32_t tag, const std::string& command);
+
+    /**
+     * @brief Drop all streams, e.g. when the connection closes
+     *
+     * @return void
+     */
+    void clear();
+
+private:
+    // Send the next chunk of a stream, or its final reply when it is complete
+    void advance(uint32_t tag);
+
+    std::function<bool(const std::string&)> send;
+    std::map<uint32_t, std::unique_ptr<ReplyStream> > streams;
+};
+
+#endif // NODE_SERVICE_LIB_H
@@ -0,0 +1,283 @@
+#ifndef PROTOCOL_LIB_H
+#define PROTOCOL_LIB_H
+
+#include <string>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Helpers for the text command protocol shared by all nodes
+ *
+ * A batch request carries several sub-commands in one message, separated by '|':
+ *     batch gyro:|acc:|relayState:
+ * The reply carries the sub-responses in the same order:
+ *     batch gyro 0.1 0 0:|acc 0 0 9.81:|relay 0:
+ *
+ * Events are pushed without a request, to the Server Node by the device nodes
+ * and from there to subscribed clients:
+ *     event relay 1:
+ *
+ * The Server Node tags its requests to the device nodes, and the nodes tag
+ * their replies the same way, so replies may come back in any order:
+ *     tag 17 relayState:
+ *     tag 17 relay 0:
+ *
+ * Large replies, such as "history <count>:", are streamed as any number of
+ * chunks of at most CHUNK_SIZE bytes followed by an ordinary final reply:
+ *     chunk 1 0.1 0 0 0 0 9.81 24.5\n2 0.1 0 0 0 0 9.81 24.5\n
+ *     history 2 0:
+ * Between a node and the Server Node the chunks carry the request's tag, and
+ * the node has at most STREAM_WINDOW chunks unacknowledged: the Server Node
+ * answers every chunk it has passed on with "tag <n> more:", or with
+ * "tag <n> stop:" if nobody wants the rest, which makes the node end the stream.
+ *
+ * A read prefixed with "stamped " is answered with the time its value was
+ * acquired, in CLOCK_MONOTONIC nanoseconds of the Pi (see Rt::monotonicNs):
+ *     stamped gyro:
+ *     stamped 84532123456 gyro 0.1 0 0:
+ * Stamps apply to single commands, including the entries of a batch. The
+ * text events carry their acquisition time the same way, after the payload:
+ *     event sensor 1 @84532123456:
+ * "clock:" returns the Pi's clock, "clock <ns>:", for estimating the offset
+ * to a client's clock (see RcsClient::syncClock).
+ */
+namespace Protocol {
+
+    /**
+     * @brief Node responsible for a command
+     */
+    enum class Route {
+        GYRO,          ///< GyroSensor Node
+        DIGITAL_IO,    ///< DigitalIO Node
+        UNKNOWN        ///< No node handles the command
+    };
+
+    /**
+     * @brief Scheduling class of a command on the way to a node, most urgent first
+     */
+    enum class Priority {
+        CONTROL,       ///< Actuation and shutdown, e.g. "relay 0:"
+        STATUS,        ///< Reads of the current state, e.g. "gyro:"
+        BULK           ///< Diagnostics that may wait, e.g. "gyroTiming:"
+    };
+
+    /// Number of priority classes
+    const int PRIORITIES = 3;
+
+    /// Prefix of batch requests and replies
+    const std::string BATCH_PREFIX = "batch ";
+
+    /// Separator between the entries of a batch
+    const char BATCH_SEPARATOR = '|';
+
+    /// Prefix of event messages
+    const std::string EVENT_PREFIX = "event ";
+
+    /// Prefix of tagged requests and replies
+    const std::string TAG_PREFIX = "tag ";
+
+    /// Prefix of the chunks of a streamed reply
+    const std::string CHUNK_PREFIX = "chunk ";
+
+    /// Prefix of commands asking for the acquisition time, and of their replies
+    const std::string STAMP_PREFIX = "stamped ";
+
+    /// Separator between the payload of an event and its acquisition time
+    const std::string EVENT_STAMP = " @";
+
+    /// Largest payload of one chunk in bytes
+    const size_t CHUNK_SIZE = 4096;
+
+    /// Chunks a node may send ahead of the Server Node's acknowledgements
+    const int STREAM_WINDOW = 4;
+
+    /// Acknowledgement of a chunk, asking for one more
+    const std::string STREAM_MORE = "more:";
+
+    /// Request to end a stream early
+    const std::string STREAM_STOP = "stop:";
+
+    /**
+     * @brief Find the node responsible for a command
+     *
+     * @param command The command
+     * @return Route The node that handles it
+     */
+    Route routeOf(const std::string& command);
+
+    /**
+     * @brief Find the scheduling class of a command
+     *
+     * A batch takes the most urgent class of its entries.
+     *
+     * @param command The command
+     * @return Priority The class
+     */
+    Priority priorityOf(const std::string& command);
+
+    /**
+     * @brief Check whether a command changes device state
+     *
+     * @param command The command
+     * @return bool True for actuation commands such as "relay 1:" or "relays 1-0:"
+     */
+    bool isWrite(const std::string& command);
+
+    /**
+     * @brief Check whether a command is answered with a streamed reply
+     *
+     * @param command The command
+     * @return bool True for "history <count>:" and "history <count> <imu>:"
+     */
+    bool isStreamed(const std::string& command);
+
+    /**
+     * @brief Check whether a message is a chunk of a streamed reply
+     *
+     * @param message The message
+     * @return bool True if the message starts with "chunk "
+     */
+    bool isChunk(const std::string& message);
+
+    /**
+     * @brief Build a chunk message
+     *
+     * @param payload Part of the reply, at most CHUNK_SIZE bytes
+     * @return std::string The chunk message
+     */
+    std::string makeChunk(const std::string& payload);
+
+    /**
+     * @brief Check whether a command asks for a stamped reply, or a reply is stamped
+     *
+     * @param message The command or reply
+     * @return bool True if the message starts with "stamped "
+     */
+    bool isStamped(const std::string& message);
+
+    /**
+     * @brief Remove the stamp request from a command
+     *
+     * @param command The command, e.g. "stamped gyro:"
+     * @return std::string The command without the prefix, e.g. "gyro:"; unstamped commands are returned as is
+     */
+    std::string unstamped(const std::string& command);
+
+    /**
+     * @brief Build a stamped reply
+     *
+     * @param timestampNs Acquisition time of the reply's value
+     * @param reply The reply, e.g. "gyro 0.1 0 0:"
+     * @return std::string The stamped reply, e.g. "stamped 84532123456 gyro 0.1 0 0:"
+     */
+    std::string makeStamped(uint64_t timestampNs, const std::string& reply);
+
+    /**
+     * @brief Split a stamped reply into its acquisition time and the reply
+     *
+     * @param message The stamped reply
+     * @param timestampNs Receives the acquisition time
+     * @param reply Receives the reply without the stamp
+     * @return bool True if the message is a stamped reply, false otherwise
+     */
+    bool splitStamped(const std::string& message, uint64_t& timestampNs, std::string& reply);
+
+    /**
+     * @brief Split the acquisition time off the payload of a text event
+     *
+     * @param payload The payload, e.g. "1 @84532123456"
+     * @param value Receives the payload without the stamp, e.g. "1"
+     * @param timestampNs Receives the acquisition time
+     * @return bool True if the payload carried a stamp, false otherwise
+     */
+    bool splitEventStamp(const std::string& payload, std::string& value, uint64_t& timestampNs);
+
+    /**
+     * @brief Check whether a message is a batch
+     *
+     * @param message The message
+     * @return bool True if the message starts with "batch "
+     */
+    bool isBatch(const std::string& message);
+
+    /**
+     * @brief Split a batch into its entries
+     *
+     * @param message The batch message
+     * @return std::vector<std::string> The entries, in order
+     */
+    std::vector<std::string> splitBatch(const std::string& message);
+
+    /**
+     * @brief Build a batch from its entries
+     *
+     * @param entries The entries, in order
+     * @return std::string The batch message
+     */
+    std::string makeBatch(const std::vector<std::string>& entries);
+
+    /**
+     * @brief Check whether a message is an event
+     *
+     * @param message The message
+     * @return bool True if the message starts with "event "
+     */
+    bool isEvent(const std::string& message);
+
+    /**
+     * @brief Build an event message
+     *
+     * @param topic The topic, e.g. "key"
+     * @param payload The payload, e.g. "5"
+     * @return std::string The event message, e.g. "event key 5:"
+     */
+    std::string makeEvent(const std::string& topic, const std::string& payload);
+
+    /**
+     * @brief Build a text event message carrying the time its payload was acquired
+     *
+     * @param topic The topic, e.g. "key"
+     * @param payload The payload, e.g. "5"
+     * @param timestampNs The acquisition time
+     * @return std::string The event message, e.g. "event key 5 @84532123456:"
+     */
+    std::string makeEvent(const std::string& topic, const std::string& payload, uint64_t timestampNs);
+
+    /**
+     * @brief Get the topic of an event message
+     *
+     * @param message The event message
+     * @return std::string The topic, or an empty string if the message is not an event
+     */
+    std::string topicOf(const std::string& message);
+
+    /**
+     * @brief Get the IMU whose frames a topic carries
+     *
+     * @param topic The topic, "imu" for the first IMU or "imu<n>" for the n-th one
+     * @param index Receives n
+     * @return bool True if the topic is an IMU topic, false otherwise
+     */
+    bool imuOfTopic(const std::string& topic, size_t& index);
+
+    /**
+     * @brief Build a tagged request or reply
+     *
+     * @param tag The tag, e.g. 17
+     * @param message The untagged message, e.g. "relayState:"
+     * @return std::string The tagged message, e.g. "tag 17 relayState:"
+     */
+    std::string makeTagged(uint32_t tag, const std::string& message);
+
+    /**
+     * @brief Split a tagged message into its tag and the untagged message
+     *
+     * @param message The message
+     * @param tag Receives the tag
+     * @param body Receives the untagged message
+     * @return bool True if the message is tagged, false otherwise
+     */
+    bool splitTagged(const std::string& message, uint32_t& tag, std::string& body);
+}
+
+#endif // PROTOCOL_LIB_H
@@ -0,0 +1,471 @@
+#ifndef RCS_CLIENT_LIB_H
+#define RCS_CLIENT_LIB_H
+
+#include "SocketConLib.h"
+#include <string>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <map>
+#include <cstdint>
+
+/**
+ * @brief Estimated offset between the Pi's clock and the local one
+ *
+ * Every exchange takes the local time before sending, the Pi's time in the
+ * reply and the local time on receipt. Taking the Pi's time as belonging to
+ * the middle of the round trip is wrong by at most half the round trip, so
+ * the exchange with the shortest round trip is kept.
+ */
+struct ClockSync {
+    int64_t offsetNs = 0;   ///< Pi clock minus local clock
+    int64_t rttNs = 0;      ///< Round trip of the exchange the offset comes from; bounds the error to rttNs / 2
+    int samples = 0;        ///< Exchanges taken into account
+
+    /**
+     * @brief Take one exchange into account
+     *
+     * @param sentNs Local time the request was sent (localNowNs())
+     * @param remoteNs Time in the reply
+     * @param receivedNs Local time the reply arrived
+     * @return void
+     */
+    void add(int64_t sentNs, uint64_t remoteNs, int64_t receivedNs);
+
+    /**
+     * @brief Convert a timestamp of the Pi, e.g. of a stamped reply, to the local clock
+     *
+     * @param remoteNs The Pi's time
+     * @return int64_t The same instant as localNowNs() would have returned it
+     */
+    int64_t toLocalNs(uint64_t remoteNs) const;
+
+    /**
+     * @brief Read the local clock the offset refers to (std::chrono::steady_clock)
+     *
+     * @return int64_t Nanoseconds since an arbitrary point
+     */
+    static int64_t localNowNs();
+};
+
+/**
+ * @brief Asynchronous client for the Server Node
+ *
+ * Every request returns a std::future right away and may also take a callback.
+ * Requests are pipelined over a single connection: any number can be in flight,
+ * and replies are matched to requests in the order they were sent. Replies are
+ * decoded into typed results.
+ *
+ * All methods are thread-safe. Callbacks run on the client's reader thread and
+ * must not block on futures of the same client.
+ *
+ * With requestTimestamps(true), results carry the time the Pi acquired their
+ * value; syncClock() maps it to the local clock, e.g. to measure how old a
+ * reading is when it is shown:
+ * @code
+ * client.requestTimestamps(true);
+ * ClockSync clock = client.syncClock().get().value;
+ * RcsClient::Result<RcsClient::Vector3> rates = client.getGyro().get();
+ * int64_t ageNs = ClockSync::localNowNs() - clock.toLocalNs(rates.timestampNs);
+ * @endcode
+ *
+ * Example:
+ * @code
+ * RcsClient client;
+ * client.connect("192.168.1.10", 7001);
+ * std::future<RcsClient::Result<RcsClient::Vector3> > gyro = client.getGyro();
+ * std::future<RcsClient::Result<bool> > relay = client.setRelay(true);
+ * RcsClient::Result<RcsClient::Vector3> rates = gyro.get();
+ * @endcode
+ */
+class RcsClient {
+public:
+    /**
+     * @brief Outcome of a request
+     */
+    template <typename T>
+    struct Result {
+        bool ok = false;      ///< True if the server answered with the expected reply
+        T value = T();        ///< Decoded reply; only meaningful if ok is true
+        std::string error;    ///< Error reply from the server or description of the failure
+        std::string raw;      ///< Reply as received
+        uint64_t timestampNs = 0;   ///< Time the Pi acquired the value (see requestTimestamps()); oldest reading of a dashboard
+    };
+
+    /// Called with the result of a request on the reader thread
+    template <typename T>
+    using Handler = std::function<void(const Result<T>&)>;
+
+    /// Called on the reader thread with the topic and payload of an event, e.g. "key" and "5"
+    typedef std::function<void(const std::string& topic, const std::string& payload)> EventHandler;
+
+    /// Called on the reader thread with the topic, payload and acquisition time on the Pi of an event; 0 for "imu" blocks, whose frames carry their own times
+    typedef std::function<void(const std::string& topic, const std::string& payload, uint64_t timestampNs)> StampedEventHandler;
+
+    /// Called on the reader thread with each part of a streamed reply, in order
+    typedef std::function<void(const std::string& chunk)> ChunkHandler;
+
+    /**
+     * @brief Three-axis reading
+     */
+    struct Vector3 {
+        double x = 0.0;
+        double y = 0.0;
+        double z = 0.0;
+    };
+
+    /**
+     * @brief Orientation in degrees
+     */
+    struct Attitude {
+        double roll = 0.0;
+        double pitch = 0.0;
+        double yaw = 0.0;
+    };
+
+    /**
+     * @brief Snapshot of all readings, fetched in one round trip
+     */
+    struct Dashboard {
+        Vector3 gyro;               ///< Angular rates in deg/s
+        Vector3 acc;                ///< Acceleration in m/s^2
+        double temperature = 0.0;   ///< Temperature in degrees Celsius
+        bool sensorOn = false;      ///< Digital sensor state
+        bool relayOn = false;       ///< Relay state
+    };
+
+    /**
+     * @brief Summary of a streamed sample history
+     */
+    struct History {
+        uint64_t sent = 0;          ///< Samples delivered
+        uint64_t lost = 0;          ///< Samples overwritten on the node before they could be sent
+    };
+
+    /**
+     * @brief Constructor for the RcsClient class
+     */
+    RcsClient();
+
+    /**
+     * @brief Destructor for the RcsClient class; disconnects if connected
+     */
+    ~RcsClient();
+
+    /**
+     * @brief Connect to the Server Node
+     *
+     * @param host Server address
+     * @param port Server port
+     * @param timeoutMs Maximum time to keep trying in milliseconds, 0 for a single attempt or -1 to try indefinitely
+     * @return bool True if connected, false otherwise
+     */
+    bool connect(const std::string& host, int port, int timeoutMs = 0);
+
+    /**
+     * @brief Close the connection; requests still in flight fail
+     *
+     * @return void
+     */
+    void disconnect();
+
+    /**
+     * @brief Check if the client is connected
+     *
+     * @return bool True if connected, false otherwise
+     */
+    bool isConnected() const;
+
+    /**
+     * @brief Ask for the acquisition time with every reading and actuation
+     *
+     * The time is in CLOCK_MONOTONIC nanoseconds of the Pi and stored in
+     * Result::timestampNs; raw requests are not affected.
+     *
+     * @param enable True to request timestamps
+     * @return void
+     */
+    void requestTimestamps(bool enable);
+
+    /**
+     * @brief Estimate the offset between the Pi's clock and the local one
+     *
+     * The "clock:" exchanges run one after another; the one with the shortest
+     * round trip is used (see ClockSync).
+     *
+     * @param rounds Number of exchanges
+     * @param handler Optional callback
+     * @return std::future<Result<ClockSync> > The estimate
+     */
+    std::future<Result<ClockSync> > syncClock(int rounds = 8, const Handler<ClockSync>& handler = Handler<ClockSync>());
+
+    /**
+     * @brief Send a raw command
+     *
+     * @param command The command, e.g. "gyro:"
+     * @param handler Optional callback
+     * @return std::future<Result<std::string> > The reply as received
+     */
+    std::future<Result<std::string> > request(const std::string& command,
+                                              const Handler<std::string>& handler = Handler<std::string>());
+
+    /**
+     * @brief Read the gyroscope
+     *
+     * @param handler Optional callback
+     * @return std::future<Result<Vector3> > Angular rates in deg/s
+     */
+    std::future<Result<Vector3> > getGyro(const Handler<Vector3>& handler = Handler<Vector3>());
+
+    /**
+     * @brief Read the accelerometer
+     *
+     * @param handler Optional callback
+     * @return std::future<Result<Vector3> > Acceleration in m/s^2
+     */
+    std::future<Result<Vector3> > getAcc(const Handler<Vector3>& handler = Handler<Vector3>());
+
+    /**
+     * @brief Read the temperature
+     *
+     * @param handler Optional callback
+     * @return std::future<Result<double> > Temperature in degrees Celsius
+     */
+    std::future<Result<double> > getTemperature(const Handler<double>& handler = Handler<double>());
+
+    /**
+     * @brief Read the attitude estimate
+     *
+     * @param handler Optional callback
+     * @return std::future<Result<Attitude> > Roll, pitch and yaw in degrees
+     */
+    std::future<Result<Attitude> > getAttitude(const Handler<Attitude>& handler = Handler<Attitude>());
+
+    /**
+     * @brief Read the digital sensor state
+     *
+     * @param handler Optional callback
+     * @return std::future<Result<bool> > True if the sensor is on
+     */
+    std::future<Result<bool> > getSensorState(const Handler<bool>& handler = Handler<bool>());
+
+    /**
+     * @brief Read the digital sensor type
+     *
+     * @param handler Optional callback
+     * @return std::future<Result<std::string> > The sensor type, e.g. "TEMPERATURE"
+     */
+    std::future<Result<std::string> > getSensorType(const Handler<std::string>& handler = Handler<std::string>());
+
+    /**
+     * @brief Read the relay state
+     *
+     * @param handler Optional callback
+     * @return std::future<Result<bool> > True if the relay is on
+     */
+    std::future<Result<bool> > getRelayState(const Handler<bool>& handler = Handler<bool>());
+
+    /**
+     * @brief Switch the relay
+     *
+     * @param on True to switch the relay on, false to switch it off
+     * @param handler Optional callback
+     * @return std::future<Result<bool> > True once the node acknowledged the change
+     */
+    std::future<Result<bool> > setRelay(bool on, const Handler<bool>& handler = Handler<bool>());
+
+    /**
+     * @brief Read the states of all relays of the bank
+     *
+     * @param handler Optional callback
+     * @return std::future<Result<std::string> > One '1' or '0' per relay, starting with relay 0, e.g. "1001"
+     */
+    std::future<Result<std::string> > getRelays(const Handler<std::string>& handler = Handler<std::string>());
+
+    /**
+     * @brief Switch any number of relays together, in one GPIO write on the node
+     *
+     * @param pattern One '1' (on), '0' (off) or '-' (unchanged) per relay, starting with relay 0, e.g. "1-0"
+     * @param handler Optional callback
+     * @return std::future<Result<bool> > True once the node acknowledged the change
+     */
+    std::future<Result<bool> > setRelays(const std::string& pattern, const Handler<bool>& handler = Handler<bool>());
+
+    /**
+     * @brief Read and clear the keys pressed on the keypad
+     *
+     * @param handler Optional callback
+     * @return std::future<Result<std::string> > The keys, oldest first; empty if none
+     */
+    std::future<Result<std::string> > getKeys(const Handler<std::string>& handler = Handler<std::string>());
+
+    /**
+     * @brief Read all sensor values in a single batch request
+     *
+     * @param handler Optional callback
+     * @return std::future<Result<Dashboard> > The readings
+     */
+    std::future<Result<Dashboard> > getDashboard(const Handler<Dashboard>& handler = Handler<Dashboard>());
+
+    /**
+     * @brief Fetch the most recent samples of an IMU
+     *
+     * The samples arrive in chunks of whole lines
+     * "<sample number> <gyro x y z> <acc x y z> <temp>\n", oldest first, so
+     * the history is never held in memory as a whole. The next chunk is only
+     * sent once the previous ones were read, so a slow handler slows the
+     * stream down instead of filling memory.
+     *
+     * @param count Number of samples, at most GyroService::HISTORY_SAMPLES
+     * @param onSamples Called with every chunk of lines
+     * @param imu Index of the IMU
+     * @param handler Optional callback
+     * @return std::future<Result<History> > The numbers of samples sent and lost
+     */
+    std::future<Result<History> > getHistory(size_t count, const ChunkHandler& onSamples, int imu = 0,
+                                             const Handler<History>& handler = Handler<History>());
+
+    /**
+     * @brief Subscribe to events pushed by the server
+     *
+     * Topics published by the nodes are "key", "sensor", "relay", "relays" and "imu";
+     * "imu" payloads are binary blocks for SampleDecoder (SampleStreamLib.h).
+     * Events arrive on the reader thread while requests continue normally.
+     *
+     * @param topic The topic
+     * @param onEvent Called for every event of the topic
+     * @param policy What the server does when this client falls behind: "drop-oldest", "conflate" or "disconnect"
+     * @param handler Optional callback
+     * @return std::future<Result<bool> > True once the server accepted the subscription
+     */
+    std::future<Result<bool> > subscribe(const std::string& topic, const EventHandler& onEvent,
+                                         const std::string& policy = "drop-oldest",
+                                         const Handler<bool>& handler = Handler<bool>());
+
+    /**
+     * @brief Subscribe to events pushed by the server, with the time each event's payload was acquired
+     *
+     * @param topic The topic
+     * @param onEvent Called for every event of the topic
+     * @param policy What the server does when this client falls behind: "drop-oldest", "conflate" or "disconnect"
+     * @param handler Optional callback
+     * @return std::future<Result<bool> > True once the server accepted the subscription
+     */
+    std::future<Result<bool> > subscribe(const std::string& topic, const StampedEventHandler& onEvent,
+                                         const std::string& policy = "drop-oldest",
+                                         const Handler<bool>& handler = Handler<bool>());
+
+    /**
+     * @brief Stop receiving events of a topic
+     *
+     * @param topic The topic
+     * @param handler Optional callback
+     * @return std::future<Result<bool> > True once the server removed the subscription
+     */
+    std::future<Result<bool> > unsubscribe(const std::string& topic, const Handler<bool>& handler = Handler<bool>());
+
+    /**
+     * @brief Ask the server to shut the whole system down
+     *
+     * @param handler Optional callback
+     * @return std::future<Result<std::string> > The server's acknowledgement
+     */
+    std::future<Result<std::string> > close(const Handler<std::string>& handler = Handler<std::string>());
+
+private:
+    // Delivers the raw reply of one request
+    typedef std::function<void(bool ok, const std::string& reply)> Completion;
+
+    /**
+     * @brief Send a command and decode its reply
+     *
+     * @param command The command
+     * @param name Name the reply starts with, e.g. "gyro" for "gyro 1 2 3:"
+     * @param decode Converts the payload of the reply into the value
+     * @param handler Optional callback
+     * @param onChunk Receives the chunks if the reply is streamed
+     * @return std::future<Result<T> > The decoded result
+     */
+    template <typename T>
+    std::future<Result<T> > call(const std::string& command, const std::string& name,
+                                 const std::function<bool(const std::string&, T&)>& decode,
+                                 const Handler<T>& handler, const ChunkHandler& onChunk = ChunkHandler());
+
+    /**
+     * @brief Queue a command and send it
+     *
+     * @param command The command
+     * @param completion Called with the reply, or with ok == false if the connection failed
+     * @param onChunk Receives the chunks if the reply is streamed
+     * @return void
+     */
+    void send(const std::string& command, const Completion& completion, const ChunkHandler& onChunk = ChunkHandler());
+
+    /**
+     * @brief Match incoming replies to requests until the connection closes
+     *
+     * @return void
+     */
+    void readLoop();
+
+    // State of a running syncClock()
+    struct ClockRounds {
+        Result<ClockSync> result;
+        int left = 0;
+        int64_t sentNs = 0;
+        std::promise<Result<ClockSync> > promise;
+        Handler<ClockSync> handler;
+    };
+
+    /**
+     * @brief Run the next "clock:" exchange of a syncClock()
+     *
+     * @param rounds The exchanges still to run and the estimate so far
+     * @return void
+     */
+    void clockRound(const std::shared_ptr<ClockRounds>& rounds);
+
+    /**
+     * @brief Fail every request still waiting for a reply
+     *
+     * @param reason Error stored in the failed results
+     * @return void
+     */
+    void failPending(const std::string& reason);
+
+    // Connection to the server
+    std::unique_ptr<SocketCon> socket;
+
+    // A request waiting for its reply
+    struct Pending {
+        Completion completion;
+        ChunkHandler onChunk;
+    };
+
+    // Requests waiting for a reply, in the order they were sent
+    std::deque<Pending> pending;
+
+    // Event handlers by topic
+    std::map<std::string, StampedEventHandler> eventHandlers;
+
+    // Whether readings and actuations are sent as "stamped <command>"
+    bool stamped;
+
+    // Protects socket, pending, eventHandlers, stamped and connected; never held while the socket blocks
+    mutable std::mutex mutex;
+
+    // Held by a sender from queueing a request until it is written, so requests
+    // are written in the order they are queued; taken before mutex
+    std::mutex sendMutex;
+
+    // Receives replies
+    std::thread reader;
+
+    // Connection status
+    bool connected;
+};
+
+#endif // RCS_CLIENT_LIB_H
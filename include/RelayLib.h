@@ -1,18 +1,38 @@
 #ifndef RELAY_LIB_H
 #define RELAY_LIB_H
 
+#include "GpioLib.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
 /**
- * @brief Class for interfacing with a relay
+ * @brief Class for interfacing with a bank of relays
  * 
- * This class provides methods to initialize and control a relay
- * connected to the Raspberry Pi GPIO pin 27
+ * This class provides methods to initialize and control relays connected
+ * to Raspberry Pi GPIO pins, by default a single relay on pin 27.
+ * Relay n is bit n of the masks taken and returned by setMask() and
+ * getStates(). All pins are claimed as one GPIO line request, so a bulk
+ * change is a single write and the outputs never pass through intermediate
+ * states (with the wiringPi fallback the pins are set one after another).
+ *
+ * Patterns describe the bank as text, one character per relay starting with
+ * relay 0: '1' on, '0' off and, in changes, '-' unchanged, e.g. "10-1".
  */
 class Relay {
 public:
+    /// Pin of the single relay of the default bank
+    static const int DEFAULT_PIN = 27;
+
+    /// Most relays in a bank, one bit each
+    static const size_t MAX_RELAYS = 64;
+
     /**
      * @brief Constructor for the Relay class
+     *
+     * @param pins BCM GPIO numbers of relays 0, 1, ...; DEFAULT_PIN if empty
      */
-    Relay();
+    explicit Relay(const std::vector<int>& pins = std::vector<int>());
     
     /**
      * @brief Destructor for the Relay class
@@ -20,7 +40,35 @@ public:
     ~Relay();
     
     /**
-     * @brief Initialize the relay
+     * @brief Parse a list of relay pins of the form "27,22,23"
+     *
+     * @param spec The text to parse
+     * @param pins Receives the pins, in relay order
+     * @return bool True if the text is a valid list of at most MAX_RELAYS distinct pins, false otherwise
+     */
+    static bool parsePins(const std::string& spec, std::vector<int>& pins);
+
+    /**
+     * @brief Parse a pattern of changes, e.g. "10-1"
+     *
+     * @param pattern One '1', '0' or '-' per relay, starting with relay 0; later relays are unchanged
+     * @param values Receives the new states, one bit per relay
+     * @param mask Receives the relays to change
+     * @return bool True if the pattern is valid and covers at most MAX_RELAYS relays, false otherwise
+     */
+    static bool parsePattern(const std::string& pattern, uint64_t& values, uint64_t& mask);
+
+    /**
+     * @brief Format relay states as a pattern, e.g. "1001"
+     *
+     * @param states One bit per relay
+     * @param count Number of relays
+     * @return std::string One '1' or '0' per relay, starting with relay 0
+     */
+    static std::string formatPattern(uint64_t states, size_t count);
+
+    /**
+     * @brief Initialize the relays, all OFF
      * 
      * @return void
      */
@@ -34,29 +82,57 @@ public:
     void release();
     
     /**
-     * @brief Set the state of the relay
+     * @brief Set the state of one relay
      * 
      * @param state True to turn the relay ON, false to turn it OFF
+     * @param index The relay, counting from 0
      * @return bool True if operation was successful, false otherwise
      */
-    bool set(bool state);
+    bool set(bool state, size_t index = 0);
     
     /**
-     * @brief Get the current state of the relay
+     * @brief Set any number of relays in one GPIO write
+     *
+     * @param values New states, one bit per relay
+     * @param mask Relays to change; the others keep their state
+     * @return bool True if operation was successful, false otherwise
+     */
+    bool setMask(uint64_t values, uint64_t mask);
+
+    /**
+     * @brief Get the current state of one relay
      * 
-     * @return bool True if relay is ON, false if it's OFF
+     * @param index The relay, counting from 0
+     * @return bool True if relay is ON, false if it's OFF or does not exist
      */
-    bool getState() const;
+    bool getState(size_t index = 0) const;
     
+    /**
+     * @brief Get the current state of all relays
+     *
+     * @return uint64_t One bit per relay, 1 for ON
+     */
+    uint64_t getStates() const;
+
+    /**
+     * @brief Get the number of relays
+     *
+     * @return size_t The number of relays in the bank
+     */
+    size_t size() const;
+
 private:
-    // GPIO pin number for the relay
-    static const int RELAY_PIN = 27;
+    // GPIO pin numbers of the relays
+    std::vector<int> pins;
     
-    // Current state of the relay
-    bool currentState;
+    // Current state of the relays, one bit each
+    uint64_t currentStates;
     
-    // Flag to track if the relay is initialized
+    // Flag to track if the relays are initialized
     bool initialized;
+    
+    // The relay pins, claimed from the shared GPIO context
+    GpioLines line;
 };
 
-#endif // RELAY_LIB_H
\ No newline at end of file
+#endif // RELAY_LIB_H
@@ -0,0 +1,121 @@
+#ifndef RESPONSE_CACHE_LIB_H
+#define RESPONSE_CACHE_LIB_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <functional>
+
+/**
+ * @brief Time-limited cache of node responses with request coalescing
+ *
+ * Each command has its own time-to-live. While a response is fresh, lookups
+ * are answered without contacting the node. When it is stale, the first caller
+ * fetches it and every concurrent caller for the same command waits for that
+ * single round trip instead of issuing its own.
+ *
+ * The class is thread-safe.
+ */
+class ResponseCache {
+public:
+    /**
+     * @brief Callback receiving the response of a coalesced fetch
+     */
+    typedef std::function<void(const std::string&)> Waiter;
+
+    /**
+     * @brief Result of acquire()
+     */
+    enum class Lookup {
+        HIT,       ///< A fresh response was returned
+        PENDING,   ///< Another caller is fetching; the waiter will be called
+        FETCH,     ///< The caller must fetch and then call complete()
+        BYPASS     ///< The command is not cacheable; forward it directly
+    };
+
+    /// TTL value for commands that are never cached
+    static const int NO_CACHE = 0;
+
+    /// TTL value for responses that never expire
+    static const int FOREVER = -1;
+
+    /**
+     * @brief Constructor for the ResponseCache class
+     */
+    ResponseCache();
+
+    /**
+     * @brief Set the time-to-live for a command
+     *
+     * @param command The command, e.g. "gyro:"
+     * @param ttlMs TTL in milliseconds, NO_CACHE or FOREVER
+     * @return void
+     */
+    void setTtl(const std::string& command, int ttlMs);
+
+    /**
+     * @brief Get the time-to-live for a command
+     *
+     * @param command The command
+     * @return int TTL in milliseconds; NO_CACHE for unknown commands
+     */
+    int getTtl(const std::string& command) const;
+
+    /**
+     * @brief Look up a command and register interest in its response
+     *
+     * @param command The command
+     * @param response Receives the cached response on HIT
+     * @param waiter Called with the response when the result is PENDING
+     * @return Lookup What the caller has to do next
+     */
+    Lookup acquire(const std::string& command, std::string& response, const Waiter& waiter);
+
+    /**
+     * @brief Finish a fetch started by acquire() returning FETCH
+     *
+     * Stores the response (unless store is false or the entry was invalidated
+     * meanwhile) and calls all queued waiters.
+     *
+     * @param command The command
+     * @param response The response received from the node
+     * @param store False to hand the response to waiters without caching it
+     * @return void
+     */
+    void complete(const std::string& command, const std::string& response, bool store = true);
+
+    /**
+     * @brief Drop the cached response for a command
+     *
+     * A fetch that is in flight is still delivered to its waiters but is not stored.
+     *
+     * @param command The command
+     * @return void
+     */
+    void invalidate(const std::string& command);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        std::string response;
+        Clock::time_point expires;
+        bool valid = false;
+        bool inFlight = false;
+        bool stale = false;
+        std::vector<Waiter> waiters;
+    };
+
+    // Protects all members below
+    mutable std::mutex mutex;
+
+    // TTL in milliseconds per command
+    std::map<std::string, int> ttls;
+
+    // Cached entries per command
+    std::map<std::string, Entry> entries;
+};
+
+#endif // RESPONSE_CACHE_LIB_H
@@ -0,0 +1,151 @@
+#ifndef RT_LIB_H
+#define RT_LIB_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+/**
+ * @brief Real-time settings of the acquisition and control threads
+ */
+struct RtConfig {
+    int priority = 0;   ///< SCHED_FIFO priority 1-99; 0 keeps the normal scheduler
+    int cpu = -1;       ///< CPU to pin the threads to; -1 leaves them free to move
+};
+
+namespace Rt {
+    /**
+     * @brief Apply the process-wide part of a configuration
+     *
+     * With a real-time priority, all current and future memory is locked
+     * (mlockall) so that a page fault cannot stall a periodic thread.
+     *
+     * @param config The configuration
+     * @return bool True if successful or nothing was requested, false otherwise
+     */
+    bool configureProcess(const RtConfig& config);
+
+    /**
+     * @brief Apply the configuration to the calling thread and name it
+     *
+     * @param config The configuration
+     * @param name Thread name shown by top and ps, at most 15 characters
+     * @return bool True if successful or nothing was requested, false otherwise
+     */
+    bool configureThread(const RtConfig& config, const std::string& name);
+
+    /**
+     * @brief Consume a real-time command line option
+     *
+     * Recognizes "--rt-priority <1-99>" and "--rt-cpu <n>".
+     *
+     * @param option The option, e.g. "--rt-priority"
+     * @param value The value following it
+     * @param config Updated with the option
+     * @return bool True if the option was recognized and valid, false otherwise
+     */
+    bool parseOption(const std::string& option, const std::string& value, RtConfig& config);
+
+    /**
+     * @brief Read CLOCK_MONOTONIC, the clock all timestamps of the nodes use
+     *
+     * The clock is shared by all processes on the Pi, so timestamps from
+     * different nodes can be compared directly; it does not jump when the
+     * wall-clock time is set.
+     *
+     * @return uint64_t Nanoseconds since an arbitrary point before boot
+     */
+    uint64_t monotonicNs();
+}
+
+/**
+ * @brief Histogram of how late a periodic thread woke up
+ *
+ * Buckets are bounded by 10, 20, 50, 100, 200, 500, 1000, 2000 and 5000 us;
+ * the last bucket takes everything later. Recording is lock-free, so the
+ * periodic thread never waits for a reader.
+ */
+class JitterHistogram {
+public:
+    /// Number of buckets
+    static const int BUCKETS = 10;
+
+    /// Upper bounds of the first BUCKETS - 1 buckets in microseconds
+    static const int64_t BOUNDS_US[BUCKETS - 1];
+
+    /**
+     * @brief Constructor for the JitterHistogram class
+     */
+    JitterHistogram();
+
+    /**
+     * @brief Record one wake-up
+     *
+     * @param latenessNs Time from the deadline to the actual wake-up
+     * @return void
+     */
+    void record(int64_t latenessNs);
+
+    /**
+     * @brief Record deadlines that passed without a wake-up
+     *
+     * @param count The number of missed periods
+     * @return void
+     */
+    void recordOverruns(uint64_t count);
+
+    /**
+     * @brief Format the histogram as "<count> <max us> <overruns> <bucket 0> ... <bucket 9>"
+     *
+     * @return std::string The numbers, separated by spaces
+     */
+    std::string format() const;
+
+private:
+    std::atomic<uint64_t> buckets[BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> overruns;
+    std::atomic<int64_t> maxNs;
+};
+
+/**
+ * @brief Paces a loop against absolute CLOCK_MONOTONIC deadlines
+ *
+ * Each wait() sleeps with clock_nanosleep(TIMER_ABSTIME) until the next
+ * deadline, so time spent in the loop body never accumulates as drift. If
+ * the body overran whole periods, the missed deadlines are skipped and
+ * counted rather than run back to back.
+ */
+class PeriodicTimer {
+public:
+    /**
+     * @brief Constructor for the PeriodicTimer class; the first deadline is one period from now
+     *
+     * @param periodUs Period in microseconds; values below 1 are taken as 1
+     * @param histogram Where the wake-up lateness is recorded, or NULL
+     */
+    PeriodicTimer(int64_t periodUs, JitterHistogram* histogram = NULL);
+
+    /**
+     * @brief Sleep until the next deadline
+     *
+     * @return void
+     */
+    void wait();
+
+    /**
+     * @brief Change the period and start over, with the next deadline one period from now
+     *
+     * @param periodUs Period in microseconds; values below 1 are taken as 1
+     * @return void
+     */
+    void setPeriod(int64_t periodUs);
+
+private:
+    int64_t periodNs;
+    int64_t deadlineNs;
+    JitterHistogram* histogram;
+};
+
+#endif // RT_LIB_H
@@ -0,0 +1,154 @@
+#ifndef SAMPLE_STREAM_LIB_H
+#define SAMPLE_STREAM_LIB_H
+
+#include "GyroLib.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * @brief Raw IMU frame recovered from a sample stream
+ */
+struct ImuRawFrame {
+    uint32_t sequence;                 ///< Position of the frame in the stream
+    int16_t values[IMU_RAW_VALUES];    ///< Accelerometer XYZ, temperature and gyroscope XYZ register values
+    uint64_t timestampNs;              ///< Acquisition time (Rt::monotonicNs()) to the microsecond; 0 in version 1 blocks
+};
+
+/**
+ * @brief Packs consecutive raw IMU frames into compact blocks
+ *
+ * Consecutive frames differ only slightly, so each value is sent as the
+ * difference to the previous frame, zig-zag mapped and written as a varint:
+ * sensor noise of a few counts takes one byte instead of two. Every
+ * keyframeInterval-th frame carries absolute values, so a receiver that
+ * joined late or lost a block picks up again at the next keyframe.
+ *
+ * Block layout, all integers as unsigned LEB128 varints:
+ *     version byte, first sequence, keyframe interval, frame count,
+ *     acquisition time of the first frame in ns,
+ *     then per frame: microseconds since the previous frame of the block
+ *     (0 for the first), followed by IMU_RAW_VALUES zig-zag values
+ * A frame is a keyframe if its sequence is a multiple of the interval.
+ * At 200 Hz the time adds two bytes per frame. Version 1 blocks, which carry
+ * no times, are still decoded.
+ * Blocks are binary and must travel in length-prefixed messages.
+ */
+class SampleEncoder {
+public:
+    /**
+     * @brief Constructor for the SampleEncoder class
+     *
+     * @param keyframeInterval Frames from one keyframe to the next
+     */
+    explicit SampleEncoder(uint32_t keyframeInterval = 200);
+
+    /**
+     * @brief Append a frame to the current block
+     *
+     * @param raw The register values
+     * @param timestampNs Time the values were read (Rt::monotonicNs())
+     * @return void
+     */
+    void add(const int16_t raw[IMU_RAW_VALUES], uint64_t timestampNs);
+
+    /**
+     * @brief Get the number of frames in the current block
+     *
+     * @return size_t The number of frames
+     */
+    size_t size() const;
+
+    /**
+     * @brief Finish the current block and start the next one
+     *
+     * @return std::string The encoded block
+     */
+    std::string flush();
+
+private:
+    // Frames from one keyframe to the next
+    uint32_t keyframeInterval;
+
+    // Sequence number of the next frame
+    uint32_t sequence;
+
+    // Sequence number of the first frame in the current block
+    uint32_t blockStart;
+
+    // Encoded frames of the current block
+    std::string body;
+
+    // Acquisition time of the first frame in the block, and of the previous frame in us since then
+    uint64_t blockStartNs;
+    uint64_t previousUs;
+
+    // Frames in the current block
+    size_t count;
+
+    // Previous frame, the reference for deltas
+    int16_t previous[IMU_RAW_VALUES];
+};
+
+/**
+ * @brief Unpacks blocks written by SampleEncoder
+ *
+ * Missing frames are detected from the sequence numbers. After a gap, frames
+ * are skipped until the next keyframe, since their deltas have no reference.
+ */
+class SampleDecoder {
+public:
+    /**
+     * @brief Constructor for the SampleDecoder class
+     */
+    SampleDecoder();
+
+    /**
+     * @brief Decode a block
+     *
+     * @param block The encoded block
+     * @param frames Decoded frames are appended here
+     * @return bool True if the block was well formed, false otherwise
+     */
+    bool decode(const std::string& block, std::vector<ImuRawFrame>& frames);
+
+    /**
+     * @brief Get the number of frames missing from the stream
+     *
+     * @return uint64_t Frames that were never received
+     */
+    uint64_t getLost() const;
+
+    /**
+     * @brief Get the number of frames received but dropped while waiting for a keyframe
+     *
+     * @return uint64_t The number of frames
+     */
+    uint64_t getSkipped() const;
+
+    /**
+     * @brief Forget the stream position, e.g. after reconnecting
+     *
+     * @return void
+     */
+    void reset();
+
+private:
+    // Whether previous holds the frame before the expected one
+    bool synchronized;
+
+    // Whether any block has been decoded since the last reset
+    bool started;
+
+    // Sequence number expected next
+    uint32_t expected;
+
+    // Last decoded frame
+    int16_t previous[IMU_RAW_VALUES];
+
+    // Counters
+    uint64_t lost;
+    uint64_t skipped;
+};
+
+#endif // SAMPLE_STREAM_LIB_H
@@ -2,12 +2,25 @@
 #define SOCKET_CON_LIB_H
 
 #include <string>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <coroutine>
+
+class EventLoop;
+class CaptureWriter;
 
 /**
  * @brief Class for socket communication
  * 
  * This class provides methods to initialize and manage socket connections
  * for both server and client modes
+ * 
+ * Every message travels as one frame: a 4-byte big-endian payload length
+ * followed by the payload. A message is therefore always received exactly as
+ * it was sent, no matter how TCP splits or merges the underlying segments.
  */
 class SocketCon {
 public:
@@ -19,6 +32,76 @@ public:
         CLIENT     ///< Client mode: connects to a server
     };
     
+    /// Messages at least this large are sent with MSG_ZEROCOPY. Such a send waits until the
+    /// peer has acknowledged the data, so it only pays off where copying costs more than that
+    static const size_t ZEROCOPY_THRESHOLD = 1024 * 1024;
+    
+    /**
+     * @brief A piece of a message passed to sendv()
+     */
+    struct Segment {
+        const void* data;    ///< Start of the bytes
+        size_t length;       ///< Number of bytes
+    };
+    
+    /// Called with each message received through receiveAsync(); ok is false once the connection is gone
+    typedef std::function<void(bool ok, const std::string& message)> MessageHandler;
+    
+    /// Called once a message queued with sendAsync() has been sent (true) or failed (false)
+    typedef std::function<void(bool ok)> SendHandler;
+    
+    /// Called with each connection accepted through acceptAsync(), or nullptr if accepting failed
+    typedef std::function<void(std::unique_ptr<SocketCon> client)> AcceptHandler;
+    
+    /**
+     * @brief Awaitable returned by receive(EventLoop&, std::string&); yields true once a message arrived
+     */
+    class ReceiveAwaiter {
+    public:
+        ReceiveAwaiter(SocketCon& socket, EventLoop& loop, std::string& message);
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        bool await_resume();
+        
+    private:
+        SocketCon& socket;
+        EventLoop& loop;
+        std::string& message;
+    };
+    
+    /**
+     * @brief Awaitable returned by send(EventLoop&, const std::string&); yields true once the message was sent
+     */
+    class SendAwaiter {
+    public:
+        SendAwaiter(SocketCon& socket, EventLoop& loop, const std::string& message);
+        bool await_ready();
+        bool await_suspend(std::coroutine_handle<> handle);
+        bool await_resume();
+        
+    private:
+        struct State;
+        SocketCon& socket;
+        EventLoop& loop;
+        const std::string& message;
+        std::shared_ptr<State> state;
+    };
+    
+    /**
+     * @brief Awaitable returned by accept(EventLoop&); yields the next client, or nullptr once detached
+     */
+    class AcceptAwaiter {
+    public:
+        AcceptAwaiter(SocketCon& socket, EventLoop& loop);
+        bool await_ready();
+        void await_suspend(std::coroutine_handle<> handle);
+        std::unique_ptr<SocketCon> await_resume();
+        
+    private:
+        SocketCon& socket;
+        EventLoop& loop;
+    };
+    
     /**
      * @brief Constructor for the SocketCon class
      * 
@@ -43,6 +126,45 @@ public:
      */
     bool init();
     
+    /**
+     * @brief Start listening without waiting for a client (SERVER mode only)
+     * 
+     * Creates the socket, binds it to the specified port and listens for connections.
+     * Clients are then taken one at a time with accept().
+     * 
+     * @return bool True if the socket is listening, false otherwise
+     */
+    bool listen();
+    
+    /**
+     * @brief Connect to the server, retrying until it accepts or the timeout expires (CLIENT mode only)
+     * 
+     * Unlike init(), a refused connection is not fatal: the attempt is repeated with
+     * a growing back-off, so the server may start after the client.
+     * 
+     * @param timeoutMs Maximum time to keep trying in milliseconds, or -1 to try indefinitely
+     * @return bool True if the connection was established, false otherwise
+     */
+    bool connect(int timeoutMs);
+    
+    /**
+     * @brief Accept the next incoming connection (SERVER mode only)
+     * 
+     * @param timeoutMs Maximum time to wait in milliseconds, or -1 to wait indefinitely
+     * @return std::unique_ptr<SocketCon> Connection to the new client, or nullptr on timeout or failure
+     */
+    std::unique_ptr<SocketCon> accept(int timeoutMs = -1);
+    
+    /**
+     * @brief Shut down the connection without releasing it
+     * 
+     * Wakes up any thread blocked in receive() on this connection. The descriptor
+     * stays valid until release() is called.
+     * 
+     * @return void
+     */
+    void shutdown();
+    
     /**
      * @brief Close the socket connection and release resources
      * 
@@ -58,6 +180,42 @@ public:
      */
     bool send(const std::string& message);
     
+    /**
+     * @brief Send a message made of several segments without joining them first
+     * 
+     * The frame header and all segments go out with a single sendmsg() call where
+     * possible. Partial writes and EAGAIN are handled by continuing where the kernel
+     * stopped. Messages of at least ZEROCOPY_THRESHOLD bytes are sent with MSG_ZEROCOPY
+     * when the kernel supports it; the call then returns once the kernel has released
+     * the segments, so they may be reused immediately afterwards. If the socket runs
+     * out of memory for completion notifications, the rest of the message is copied.
+     * 
+     * @param segments The pieces of the message, in order
+     * @return bool True if the whole message was sent, false otherwise
+     */
+    bool sendv(const std::vector<Segment>& segments);
+    
+    /**
+     * @brief Enable or disable Nagle's algorithm (TCP_NODELAY)
+     * 
+     * Connections start with TCP_NODELAY enabled since every message is latency-sensitive.
+     * 
+     * @param enable True to send small frames immediately, false to let the kernel coalesce them
+     * @return bool True if the option was applied, false otherwise
+     */
+    bool setNoDelay(bool enable);
+    
+    /**
+     * @brief Cork or uncork the connection (TCP_CORK)
+     * 
+     * While corked, the kernel holds back partial segments so that several messages
+     * leave in as few packets as possible. Uncorking flushes them.
+     * 
+     * @param enable True to cork, false to uncork and flush
+     * @return bool True if the option was applied, false otherwise
+     */
+    bool setCork(bool enable);
+    
     /**
      * @brief Receive a message from the socket
      * 
@@ -73,7 +231,171 @@ public:
      */
     bool isConnected() const;
     
+    /**
+     * @brief Record every message sent and received on this connection
+     * 
+     * @param writer Capture file shared by all recorded connections; must outlive the recording
+     * @param label Role of the connection in the capture, e.g. "client"
+     * @return void
+     */
+    void setCapture(CaptureWriter* writer, const std::string& label);
+    
+    /**
+     * @brief Receive messages through an event loop instead of blocking
+     * 
+     * The handler is called on the loop thread for every complete message until
+     * detach() or release() is called. Messages already buffered by receive() are
+     * delivered right away.
+     * 
+     * @param loop The event loop
+     * @param handler Called for every message, and once with ok == false on disconnect
+     * @return void
+     */
+    void receiveAsync(EventLoop& loop, const MessageHandler& handler);
+    
+    /**
+     * @brief Queue a message for sending through an event loop
+     * 
+     * Messages are sent in the order they were queued, independent of receiveAsync().
+     * 
+     * @param loop The event loop
+     * @param message The message to send
+     * @param handler Optional completion handler
+     * @return void
+     */
+    void sendAsync(EventLoop& loop, const std::string& message, const SendHandler& handler = SendHandler());
+    
+    /**
+     * @brief Accept connections through an event loop (SERVER mode only, after listen())
+     * 
+     * @param loop The event loop
+     * @param handler Called for every accepted connection
+     * @return void
+     */
+    void acceptAsync(EventLoop& loop, const AcceptHandler& handler);
+    
+    /**
+     * @brief Stop all event loop activity on this socket
+     * 
+     * No handler passed to the async methods is called afterwards. Called by release().
+     * 
+     * @return void
+     */
+    void detach();
+    
+    /**
+     * @brief Wait for the next message inside a coroutine
+     * 
+     * Usage: bool ok = co_await conn.receive(loop, message);
+     * Messages arriving while nobody waits are queued. Do not combine with receiveAsync().
+     * A pending receive finishes with false when the connection closes or detach() is called.
+     * 
+     * @param loop The event loop
+     * @param message Reference to store the received message
+     * @return ReceiveAwaiter Awaitable yielding true if a message was received, false otherwise
+     */
+    ReceiveAwaiter receive(EventLoop& loop, std::string& message);
+    
+    /**
+     * @brief Send a message inside a coroutine
+     * 
+     * Usage: bool ok = co_await conn.send(loop, message);
+     * 
+     * @param loop The event loop
+     * @param message The message to send; must stay valid until the await finishes
+     * @return SendAwaiter Awaitable yielding true if the message was sent, false otherwise
+     */
+    SendAwaiter send(EventLoop& loop, const std::string& message);
+    
+    /**
+     * @brief Wait for the next client inside a coroutine (SERVER mode only, after listen())
+     * 
+     * Usage: std::unique_ptr<SocketCon> client = co_await server.accept(loop);
+     * Do not combine with acceptAsync().
+     * 
+     * @param loop The event loop
+     * @return AcceptAwaiter Awaitable yielding the connection, or nullptr on failure or detach()
+     */
+    AcceptAwaiter accept(EventLoop& loop);
+    
 private:
+    // Messages and clients queued for coroutines, and the coroutine waiting for them
+    struct Mailbox;
+    /**
+     * @brief Wrap a connection returned by accept()
+     * 
+     * @param fd Connected socket file descriptor
+     */
+    explicit SocketCon(int fd);
+    
+    /**
+     * @brief Create, bind and listen on the server socket
+     * 
+     * @return bool True if successful, false otherwise
+     */
+    bool openListener();
+    
+    /**
+     * @brief Make a single non-blocking connection attempt
+     * 
+     * @param timeoutMs Maximum time to wait for the handshake in milliseconds
+     * @return bool True if connected, false otherwise
+     */
+    bool tryConnect(int timeoutMs);
+    
+    /**
+     * @brief Apply the default options to a newly established connection
+     * 
+     * @return void
+     */
+    void configureConnection();
+    
+    /**
+     * @brief Read more bytes from the socket into the receive buffer
+     * 
+     * @param count Maximum number of bytes to read
+     * @return bool True if at least one byte was read, false on error or disconnect
+     */
+    bool fillBuffer(size_t count);
+    
+    /**
+     * @brief Wait until the kernel has released all MSG_ZEROCOPY sends
+     * 
+     * @return bool True if all completions were received, false otherwise
+     */
+    bool reapZeroCopy();
+    
+    /**
+     * @brief Read the payload length of the next frame in the receive buffer
+     * 
+     * @param length Receives the payload length
+     * @return bool True if the whole frame header has been received, false otherwise
+     */
+    bool peekFrame(uint32_t& length) const;
+    
+    /**
+     * @brief Attach the socket to an event loop
+     * 
+     * @param target The event loop
+     * @return bool True if attached, false if already attached to a different loop
+     */
+    bool attach(EventLoop& target);
+    
+    /**
+     * @brief Remove the descriptors from the event loop
+     * 
+     * @return void
+     */
+    void removeFromLoop();
+    
+    /**
+     * @brief Finish a coroutine waiting in receive() or accept() with false or nullptr,
+     * and fail the sends the event loop did not make
+     * 
+     * @return void
+     */
+    void wakeWaiters();
+    
     // Socket file descriptor
     int sockfd;
     
@@ -92,8 +414,40 @@ private:
     // Connection status
     bool connected;
     
+    // Bytes received but not yet returned by receive()
+    std::string rxBuffer;
+    
+    // Whether SO_ZEROCOPY is enabled on the connection
+    bool zeroCopyEnabled;
+    
+    // Number of MSG_ZEROCOPY sends issued and completed
+    uint32_t zeroCopySent;
+    uint32_t zeroCopyDone;
+    
+    // Event loop driving the async methods, if any
+    EventLoop* eventLoop;
+    
+    // Cleared by detach(); lets handlers already running notice that the socket went away
+    std::shared_ptr<bool> attached;
+    
+    // Set up by the first coroutine receive() or accept()
+    std::shared_ptr<Mailbox> mailbox;
+    
+    // Handlers of sends dropped by removeFromLoop(), failed by wakeWaiters()
+    std::vector<SendHandler> unsent;
+    
+    // Capture file recording this connection, if any, and the connection's id in it
+    CaptureWriter* capture;
+    uint32_t captureId;
+    
     // Buffer size for receiving messages
     static const int BUFFER_SIZE = 1024;
+    
+    // Size of the frame header carrying the payload length
+    static const size_t HEADER_SIZE = 4;
+    
+    // Largest payload accepted by receive()
+    static const uint32_t MAX_MESSAGE_SIZE = 16 * 1024 * 1024;
 };
 
 #endif // SOCKET_CON_LIB_H
\ No newline at end of file
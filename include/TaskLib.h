@@ -0,0 +1,256 @@
+#ifndef TASK_LIB_H
+#define TASK_LIB_H
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <utility>
+
+/**
+ * @brief Coroutine returning a value of type T
+ *
+ * A Task does not start until it is awaited by another coroutine or handed to
+ * spawn(). When it finishes, the awaiting coroutine continues directly, without
+ * going through the event loop.
+ *
+ * Example:
+ * @code
+ * Task<std::string> echo(SocketCon& conn, EventLoop& loop) {
+ *     std::string message;
+ *     if (co_await conn.receive(loop, message)) {
+ *         co_await conn.send(loop, message);
+ *     }
+ *     co_return message;
+ * }
+ * @endcode
+ */
+template <typename T>
+class Task;
+
+namespace TaskDetail {
+    // State shared by the promises of all Task types
+    struct PromiseBase {
+        std::coroutine_handle<> continuation;
+        bool detached = false;
+
+        // Resume the awaiting coroutine, or free the frame of a spawned task
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                PromiseBase& promise = handle.promise();
+                if (promise.continuation) {
+                    return promise.continuation;
+                }
+                if (promise.detached) {
+                    handle.destroy();
+                }
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {
+            }
+        };
+
+        std::suspend_always initial_suspend() noexcept {
+            return std::suspend_always();
+        }
+
+        FinalAwaiter final_suspend() noexcept {
+            return FinalAwaiter();
+        }
+
+        void unhandled_exception() noexcept {
+            std::terminate();
+        }
+    };
+
+    template <typename T>
+    struct Promise : PromiseBase {
+        T value;
+
+        Task<T> get_return_object() noexcept;
+
+        void return_value(T result) {
+            value = std::move(result);
+        }
+
+        T result() {
+            return std::move(value);
+        }
+    };
+
+    template <>
+    struct Promise<void> : PromiseBase {
+        Task<void> get_return_object() noexcept;
+
+        void return_void() noexcept {
+        }
+
+        void result() noexcept {
+        }
+    };
+}
+
+template <typename T>
+class Task {
+public:
+    typedef TaskDetail::Promise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> Handle;
+
+    explicit Task(Handle handle) : handle(handle) {
+    }
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, Handle())) {
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    // Start the task and continue the caller once it has finished
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle.promise().continuation = caller;
+        return handle;
+    }
+
+    T await_resume() {
+        return handle.promise().result();
+    }
+
+    /**
+     * @brief Give up ownership of the coroutine frame
+     *
+     * @return Handle The frame; the caller becomes responsible for it
+     */
+    Handle release() noexcept {
+        return std::exchange(handle, Handle());
+    }
+
+private:
+    Handle handle;
+};
+
+namespace TaskDetail {
+    template <typename T>
+    Task<T> Promise<T>::get_return_object() noexcept {
+        return Task<T>(std::coroutine_handle<Promise<T> >::from_promise(*this));
+    }
+
+    inline Task<void> Promise<void>::get_return_object() noexcept {
+        return Task<void>(std::coroutine_handle<Promise<void> >::from_promise(*this));
+    }
+}
+
+/**
+ * @brief Run a task without waiting for it
+ *
+ * The task starts right away and runs until its first suspension; its frame is
+ * freed when it finishes.
+ *
+ * @param task The task
+ * @return void
+ */
+inline void spawn(Task<void> task) {
+    Task<void>::Handle handle = task.release();
+    handle.promise().detached = true;
+    handle.resume();
+}
+
+/**
+ * @brief Value that is delivered later, e.g. by a callback, and can be awaited once
+ *
+ * Copies share the same state, so a copy can be handed to the code that
+ * delivers the value while the original is awaited.
+ */
+template <typename T>
+class Completion {
+public:
+    Completion() : state(std::make_shared<State>()) {
+    }
+
+    /**
+     * @brief Deliver the value and resume the coroutine waiting for it, if any
+     *
+     * @param value The value
+     * @return void
+     */
+    void set(const T& value) const {
+        state->value = value;
+        state->done = true;
+        if (state->waiter) {
+            std::exchange(state->waiter, std::coroutine_handle<>()).resume();
+        }
+    }
+
+    /**
+     * @brief Get a callback that delivers the value
+     *
+     * @return std::function<void(const T&)> Callback calling set()
+     */
+    std::function<void(const T&)> setter() const {
+        Completion copy = *this;
+        return [copy](const T& value) {
+            copy.set(value);
+        };
+    }
+
+    bool await_ready() const noexcept {
+        return state->done;
+    }
+
+    void await_suspend(std::coroutine_handle<> caller) const noexcept {
+        state->waiter = caller;
+    }
+
+    T await_resume() const {
+        return std::move(state->value);
+    }
+
+private:
+    struct State {
+        bool done = false;
+        T value;
+        std::coroutine_handle<> waiter;
+    };
+
+    std::shared_ptr<State> state;
+};
+
+/**
+ * @brief Start a task right away and await its result later
+ *
+ * Used to run several tasks at the same time:
+ * @code
+ * Completion<int> a = start(first());
+ * Completion<int> b = start(second());
+ * int sum = co_await a + co_await b;
+ * @endcode
+ *
+ * @param task The task
+ * @return Completion<T> Receives the task's result
+ */
+template <typename T>
+Completion<T> start(Task<T> task) {
+    Completion<T> done;
+    spawn([](Task<T> body, Completion<T> result) -> Task<void> {
+        T value = co_await body;
+        result.set(value);
+    }(std::move(task), done));
+    return done;
+}
+
+#endif // TASK_LIB_H
@@ -0,0 +1,226 @@
+#ifndef TELEMETRY_LIB_H
+#define TELEMETRY_LIB_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <netinet/in.h>
+
+/**
+ * @brief One telemetry sample as sent over UDP multicast
+ *
+ * On the wire a frame is FRAME_SIZE bytes in network byte order:
+ * magic "RT", version, flags, source, sequence, timestamp, then gyro, acc and
+ * temperature as IEEE 754 floats.
+ */
+struct TelemetryFrame {
+    uint32_t source = 0;           ///< Random id of the publisher, new on every start
+    uint32_t sequence = 0;         ///< Incremented by one for every frame
+    uint64_t timestampMs = 0;      ///< Publisher's wall-clock time in ms since the epoch
+    bool imuValid = false;         ///< True if gyro, acc and temperature hold readings
+    bool digitalIOValid = false;   ///< True if sensorOn and relayOn hold readings
+    float gyro[3] = { 0.0f, 0.0f, 0.0f };   ///< Angular rates in deg/s
+    float acc[3] = { 0.0f, 0.0f, 0.0f };    ///< Acceleration in m/s^2
+    float temperature = 0.0f;      ///< Temperature in degrees Celsius
+    bool sensorOn = false;         ///< Digital sensor state
+    bool relayOn = false;          ///< Relay state
+};
+
+namespace Telemetry {
+    /// Multicast group used when none is configured (organization-local scope)
+    const std::string DEFAULT_GROUP = "239.255.70.1";
+
+    /// UDP port used when none is configured
+    const int DEFAULT_PORT = 7010;
+
+    /// Size of an encoded frame in bytes
+    const size_t FRAME_SIZE = 48;
+
+    /**
+     * @brief Encode a frame for sending
+     *
+     * @param frame The frame
+     * @param buffer Destination of at least FRAME_SIZE bytes
+     * @return void
+     */
+    void encode(const TelemetryFrame& frame, uint8_t* buffer);
+
+    /**
+     * @brief Decode a received frame
+     *
+     * @param buffer The datagram
+     * @param size Size of the datagram
+     * @param frame Receives the frame
+     * @return bool True if the datagram is a telemetry frame of a known version
+     */
+    bool decode(const uint8_t* buffer, size_t size, TelemetryFrame& frame);
+}
+
+/**
+ * @brief Sends telemetry frames to a multicast group
+ *
+ * Frames are numbered by the publisher, so receivers can tell how many were lost.
+ */
+class TelemetryPublisher {
+public:
+    /**
+     * @brief Constructor for the TelemetryPublisher class
+     *
+     * @param group Multicast group address
+     * @param port UDP port
+     * @param interfaceAddress Address of the interface to send on; empty for the default route
+     */
+    TelemetryPublisher(const std::string& group = Telemetry::DEFAULT_GROUP, int port = Telemetry::DEFAULT_PORT,
+                       const std::string& interfaceAddress = "");
+
+    /**
+     * @brief Destructor for the TelemetryPublisher class
+     */
+    ~TelemetryPublisher();
+
+    /**
+     * @brief Create the socket
+     *
+     * @param ttl Number of router hops the frames may cross; 1 keeps them on the local network
+     * @return bool True if successful, false otherwise
+     */
+    bool init(int ttl = 1);
+
+    /**
+     * @brief Number the frame and send it without blocking
+     *
+     * @param frame The frame; source and sequence are filled in
+     * @return bool True if the frame was handed to the network, false otherwise
+     */
+    bool publish(TelemetryFrame& frame);
+
+    /**
+     * @brief Close the socket
+     *
+     * @return void
+     */
+    void release();
+
+private:
+    // Multicast group address
+    std::string group;
+
+    // UDP port
+    int port;
+
+    // Address of the interface to send on
+    std::string interfaceAddress;
+
+    // Socket file descriptor
+    int sockfd;
+
+    // Destination of the frames
+    struct sockaddr_in destination;
+
+    // Random id sent with every frame
+    uint32_t source;
+
+    // Sequence number of the next frame
+    uint32_t nextSequence;
+};
+
+/**
+ * @brief Receives telemetry frames from a multicast group and detects lost frames
+ *
+ * Frames that arrive out of order or twice are dropped. When the publisher
+ * restarts, the receiver follows the new sequence without counting a gap.
+ */
+class TelemetryReceiver {
+public:
+    /**
+     * @brief Frame counters since init()
+     */
+    struct Stats {
+        uint64_t received = 0;   ///< Frames returned by receive()
+        uint64_t lost = 0;       ///< Frames missing from the sequence
+        uint64_t late = 0;       ///< Frames dropped as duplicate or out of order
+        uint64_t restarts = 0;   ///< Times the publisher was seen restarting
+    };
+
+    /**
+     * @brief Constructor for the TelemetryReceiver class
+     *
+     * @param group Multicast group address
+     * @param port UDP port
+     * @param interfaceAddress Address of the interface to join the group on; empty for any
+     */
+    TelemetryReceiver(const std::string& group = Telemetry::DEFAULT_GROUP, int port = Telemetry::DEFAULT_PORT,
+                      const std::string& interfaceAddress = "");
+
+    /**
+     * @brief Destructor for the TelemetryReceiver class
+     */
+    ~TelemetryReceiver();
+
+    /**
+     * @brief Create the socket and join the group
+     *
+     * @return bool True if successful, false otherwise
+     */
+    bool init();
+
+    /**
+     * @brief Wait for the next frame in sequence
+     *
+     * @param frame Receives the frame
+     * @param timeoutMs Maximum time to wait in milliseconds, -1 to wait indefinitely
+     * @return bool True if a frame was received, false on timeout or error
+     */
+    bool receive(TelemetryFrame& frame, int timeoutMs = -1);
+
+    /**
+     * @brief Get the number of frames lost right before the last received frame
+     *
+     * @return uint32_t 0 if the last frame followed its predecessor directly
+     */
+    uint32_t getGap() const;
+
+    /**
+     * @brief Get the frame counters
+     *
+     * @return Stats The counters
+     */
+    Stats getStats() const;
+
+    /**
+     * @brief Leave the group and close the socket
+     *
+     * @return void
+     */
+    void release();
+
+private:
+    // Multicast group address
+    std::string group;
+
+    // UDP port
+    int port;
+
+    // Address of the interface the group is joined on
+    std::string interfaceAddress;
+
+    // Socket file descriptor
+    int sockfd;
+
+    // Whether a frame has been received since init()
+    bool synchronized;
+
+    // Source of the frames being followed
+    uint32_t source;
+
+    // Sequence number expected next
+    uint32_t expected;
+
+    // Frames lost before the last received frame
+    uint32_t gap;
+
+    // Frame counters
+    Stats stats;
+};
+
+#endif // TELEMETRY_LIB_H
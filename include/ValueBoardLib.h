@@ -0,0 +1,241 @@
+#ifndef VALUE_BOARD_LIB_H
+#define VALUE_BOARD_LIB_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+/**
+ * @brief Latest values of the GyroSensor Node, published in shared memory
+ *
+ * Sensor n of the node is imus[n]; only the first MAX_IMUS sensors are published.
+ */
+struct GyroBoard {
+    /// Name of the shared memory segment (/dev/shm/rcs-gyro)
+    static constexpr const char* SEGMENT = "/rcs-gyro";
+
+    /// Number of sensors the board has room for
+    static const int MAX_IMUS = 8;
+
+    /**
+     * @brief Latest reading of one sensor
+     */
+    struct Imu {
+        float gyro[3];        ///< Angular rates in deg/s
+        float acc[3];         ///< Acceleration in m/s^2
+        float temperature;    ///< Temperature in degrees Celsius
+        float roll;           ///< Attitude estimate in degrees
+        float pitch;
+        float yaw;
+    };
+
+    uint64_t timestampNs = 0;   ///< CLOCK_MONOTONIC time of the last sample in ns
+    uint64_t samples = 0;       ///< Sampling passes since the node started
+    uint32_t imuCount = 0;      ///< Number of valid entries in imus
+    Imu imus[MAX_IMUS] = {};
+};
+
+/**
+ * @brief Latest values of the DigitalIO Node, published in shared memory
+ */
+struct DigitalIOBoard {
+    /// Name of the shared memory segment (/dev/shm/rcs-digitalio)
+    static constexpr const char* SEGMENT = "/rcs-digitalio";
+
+    uint64_t timestampNs = 0;   ///< CLOCK_MONOTONIC time of the last sensor poll in ns
+    bool sensorOn = false;      ///< Digital sensor state
+    bool relayOn = false;       ///< State of relay 0
+    uint32_t relayCount = 0;    ///< Number of relays in the bank
+    uint64_t relays = 0;        ///< State of every relay, bit n for relay n
+};
+
+/**
+ * @brief Fixed-size record in a POSIX shared memory segment, written by one
+ * process and read by any number of others without locks or system calls
+ *
+ * The record is guarded by a sequence counter (seqlock): the writer makes it
+ * odd before changing the record and even again afterwards, and a reader
+ * copies the record and retries if the counter was odd or changed meanwhile.
+ * Readers therefore always get a consistent snapshot and can never hold up
+ * the writer. Readers map the segment read-only.
+ *
+ * The segment outlives the writer, so readers keep working across node
+ * restarts; the timestamp in the record shows how fresh it is.
+ */
+class SharedBoard {
+public:
+    /**
+     * @brief Constructor for the SharedBoard class
+     *
+     * @param name Segment name, e.g. "/rcs-gyro"
+     * @param size Size of the record in bytes, a multiple of 4
+     */
+    SharedBoard(const std::string& name, size_t size);
+
+    /**
+     * @brief Destructor for the SharedBoard class; unmaps the segment
+     */
+    ~SharedBoard();
+
+    /**
+     * @brief Create or take over the segment as its only writer
+     *
+     * @return bool True if successful, false if another process writes the segment or on error
+     */
+    bool create();
+
+    /**
+     * @brief Map an existing segment for reading
+     *
+     * @return bool True if the segment exists and has the expected layout, false otherwise
+     */
+    bool open();
+
+    /**
+     * @brief Check whether the segment is mapped
+     *
+     * @return bool True after a successful create() or open()
+     */
+    bool isOpen() const;
+
+    /**
+     * @brief Replace the record; must not be called from several threads at once
+     *
+     * @param record The new record, size bytes
+     * @return void
+     */
+    void write(const void* record);
+
+    /**
+     * @brief Copy a consistent snapshot of the record
+     *
+     * @param record Receives size bytes
+     * @return bool True if a record was copied, false if nothing was written yet or the writer stopped mid-update
+     */
+    bool read(void* record) const;
+
+    /**
+     * @brief Unmap the segment; the segment itself is kept for the next writer and the readers
+     *
+     * @return void
+     */
+    void release();
+
+    SharedBoard(const SharedBoard&) = delete;
+    SharedBoard& operator=(const SharedBoard&) = delete;
+
+private:
+    // Create a new segment with an empty record
+    bool createFresh();
+
+    // Map the segment behind fd and check its header
+    bool map(int prot);
+
+    // Segment name
+    std::string name;
+
+    // Size of the record in bytes
+    size_t size;
+
+    // Segment file descriptor; the writer keeps it open to hold its lock
+    int fd;
+
+    // Mapped header followed by the record, as 32-bit words
+    uint32_t* words;
+};
+
+/**
+ * @brief Publishes a board record (GyroBoard or DigitalIOBoard)
+ */
+template <typename T>
+class BoardWriter {
+    static_assert(std::is_trivially_copyable<T>::value && sizeof(T) % 4 == 0, "board records are copied as words");
+
+public:
+    /**
+     * @brief Constructor for the BoardWriter class
+     *
+     * @param name Segment name; the record's own by default
+     */
+    explicit BoardWriter(const std::string& name = T::SEGMENT) : board(name, sizeof(T)) {}
+
+    /**
+     * @brief Create or take over the segment
+     *
+     * @return bool True if successful, false otherwise
+     */
+    bool init() {
+        return board.create();
+    }
+
+    /**
+     * @brief Publish a record; does nothing if init() failed
+     *
+     * @param record The record
+     * @return void
+     */
+    void publish(const T& record) {
+        if (board.isOpen()) {
+            board.write(&record);
+        }
+    }
+
+    /**
+     * @brief Stop publishing
+     *
+     * @return void
+     */
+    void release() {
+        board.release();
+    }
+
+private:
+    SharedBoard board;
+};
+
+/**
+ * @brief Reads a board record (GyroBoard or DigitalIOBoard) published by a node on the same machine
+ *
+ * Example:
+ * @code
+ * BoardReader<GyroBoard> reader;
+ * GyroBoard gyro;
+ * if (reader.read(gyro) && gyro.imuCount > 0) {
+ *     std::cout << gyro.imus[0].gyro[0] << std::endl;
+ * }
+ * @endcode
+ */
+template <typename T>
+class BoardReader {
+    static_assert(std::is_trivially_copyable<T>::value && sizeof(T) % 4 == 0, "board records are copied as words");
+
+public:
+    /**
+     * @brief Constructor for the BoardReader class
+     *
+     * @param name Segment name; the record's own by default
+     */
+    explicit BoardReader(const std::string& name = T::SEGMENT) : board(name, sizeof(T)) {}
+
+    /**
+     * @brief Read the latest record
+     *
+     * The segment is mapped on the first call that finds it, so readers may
+     * start before the node; after that, reading takes no system calls.
+     *
+     * @param record Receives the record
+     * @return bool True if a record was read, false if the node has not published one
+     */
+    bool read(T& record) {
+        if (!board.isOpen() && !board.open()) {
+            return false;
+        }
+        return board.read(&record);
+    }
+
+private:
+    SharedBoard board;
+};
+
+#endif // VALUE_BOARD_LIB_H
@@ -0,0 +1,86 @@
+#ifndef WORKER_POOL_LIB_H
+#define WORKER_POOL_LIB_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * @brief Fixed set of threads running tasks, serialized per key
+ *
+ * Every task names the keys (e.g. devices) it uses. Tasks sharing a key run
+ * one after another in the order they were submitted; tasks without a common
+ * key run in parallel. A task with several keys waits until it is first in
+ * line for all of them, so it is ordered against each of them. A task without
+ * keys runs as soon as a thread is free.
+ */
+class WorkerPool {
+public:
+    /**
+     * @brief Constructor for the WorkerPool class; starts the threads
+     *
+     * @param threads Number of threads, at least 1
+     */
+    explicit WorkerPool(size_t threads);
+
+    /**
+     * @brief Destructor for the WorkerPool class; runs the remaining tasks and joins the threads
+     */
+    ~WorkerPool();
+
+    /**
+     * @brief Queue a task
+     *
+     * @param keys The keys the task uses; may be empty
+     * @param task The task
+     * @return void
+     */
+    void submit(const std::vector<std::string>& keys, std::function<void()> task);
+
+    /**
+     * @brief Wait until all submitted tasks have finished
+     *
+     * @return void
+     */
+    void waitIdle();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+private:
+    struct Job {
+        std::vector<std::string> keys;
+        std::function<void()> task;
+        bool queued;
+    };
+
+    // Take ready tasks until the pool stops
+    void work();
+
+    // Queue the job if it is first in line for all its keys; the caller holds the mutex
+    void makeReadyIfFirst(const std::shared_ptr<Job>& job);
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+
+    // Jobs in submission order per key; the front job of a key is running or about to
+    std::map<std::string, std::deque<std::shared_ptr<Job> > > lines;
+
+    // Jobs that may run now
+    std::deque<std::shared_ptr<Job> > ready;
+
+    // Jobs submitted and not yet finished
+    size_t outstanding;
+
+    bool stopping;
+    std::vector<std::thread> threads;
+};
+
+#endif // WORKER_POOL_LIB_H
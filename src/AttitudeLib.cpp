@@ -0,0 +1,107 @@
+#include "../include/AttitudeLib.h"
+#include <cmath>
+
+namespace {
+    const double DEG_TO_RAD = M_PI / 180.0;
+    const double RAD_TO_DEG = 180.0 / M_PI;
+}
+
+Attitude::Attitude(double beta) : beta(beta), q0(1.0), q1(0.0), q2(0.0), q3(0.0) {
+    // Start from the identity orientation
+}
+
+void Attitude::reset() {
+    q0 = 1.0;
+    q1 = 0.0;
+    q2 = 0.0;
+    q3 = 0.0;
+}
+
+void Attitude::update(double gx, double gy, double gz,
+                      double ax, double ay, double az, double dt) {
+    // Convert the gyroscope rates to rad/s
+    gx *= DEG_TO_RAD;
+    gy *= DEG_TO_RAD;
+    gz *= DEG_TO_RAD;
+
+    // Rate of change of the quaternion from the gyroscope
+    double qDot0 = 0.5 * (-q1 * gx - q2 * gy - q3 * gz);
+    double qDot1 = 0.5 * (q0 * gx + q2 * gz - q3 * gy);
+    double qDot2 = 0.5 * (q0 * gy - q1 * gz + q3 * gx);
+    double qDot3 = 0.5 * (q0 * gz + q1 * gy - q2 * gx);
+
+    // Apply the accelerometer correction only if the measurement is valid
+    double norm = std::sqrt(ax * ax + ay * ay + az * az);
+    if (norm > 0.0) {
+        ax /= norm;
+        ay /= norm;
+        az /= norm;
+
+        // Gradient descent step towards the measured gravity direction
+        double _2q0 = 2.0 * q0;
+        double _2q1 = 2.0 * q1;
+        double _2q2 = 2.0 * q2;
+        double _2q3 = 2.0 * q3;
+        double _4q0 = 4.0 * q0;
+        double _4q1 = 4.0 * q1;
+        double _4q2 = 4.0 * q2;
+        double _8q1 = 8.0 * q1;
+        double _8q2 = 8.0 * q2;
+        double q0q0 = q0 * q0;
+        double q1q1 = q1 * q1;
+        double q2q2 = q2 * q2;
+        double q3q3 = q3 * q3;
+
+        double s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+        double s1 = _4q1 * q3q3 - _2q3 * ax + 4.0 * q0q0 * q1 - _2q0 * ay - _4q1
+                    + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+        double s2 = 4.0 * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2
+                    + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+        double s3 = 4.0 * q1q1 * q3 - _2q1 * ax + 4.0 * q2q2 * q3 - _2q2 * ay;
+
+        norm = std::sqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+        if (norm > 0.0) {
+            qDot0 -= beta * s0 / norm;
+            qDot1 -= beta * s1 / norm;
+            qDot2 -= beta * s2 / norm;
+            qDot3 -= beta * s3 / norm;
+        }
+    }
+
+    // Integrate and renormalise
+    q0 += qDot0 * dt;
+    q1 += qDot1 * dt;
+    q2 += qDot2 * dt;
+    q3 += qDot3 * dt;
+
+    norm = std::sqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    q0 /= norm;
+    q1 /= norm;
+    q2 /= norm;
+    q3 /= norm;
+}
+
+double Attitude::getRoll() const {
+    return std::atan2(q0 * q1 + q2 * q3, 0.5 - q1 * q1 - q2 * q2) * RAD_TO_DEG;
+}
+
+double Attitude::getPitch() const {
+    double sinp = -2.0 * (q1 * q3 - q0 * q2);
+    if (sinp > 1.0) {
+        sinp = 1.0;
+    } else if (sinp < -1.0) {
+        sinp = -1.0;
+    }
+    return std::asin(sinp) * RAD_TO_DEG;
+}
+
+double Attitude::getYaw() const {
+    return std::atan2(q1 * q2 + q0 * q3, 0.5 - q2 * q2 - q3 * q3) * RAD_TO_DEG;
+}
+
+void Attitude::getQuaternion(double q[4]) const {
+    q[0] = q0;
+    q[1] = q1;
+    q[2] = q2;
+    q[3] = q3;
+}
@@ -0,0 +1,182 @@
+#include "../include/BrokerLib.h"
+#include <vector>
+#include <algorithm>
+
+Broker::Subscriber::Subscriber(size_t capacity, const Callback& onReady, const Callback& onOverflow)
+    : capacity(capacity > 0 ? capacity : 1), onReady(onReady), onOverflow(onOverflow),
+      reserved(0), idle(true), overflowed(false), dropped(0), conflated(0) {
+}
+
+bool Broker::Subscriber::next(std::string& message) {
+    if (queue.empty() || overflowed) {
+        idle = true;
+        return false;
+    }
+
+    if (queue.front().reserved) {
+        reserved--;
+    }
+    message.swap(queue.front().message);
+    queue.pop_front();
+    return true;
+}
+
+bool Broker::Subscriber::hasOverflowed() const {
+    return overflowed;
+}
+
+uint64_t Broker::Subscriber::getDropped() const {
+    return dropped;
+}
+
+uint64_t Broker::Subscriber::getConflated() const {
+    return conflated;
+}
+
+void Broker::Subscriber::push(const std::string& topic, const std::string& message, Overflow policy) {
+    if (overflowed) {
+        return;
+    }
+
+    if (policy == Overflow::CONFLATE) {
+        // Replace the pending event of this topic, if there is one
+        for (std::deque<Event>::iterator it = queue.begin(); it != queue.end(); ++it) {
+            if (it->topic == topic) {
+                it->message = message;
+                conflated++;
+                return;
+            }
+        }
+    }
+
+    // A CONFLATE topic has room for its one pending event beyond the capacity,
+    // so the latest value is never lost to the other topics' events
+    bool reserve = policy == Overflow::CONFLATE;
+    if (!reserve && queue.size() - reserved >= capacity) {
+        if (policy == Overflow::DISCONNECT) {
+            // Nothing queued will be delivered any more
+            overflowed = true;
+            dropped += queue.size() + 1;
+            queue.clear();
+            reserved = 0;
+            if (onOverflow) {
+                onOverflow(shared_from_this());
+            }
+            return;
+        }
+
+        // Make room only at the expense of this topic's own events, so that
+        // the policies of the other topics still hold
+        std::deque<Event>::iterator oldest = queue.begin();
+        while (oldest != queue.end() && (oldest->topic != topic || oldest->reserved)) {
+            ++oldest;
+        }
+        dropped++;
+        if (oldest == queue.end()) {
+            return;
+        }
+        queue.erase(oldest);
+    }
+
+    Event event = { topic, message, reserve };
+    queue.push_back(event);
+    if (reserve) {
+        reserved++;
+    }
+
+    if (idle) {
+        idle = false;
+        if (onReady) {
+            onReady(shared_from_this());
+        }
+    }
+}
+
+Broker::Broker(size_t capacity) : capacity(capacity) {
+}
+
+std::shared_ptr<Broker::Subscriber> Broker::attach(const Subscriber::Callback& onReady,
+                                                   const Subscriber::Callback& onOverflow) {
+    return std::make_shared<Subscriber>(capacity, onReady, onOverflow);
+}
+
+void Broker::detach(const std::shared_ptr<Subscriber>& subscriber) {
+    std::map<std::string, Overflow>::iterator it;
+    for (it = subscriber->topics.begin(); it != subscriber->topics.end(); ++it) {
+        subscribers[it->first].erase(subscriber);
+    }
+    subscriber->topics.clear();
+    subscriber->rates.clear();
+}
+
+void Broker::subscribe(const std::shared_ptr<Subscriber>& subscriber, const std::string& topic, Overflow policy,
+                       int rateHz) {
+    subscriber->topics[topic] = policy;
+    subscriber->rates[topic] = rateHz;
+    subscribers[topic].insert(subscriber);
+}
+
+bool Broker::unsubscribe(const std::shared_ptr<Subscriber>& subscriber, const std::string& topic) {
+    if (subscriber->topics.erase(topic) == 0) {
+        return false;
+    }
+    subscriber->rates.erase(topic);
+    subscribers[topic].erase(subscriber);
+    return true;
+}
+
+size_t Broker::publish(const std::string& topic, const std::string& message) {
+    std::map<std::string, std::set<std::shared_ptr<Subscriber> > >::iterator found = subscribers.find(topic);
+    if (found == subscribers.end()) {
+        return 0;
+    }
+
+    // Callbacks may detach subscribers, so work on a copy of the set
+    std::vector<std::shared_ptr<Subscriber> > targets(found->second.begin(), found->second.end());
+    for (size_t i = 0; i < targets.size(); i++) {
+        std::map<std::string, Overflow>::iterator subscription = targets[i]->topics.find(topic);
+        if (subscription != targets[i]->topics.end()) {
+            targets[i]->push(topic, message, subscription->second);
+        }
+    }
+    return targets.size();
+}
+
+int Broker::requestedRate(const std::string& topic) const {
+    std::map<std::string, std::set<std::shared_ptr<Subscriber> > >::const_iterator found = subscribers.find(topic);
+    if (found == subscribers.end()) {
+        return 0;
+    }
+
+    int rate = 0;
+    std::set<std::shared_ptr<Subscriber> >::const_iterator it;
+    for (it = found->second.begin(); it != found->second.end(); ++it) {
+        std::map<std::string, int>::const_iterator subscription = (*it)->rates.find(topic);
+        if (subscription != (*it)->rates.end()) {
+            rate = std::max(rate, subscription->second);
+        }
+    }
+    return rate;
+}
+
+std::vector<std::string> Broker::topicsOf(const std::shared_ptr<Subscriber>& subscriber) const {
+    std::vector<std::string> topics;
+    std::map<std::string, Overflow>::const_iterator it;
+    for (it = subscriber->topics.begin(); it != subscriber->topics.end(); ++it) {
+        topics.push_back(it->first);
+    }
+    return topics;
+}
+
+bool Broker::parseOverflow(const std::string& name, Overflow& policy) {
+    if (name == "drop-oldest") {
+        policy = Overflow::DROP_OLDEST;
+    } else if (name == "conflate") {
+        policy = Overflow::CONFLATE;
+    } else if (name == "disconnect") {
+        policy = Overflow::DISCONNECT;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,165 @@
+#include "../include/CaptureLib.h"
+#include <iostream>
+#include <cstring>
+
+namespace {
+    const char MAGIC[8] = { 'R', 'C', 'S', 'C', 'A', 'P', '1', '\n' };
+
+    // Larger records only occur in corrupt files
+    const uint64_t MAX_RECORD_SIZE = 64 * 1024 * 1024;
+
+    void putVarint(std::FILE* file, uint64_t value) {
+        while (value >= 0x80) {
+            std::fputc(static_cast<int>((value & 0x7F) | 0x80), file);
+            value >>= 7;
+        }
+        std::fputc(static_cast<int>(value), file);
+    }
+
+    bool getVarint(std::FILE* file, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int byte = std::fgetc(file);
+            if (byte == EOF) {
+                return false;
+            }
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+CaptureWriter::CaptureWriter() : file(NULL), lastUs(0), nextConnection(1) {
+}
+
+CaptureWriter::~CaptureWriter() {
+    close();
+}
+
+bool CaptureWriter::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file != NULL) {
+        std::fclose(file);
+    }
+
+    file = std::fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        std::cerr << "Failed to create capture file " << path << std::endl;
+        return false;
+    }
+
+    // A large buffer keeps recording off the critical path; records are flushed in bulk
+    std::setvbuf(file, NULL, _IOFBF, 1 << 16);
+    std::fwrite(MAGIC, 1, sizeof(MAGIC), file);
+    start = std::chrono::steady_clock::now();
+    lastUs = 0;
+    nextConnection = 1;
+    return true;
+}
+
+uint32_t CaptureWriter::openConnection(const std::string& label) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file == NULL) {
+        return 0;
+    }
+
+    uint32_t connection = nextConnection++;
+    write(connection, CaptureRecord::Type::OPEN, label);
+    return connection;
+}
+
+void CaptureWriter::record(uint32_t connection, CaptureRecord::Type type, const std::string& message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file != NULL && connection != 0) {
+        write(connection, type, message);
+    }
+}
+
+void CaptureWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (file != NULL) {
+        std::fclose(file);
+        file = NULL;
+    }
+}
+
+void CaptureWriter::write(uint32_t connection, CaptureRecord::Type type, const std::string& message) {
+    uint64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    // Threads may take the mutex out of timestamp order; never go backwards
+    if (nowUs < lastUs) {
+        nowUs = lastUs;
+    }
+
+    putVarint(file, nowUs - lastUs);
+    std::fputc(static_cast<int>(type), file);
+    putVarint(file, connection);
+    putVarint(file, message.size());
+    std::fwrite(message.data(), 1, message.size(), file);
+    lastUs = nowUs;
+}
+
+CaptureReader::CaptureReader() : file(NULL), timeUs(0) {
+}
+
+CaptureReader::~CaptureReader() {
+    close();
+}
+
+bool CaptureReader::open(const std::string& path) {
+    close();
+
+    file = std::fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        std::cerr << "Failed to open capture file " << path << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(MAGIC)];
+    if (std::fread(magic, 1, sizeof(magic), file) != sizeof(magic) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        std::cerr << "Not a capture file: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    timeUs = 0;
+    return true;
+}
+
+bool CaptureReader::next(CaptureRecord& record) {
+    if (file == NULL) {
+        return false;
+    }
+
+    uint64_t delta, connection, length;
+    if (!getVarint(file, delta)) {
+        return false;
+    }
+    int type = std::fgetc(file);
+    if (type == EOF || type > static_cast<int>(CaptureRecord::Type::CLOSE) ||
+        !getVarint(file, connection) || !getVarint(file, length) || length > MAX_RECORD_SIZE) {
+        return false;
+    }
+
+    record.message.resize(length);
+    if (length > 0 && std::fread(&record.message[0], 1, length, file) != length) {
+        return false;
+    }
+
+    timeUs += delta;
+    record.timeUs = timeUs;
+    record.type = static_cast<CaptureRecord::Type>(type);
+    record.connection = static_cast<uint32_t>(connection);
+    return true;
+}
+
+void CaptureReader::close() {
+    if (file != NULL) {
+        std::fclose(file);
+        file = NULL;
+    }
+}
@@ -1,8 +1,7 @@
 #include "../include/DigSensorLib.h"
-#include <wiringPi.h>
 #include <iostream>
 
-DigSensor::DigSensor() : initialized(false), sensorType("TEMPERATURE") {
+DigSensor::DigSensor() : sensorType("TEMPERATURE"), initialized(false) {
     // Default sensor type is TEMPERATURE, can be changed if needed
 }
 
@@ -14,15 +13,12 @@ DigSensor::~DigSensor() {
 }
 
 void DigSensor::init() {
-    // Initialize wiringPi library if not already initialized
-    if (wiringPiSetupGpio() == -1) {
-        std::cerr << "Failed to initialize wiringPi" << std::endl;
+    // Configure the sensor pin as input
+    if (!line.request({ SENSOR_PIN }, GpioLines::Direction::IN)) {
+        std::cerr << "Failed to initialize digital sensor GPIO" << std::endl;
         return;
     }
     
-    // Configure the sensor pin as input
-    pinMode(SENSOR_PIN, INPUT);
-    
     initialized = true;
     std::cout << "Digital sensor initialized successfully" << std::endl;
 }
@@ -33,7 +29,7 @@ void DigSensor::release() {
     }
     
     // Reset pin to input mode (safe state)
-    pinMode(SENSOR_PIN, INPUT);
+    line.release();
     
     initialized = false;
     std::cout << "Digital sensor resources released" << std::endl;
@@ -46,10 +42,11 @@ bool DigSensor::read() {
     }
     
     // Read the digital value from the sensor pin
-    int value = digitalRead(SENSOR_PIN);
+    uint64_t value = 0;
+    line.read(value);
     
     // Return true if HIGH, false if LOW
-    return (value == HIGH);
+    return (value & 1) != 0;
 }
 
 std::string DigSensor::getType() const {
@@ -0,0 +1,893 @@
+#include "../include/EventLoopLib.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+#include <linux/io_uring.h>
+
+// Interface between the loop and an I/O engine. An engine reports every
+// event back through the loop's on*() callbacks, always from wait().
+class EventLoop::Engine {
+public:
+    virtual ~Engine() {}
+
+    // Start delivering received bytes for a descriptor
+    virtual void receive(int fd) = 0;
+
+    // Start accepting connections on a listening descriptor
+    virtual void accept(int fd) = 0;
+
+    // Send bytes; the loop keeps them alive and queues at most one send per descriptor
+    virtual void send(int fd, const char* data, size_t length) = 0;
+
+    // Forget a descriptor; no further events are reported for it
+    virtual void remove(int fd) = 0;
+
+    // Wait for events for at most timeoutMs (-1 for no limit) and dispatch them
+    virtual void wait(int timeoutMs) = 0;
+};
+
+namespace {
+    void setBlocking(int fd, bool blocking) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags >= 0) {
+            fcntl(fd, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+        }
+    }
+}
+
+/**
+ * io_uring engine built directly on the kernel interface.
+ *
+ * All operations prepared while handling one batch of completions are
+ * submitted together by the single io_uring_enter() that waits for the
+ * next batch.
+ */
+class UringEngine : public EventLoop::Engine {
+public:
+    UringEngine(EventLoop& loop, int wakeFd)
+        : loop(loop), wakeFd(wakeFd), ringFd(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED),
+          sqes(static_cast<io_uring_sqe*>(MAP_FAILED)),
+          sqRingSize(0), cqRingSize(0), sqesSize(0),
+          sqeTail(0), nextOpId(FIRST_OP_ID), wakeValue(0) {
+    }
+
+    ~UringEngine() {
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing != MAP_FAILED && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != MAP_FAILED) {
+            munmap(sqRing, sqRingSize);
+        }
+        if (ringFd >= 0) {
+            close(ringFd);
+        }
+    }
+
+    // Set up the rings and register the buffers; false if the kernel lacks a required feature
+    bool init() {
+        // Multishot receive needs Linux 6.0; older kernels reject it only once a receive is queued
+        struct utsname host;
+        int major = 0, minor = 0;
+        if (uname(&host) != 0 || sscanf(host.release, "%d.%d", &major, &minor) != 2 || major < 6) {
+            return false;
+        }
+
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, RING_ENTRIES, &params));
+        if (ringFd < 0) {
+            return false;
+        }
+
+        // The timeout argument of io_uring_enter() needs IORING_FEAT_EXT_ARG (5.11)
+        if (!(params.features & IORING_FEAT_EXT_ARG)) {
+            return false;
+        }
+
+        // Map the submission and completion rings
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            return false;
+        }
+        cqRing = singleMmap ? sqRing : mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            return false;
+        }
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        void* sqeMem = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ringFd, IORING_OFF_SQES);
+        if (sqeMem == MAP_FAILED) {
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqeMem);
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqEntries = params.sq_entries;
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+        sqeTail = *sqTail;
+
+        // Buffer group for multishot receive; handed to the kernel with the first submission
+        recvPool.resize(RECV_BUFFERS * RECV_BUFFER_SIZE);
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = RECV_BUFFERS;
+        sqe->addr = reinterpret_cast<uint64_t>(&recvPool[0]);
+        sqe->len = RECV_BUFFER_SIZE;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->off = 0;
+        sqe->user_data = PROVIDE_OP_ID;
+
+        // Registered buffers for small sends
+        sendPool.resize(SEND_SLOTS * SEND_SLOT_SIZE);
+        std::vector<struct iovec> iov(SEND_SLOTS);
+        for (unsigned slot = 0; slot < SEND_SLOTS; slot++) {
+            iov[slot].iov_base = &sendPool[slot * SEND_SLOT_SIZE];
+            iov[slot].iov_len = SEND_SLOT_SIZE;
+            freeSlots.push_back(slot);
+        }
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS, &iov[0], SEND_SLOTS) < 0) {
+            return false;
+        }
+
+        armWake();
+        return true;
+    }
+
+    void receive(int fd) override {
+        // Blocking descriptors let the kernel wait internally instead of failing with EAGAIN
+        setBlocking(fd, true);
+        armReceive(fd);
+    }
+
+    void accept(int fd) override {
+        setBlocking(fd, true);
+        armAccept(fd);
+    }
+
+    void send(int fd, const char* data, size_t length) override {
+        uint64_t id = addOp(Op::SEND, fd);
+        io_uring_sqe* sqe = getSqe();
+        sqe->fd = fd;
+        sqe->user_data = id;
+
+        if (length <= SEND_SLOT_SIZE && !freeSlots.empty()) {
+            // Copy into a registered buffer so the kernel need not map user pages
+            unsigned slot = freeSlots.back();
+            freeSlots.pop_back();
+            ops[id].slot = static_cast<int>(slot);
+
+            char* buffer = &sendPool[slot * SEND_SLOT_SIZE];
+            memcpy(buffer, data, length);
+            sqe->opcode = IORING_OP_WRITE_FIXED;
+            sqe->addr = reinterpret_cast<uint64_t>(buffer);
+            sqe->len = static_cast<uint32_t>(length);
+            sqe->buf_index = static_cast<uint16_t>(slot);
+        } else {
+            // Keep a private copy; the loop may drop its queue before the kernel is done
+            std::string& payload = ops[id].payload;
+            payload.assign(data, length);
+            sqe->opcode = IORING_OP_SEND;
+            sqe->addr = reinterpret_cast<uint64_t>(payload.data());
+            sqe->len = static_cast<uint32_t>(length);
+            sqe->msg_flags = MSG_NOSIGNAL;
+        }
+    }
+
+    void remove(int fd) override {
+        bool any = false;
+        for (std::map<uint64_t, Op>::iterator it = ops.begin(); it != ops.end(); ++it) {
+            if (it->second.fd == fd && it->second.live) {
+                it->second.live = false;
+                any = true;
+            }
+        }
+
+        // Cancel everything still queued in the kernel for the descriptor
+        if (any) {
+            io_uring_sqe* sqe = getSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = fd;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data = CANCEL_OP_ID;
+
+            // Submit now, while the descriptor still refers to the same socket
+            enter(0);
+        }
+    }
+
+    void wait(int timeoutMs) override {
+        enter(timeoutMs);
+
+        // Copy the completions out first; handlers may queue new submissions
+        std::vector<struct io_uring_cqe> ready;
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            ready.push_back(cqes[head & cqMask]);
+            head++;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+        for (size_t i = 0; i < ready.size(); i++) {
+            dispatch(ready[i]);
+        }
+    }
+
+private:
+    // Sizes of the rings and buffer pools
+    static const unsigned RING_ENTRIES = 256;
+    static const unsigned RECV_BUFFERS = 64;
+    static const size_t RECV_BUFFER_SIZE = 4096;
+    static const unsigned SEND_SLOTS = 64;
+    static const size_t SEND_SLOT_SIZE = 4096;
+    static const uint16_t BUFFER_GROUP = 1;
+
+    // Reserved user_data values
+    static const uint64_t CANCEL_OP_ID = 1;
+    static const uint64_t WAKE_OP_ID = 2;
+    static const uint64_t PROVIDE_OP_ID = 3;
+    static const uint64_t FIRST_OP_ID = 16;
+
+    // An operation in flight in the kernel
+    struct Op {
+        enum Kind { RECV, ACCEPT, SEND } kind;
+        int fd;
+        bool live;
+        int slot;
+        std::string payload;
+    };
+
+    uint64_t addOp(Op::Kind kind, int fd) {
+        uint64_t id = nextOpId++;
+        Op op;
+        op.kind = kind;
+        op.fd = fd;
+        op.live = true;
+        op.slot = -1;
+        ops[id] = op;
+        return id;
+    }
+
+    // Queue a multishot receive drawing from the buffer ring
+    void armReceive(int fd) {
+        uint64_t id = addOp(Op::RECV, fd);
+
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->user_data = id;
+    }
+
+    // Queue a single accept
+    void armAccept(int fd) {
+        uint64_t id = addOp(Op::ACCEPT, fd);
+
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = fd;
+        sqe->user_data = id;
+    }
+
+    // Get a zeroed submission entry, flushing the queue first if it is full
+    io_uring_sqe* getSqe() {
+        if (sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+            enter(0);
+        }
+        unsigned index = sqeTail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqArray[index] = index;
+        sqeTail++;
+        return sqe;
+    }
+
+    // Submit everything queued and optionally wait for one completion
+    void enter(int timeoutMs) {
+        __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+        unsigned toSubmit = sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        if (timeoutMs > 0) {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+
+        unsigned waitFor = (timeoutMs == 0) ? 0 : 1;
+        unsigned flags = IORING_ENTER_EXT_ARG | (waitFor ? IORING_ENTER_GETEVENTS : 0);
+        if (syscall(__NR_io_uring_enter, ringFd, toSubmit, waitFor, flags, &arg, sizeof(arg)) < 0 &&
+            errno != EINTR && errno != ETIME && errno != EBUSY && errno != EAGAIN) {
+            std::cerr << "io_uring_enter failed: " << strerror(errno) << std::endl;
+        }
+    }
+
+    // Return a receive buffer to the kernel; goes out with the next submission
+    void recycleBuffer(unsigned bid) {
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = 1;
+        sqe->addr = reinterpret_cast<uint64_t>(&recvPool[bid * RECV_BUFFER_SIZE]);
+        sqe->len = RECV_BUFFER_SIZE;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->off = bid;
+        sqe->user_data = PROVIDE_OP_ID;
+    }
+
+    // Wait for the loop's eventfd to be signalled
+    void armWake() {
+        io_uring_sqe* sqe = getSqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = wakeFd;
+        sqe->addr = reinterpret_cast<uint64_t>(&wakeValue);
+        sqe->len = sizeof(wakeValue);
+        sqe->user_data = WAKE_OP_ID;
+    }
+
+    void dispatch(const struct io_uring_cqe& cqe) {
+        if (cqe.user_data == CANCEL_OP_ID || cqe.user_data == PROVIDE_OP_ID) {
+            return;
+        }
+        if (cqe.user_data == WAKE_OP_ID) {
+            armWake();
+            loop.onWake();
+            return;
+        }
+
+        std::map<uint64_t, Op>::iterator it = ops.find(cqe.user_data);
+        if (it == ops.end()) {
+            return;
+        }
+        Op op;
+        op.kind = it->second.kind;
+        op.fd = it->second.fd;
+        op.live = it->second.live;
+        op.slot = it->second.slot;
+        bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+        switch (op.kind) {
+            case Op::RECV: {
+                if (!more) {
+                    ops.erase(it);
+                }
+                if (cqe.flags & IORING_CQE_F_BUFFER) {
+                    unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                    if (op.live && cqe.res > 0) {
+                        loop.onData(op.fd, &recvPool[bid * RECV_BUFFER_SIZE], cqe.res);
+                    }
+                    recycleBuffer(bid);
+                }
+                if (!more && op.live && !isRemoved(op.fd)) {
+                    if (cqe.res > 0 || cqe.res == -ENOBUFS) {
+                        // The multishot receive ended early; start another one
+                        armReceive(op.fd);
+                    } else if (cqe.res != -ECANCELED) {
+                        loop.onData(op.fd, NULL, 0);
+                    }
+                }
+                break;
+            }
+            case Op::ACCEPT:
+                ops.erase(it);
+                if (op.live) {
+                    if (cqe.res >= 0) {
+                        armAccept(op.fd);
+                        loop.onAccept(op.fd, cqe.res);
+                    } else if (cqe.res != -ECANCELED) {
+                        loop.onAccept(op.fd, -1);
+                    }
+                } else if (cqe.res >= 0) {
+                    close(cqe.res);
+                }
+                break;
+            case Op::SEND:
+                ops.erase(it);
+                if (op.slot >= 0) {
+                    freeSlots.push_back(static_cast<unsigned>(op.slot));
+                }
+                if (op.live) {
+                    loop.onSent(op.fd, cqe.res);
+                }
+                break;
+        }
+    }
+
+    // True once remove() ran for a descriptor during the current dispatch
+    bool isRemoved(int fd) const {
+        return loop.watches.find(fd) == loop.watches.end();
+    }
+
+    EventLoop& loop;
+    int wakeFd;
+    int ringFd;
+
+    // Ring memory
+    void* sqRing;
+    void* cqRing;
+    io_uring_sqe* sqes;
+    size_t sqRingSize, cqRingSize, sqesSize;
+
+    // Ring pointers
+    unsigned *sqHead, *sqTail, *sqArray, *cqHead, *cqTail;
+    unsigned sqMask, sqEntries, cqMask;
+    struct io_uring_cqe* cqes;
+    unsigned sqeTail;
+
+    // Buffer pools
+    std::vector<char> recvPool;
+    std::vector<char> sendPool;
+    std::vector<unsigned> freeSlots;
+
+    // Operations in flight
+    std::map<uint64_t, Op> ops;
+    uint64_t nextOpId;
+    uint64_t wakeValue;
+};
+
+/**
+ * epoll engine for kernels without the required io_uring features.
+ */
+class EpollEngine : public EventLoop::Engine {
+public:
+    EpollEngine(EventLoop& loop, int wakeFd) : loop(loop), wakeFd(wakeFd), epfd(-1) {
+    }
+
+    ~EpollEngine() {
+        if (epfd >= 0) {
+            close(epfd);
+        }
+    }
+
+    bool init() {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) {
+            return false;
+        }
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = wakeFd;
+        return epoll_ctl(epfd, EPOLL_CTL_ADD, wakeFd, &ev) == 0;
+    }
+
+    void receive(int fd) override {
+        states[fd].reading = true;
+        update(fd);
+    }
+
+    void accept(int fd) override {
+        states[fd].accepting = true;
+        update(fd);
+    }
+
+    void send(int fd, const char* data, size_t length) override {
+        // Try right away; only wait for EPOLLOUT if the socket buffer is full
+        ssize_t sent = ::send(fd, data, length, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            State& state = states[fd];
+            state.out = data;
+            state.outLength = length;
+            update(fd);
+            return;
+        }
+
+        // Report from wait() so handlers never run inside send()
+        completed.push_back(std::make_pair(fd, sent < 0 ? -static_cast<long>(errno) : static_cast<long>(sent)));
+    }
+
+    void remove(int fd) override {
+        std::map<int, State>::iterator it = states.find(fd);
+        if (it != states.end()) {
+            if (it->second.events != 0) {
+                epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+            }
+            states.erase(it);
+        }
+        for (size_t i = 0; i < completed.size(); i++) {
+            if (completed[i].first == fd) {
+                completed[i].first = -1;
+            }
+        }
+    }
+
+    void wait(int timeoutMs) override {
+        std::vector<std::pair<int, long> > done;
+        done.swap(completed);
+        for (size_t i = 0; i < done.size(); i++) {
+            if (done[i].first >= 0) {
+                loop.onSent(done[i].first, done[i].second);
+            }
+        }
+        if (!done.empty() || !completed.empty()) {
+            timeoutMs = 0;
+        }
+
+        struct epoll_event events[64];
+        int count = epoll_wait(epfd, events, 64, timeoutMs);
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd) {
+                uint64_t value;
+                if (read(wakeFd, &value, sizeof(value)) < 0) {
+                    // Nothing to do; the counter was already drained
+                }
+                loop.onWake();
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                writeReady(fd);
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                readReady(fd);
+            }
+        }
+    }
+
+private:
+    struct State {
+        bool reading = false;
+        bool accepting = false;
+        const char* out = NULL;
+        size_t outLength = 0;
+        uint32_t events = 0;
+    };
+
+    // Bring the epoll registration in line with what the descriptor waits for
+    void update(int fd) {
+        State& state = states[fd];
+        uint32_t events = 0;
+        if (state.reading || state.accepting) {
+            events |= EPOLLIN;
+        }
+        if (state.out != NULL) {
+            events |= EPOLLOUT;
+        }
+        if (events == state.events) {
+            return;
+        }
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.fd = fd;
+        if (state.events == 0) {
+            setBlocking(fd, false);
+            epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        } else if (events == 0) {
+            epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+        } else {
+            epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+        }
+        state.events = events;
+    }
+
+    void writeReady(int fd) {
+        std::map<int, State>::iterator it = states.find(fd);
+        if (it == states.end() || it->second.out == NULL) {
+            return;
+        }
+        ssize_t sent = ::send(fd, it->second.out, it->second.outLength, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        it->second.out = NULL;
+        update(fd);
+        loop.onSent(fd, sent < 0 ? -static_cast<long>(errno) : static_cast<long>(sent));
+    }
+
+    void readReady(int fd) {
+        std::map<int, State>::iterator it = states.find(fd);
+        if (it == states.end()) {
+            return;
+        }
+
+        if (it->second.accepting) {
+            // Take every pending connection
+            while (states.count(fd)) {
+                int client = ::accept(fd, NULL, NULL);
+                if (client < 0) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                        loop.onAccept(fd, -1);
+                    }
+                    return;
+                }
+                loop.onAccept(fd, client);
+            }
+            return;
+        }
+
+        // Drain the socket, stopping if a handler removes the descriptor
+        char buffer[4096];
+        while (states.count(fd)) {
+            ssize_t received = read(fd, buffer, sizeof(buffer));
+            if (received > 0) {
+                loop.onData(fd, buffer, received);
+                continue;
+            }
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                return;
+            }
+
+            // Closed by the peer or failed
+            std::map<int, State>::iterator current = states.find(fd);
+            if (current != states.end()) {
+                current->second.reading = false;
+                update(fd);
+            }
+            loop.onData(fd, NULL, 0);
+            return;
+        }
+    }
+
+    EventLoop& loop;
+    int wakeFd;
+    int epfd;
+    std::map<int, State> states;
+    std::vector<std::pair<int, long> > completed;
+};
+
+EventLoop::EventLoop(Backend preferred)
+    : backend(Backend::EPOLL), wakeFd(-1), nextTimerId(1), stopRequested(false) {
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+
+    if (preferred == Backend::IO_URING) {
+        UringEngine* uring = new UringEngine(*this, wakeFd);
+        if (uring->init()) {
+            engine.reset(uring);
+            backend = Backend::IO_URING;
+        } else {
+            delete uring;
+            std::cout << "io_uring not available, falling back to epoll" << std::endl;
+        }
+    }
+
+    if (!engine) {
+        EpollEngine* epoll = new EpollEngine(*this, wakeFd);
+        if (!epoll->init()) {
+            std::cerr << "Failed to initialize epoll" << std::endl;
+        }
+        engine.reset(epoll);
+    }
+}
+
+EventLoop::~EventLoop() {
+    engine.reset();
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
+}
+
+EventLoop::Backend EventLoop::getBackend() const {
+    return backend;
+}
+
+void EventLoop::receive(int fd, const DataHandler& handler) {
+    watches[fd].onData = handler;
+    engine->receive(fd);
+}
+
+void EventLoop::accept(int fd, const AcceptHandler& handler) {
+    watches[fd].onAccept = handler;
+    engine->accept(fd);
+}
+
+void EventLoop::send(int fd, const std::string& data, const SendHandler& handler) {
+    Outgoing outgoing;
+    outgoing.data = data;
+    outgoing.offset = 0;
+    outgoing.handler = handler;
+
+    Watch& watch = watches[fd];
+    watch.sendQueue.push_back(outgoing);
+    if (!watch.sending) {
+        startSend(fd);
+    }
+}
+
+std::vector<EventLoop::SendHandler> EventLoop::remove(int fd) {
+    std::vector<SendHandler> unsent;
+    std::map<int, Watch>::iterator it = watches.find(fd);
+    if (it != watches.end()) {
+        for (size_t i = 0; i < it->second.sendQueue.size(); i++) {
+            if (it->second.sendQueue[i].handler) {
+                unsent.push_back(it->second.sendQueue[i].handler);
+            }
+        }
+        watches.erase(it);
+    }
+    engine->remove(fd);
+    return unsent;
+}
+
+void EventLoop::startSend(int fd) {
+    std::map<int, Watch>::iterator it = watches.find(fd);
+    if (it == watches.end() || it->second.sendQueue.empty()) {
+        if (it != watches.end()) {
+            it->second.sending = false;
+        }
+        return;
+    }
+
+    // Keep one send per descriptor in flight so the byte stream stays in order
+    it->second.sending = true;
+    Outgoing& next = it->second.sendQueue.front();
+    engine->send(fd, next.data.data() + next.offset, next.data.size() - next.offset);
+}
+
+void EventLoop::onSent(int fd, long result) {
+    std::map<int, Watch>::iterator it = watches.find(fd);
+    if (it == watches.end() || it->second.sendQueue.empty()) {
+        return;
+    }
+
+    Outgoing& current = it->second.sendQueue.front();
+    if (result <= 0) {
+        // The connection is broken; fail everything that is queued
+        std::deque<Outgoing> failed;
+        failed.swap(it->second.sendQueue);
+        it->second.sending = false;
+        for (size_t i = 0; i < failed.size(); i++) {
+            if (failed[i].handler) {
+                failed[i].handler(false);
+            }
+        }
+        return;
+    }
+
+    current.offset += static_cast<size_t>(result);
+    if (current.offset < current.data.size()) {
+        // Partial send; continue with the rest
+        startSend(fd);
+        return;
+    }
+
+    SendHandler handler = current.handler;
+    it->second.sendQueue.pop_front();
+    startSend(fd);
+    if (handler) {
+        handler(true);
+    }
+}
+
+void EventLoop::onData(int fd, const char* data, size_t length) {
+    std::map<int, Watch>::iterator it = watches.find(fd);
+    if (it != watches.end() && it->second.onData) {
+        // Copy the handler; it may remove the descriptor while running
+        DataHandler handler = it->second.onData;
+        handler(data, length);
+    }
+}
+
+void EventLoop::onAccept(int fd, int client) {
+    std::map<int, Watch>::iterator it = watches.find(fd);
+    if (it != watches.end() && it->second.onAccept) {
+        AcceptHandler handler = it->second.onAccept;
+        handler(client);
+    } else if (client >= 0) {
+        close(client);
+    }
+}
+
+void EventLoop::onWake() {
+    // Posted tasks run from runPending()
+}
+
+EventLoop::TimerId EventLoop::runAfter(int delayMs, const Task& task) {
+    TimerId id = nextTimerId++;
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(delayMs);
+    timers[std::make_pair(deadline, id)] = task;
+    timerDeadlines[id] = deadline;
+    return id;
+}
+
+void EventLoop::cancelTimer(TimerId id) {
+    std::map<TimerId, Clock::time_point>::iterator it = timerDeadlines.find(id);
+    if (it != timerDeadlines.end()) {
+        timers.erase(std::make_pair(it->second, id));
+        timerDeadlines.erase(it);
+    }
+}
+
+void EventLoop::post(const Task& task) {
+    {
+        std::lock_guard<std::mutex> lock(postMutex);
+        posted.push_back(task);
+    }
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        std::cerr << "Failed to wake event loop" << std::endl;
+    }
+}
+
+void EventLoop::stop() {
+    {
+        std::lock_guard<std::mutex> lock(postMutex);
+        stopRequested = true;
+    }
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        std::cerr << "Failed to wake event loop" << std::endl;
+    }
+}
+
+int EventLoop::runPending() {
+    // Tasks posted from other threads
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(postMutex);
+        tasks.swap(posted);
+    }
+    for (size_t i = 0; i < tasks.size(); i++) {
+        tasks[i]();
+    }
+
+    // Timers that are due
+    while (!timers.empty() && timers.begin()->first.first <= Clock::now()) {
+        Task task = timers.begin()->second;
+        timerDeadlines.erase(timers.begin()->first.second);
+        timers.erase(timers.begin());
+        task();
+    }
+
+    if (timers.empty()) {
+        return -1;
+    }
+
+    // Round up so the timer is due when the wait ends
+    Clock::duration left = timers.begin()->first.first - Clock::now();
+    long ms = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(left).count()) + 1;
+    return ms > 0 ? static_cast<int>(ms) : 0;
+}
+
+void EventLoop::run() {
+    while (true) {
+        int timeoutMs = runPending();
+        {
+            std::lock_guard<std::mutex> lock(postMutex);
+            if (stopRequested) {
+                stopRequested = false;
+                break;
+            }
+            if (!posted.empty()) {
+                timeoutMs = 0;
+            }
+        }
+        engine->wait(timeoutMs);
+    }
+}
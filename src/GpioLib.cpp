@@ -0,0 +1,197 @@
+#include "../include/GpioLib.h"
+#include <wiringPi.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+namespace {
+    // Shared context; it closes when its last user is gone
+    std::mutex chipMutex;
+    std::weak_ptr<GpioChip> sharedChip;
+
+    // Bit mask covering the first count pins
+    uint64_t maskOf(size_t count) {
+        return count >= 64 ? ~0ULL : (1ULL << count) - 1;
+    }
+}
+
+std::shared_ptr<GpioChip> GpioChip::get() {
+    std::lock_guard<std::mutex> lock(chipMutex);
+    std::shared_ptr<GpioChip> chip = sharedChip.lock();
+    if (chip) {
+        return chip;
+    }
+
+    int fd = open("/dev/gpiochip0", O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        // Older kernels: drive the pins through wiringPi, set up only once
+        static bool wiringPiReady = (wiringPiSetupGpio() != -1);
+        if (!wiringPiReady) {
+            std::cerr << "Failed to initialize GPIO access" << std::endl;
+            return nullptr;
+        }
+    }
+
+    chip.reset(new GpioChip(fd));
+    sharedChip = chip;
+    return chip;
+}
+
+GpioChip::GpioChip(int fd) : fd(fd) {
+}
+
+GpioChip::~GpioChip() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool GpioChip::isCharacterDevice() const {
+    return fd >= 0;
+}
+
+GpioLines::GpioLines() : fd(-1) {
+}
+
+GpioLines::~GpioLines() {
+    release();
+}
+
+bool GpioLines::request(const std::vector<int>& requested, Direction direction, Bias bias, uint64_t values) {
+    release();
+    if (requested.empty() || requested.size() > GPIO_V2_LINES_MAX) {
+        return false;
+    }
+
+    std::shared_ptr<GpioChip> context = GpioChip::get();
+    if (!context) {
+        return false;
+    }
+
+    if (!context->isCharacterDevice()) {
+        for (size_t i = 0; i < requested.size(); i++) {
+            if (direction == Direction::OUT) {
+                pinMode(requested[i], OUTPUT);
+                digitalWrite(requested[i], (values >> i) & 1 ? HIGH : LOW);
+            } else {
+                pinMode(requested[i], INPUT);
+                pullUpDnControl(requested[i], bias == Bias::PULL_UP ? PUD_UP
+                                              : bias == Bias::PULL_DOWN ? PUD_DOWN : PUD_OFF);
+            }
+        }
+        chip = context;
+        pins = requested;
+        return true;
+    }
+
+    struct gpio_v2_line_request request;
+    memset(&request, 0, sizeof(request));
+    for (size_t i = 0; i < requested.size(); i++) {
+        request.offsets[i] = static_cast<uint32_t>(requested[i]);
+    }
+    strncpy(request.consumer, "rcs", sizeof(request.consumer) - 1);
+    request.num_lines = static_cast<uint32_t>(requested.size());
+
+    if (direction == Direction::OUT) {
+        // Outputs start at their initial levels instead of glitching through a default
+        request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+        request.config.num_attrs = 1;
+        request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+        request.config.attrs[0].attr.values = values & maskOf(requested.size());
+        request.config.attrs[0].mask = maskOf(requested.size());
+    } else {
+        request.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+        if (bias == Bias::PULL_UP) {
+            request.config.flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_UP;
+        } else if (bias == Bias::PULL_DOWN) {
+            request.config.flags |= GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN;
+        }
+    }
+
+    if (ioctl(context->fd, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+        std::cerr << "Failed to request GPIO lines" << std::endl;
+        return false;
+    }
+
+    chip = context;
+    pins = requested;
+    fd = request.fd;
+    return true;
+}
+
+bool GpioLines::read(uint64_t& values) {
+    if (!chip) {
+        return false;
+    }
+
+    if (fd < 0) {
+        values = 0;
+        for (size_t i = 0; i < pins.size(); i++) {
+            if (digitalRead(pins[i]) == HIGH) {
+                values |= 1ULL << i;
+            }
+        }
+        return true;
+    }
+
+    struct gpio_v2_line_values request;
+    request.bits = 0;
+    request.mask = maskOf(pins.size());
+    if (ioctl(fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &request) < 0) {
+        return false;
+    }
+    values = request.bits;
+    return true;
+}
+
+bool GpioLines::write(uint64_t values, uint64_t mask) {
+    if (!chip) {
+        return false;
+    }
+
+    mask &= maskOf(pins.size());
+    if (fd < 0) {
+        for (size_t i = 0; i < pins.size(); i++) {
+            if ((mask >> i) & 1) {
+                digitalWrite(pins[i], (values >> i) & 1 ? HIGH : LOW);
+            }
+        }
+        return true;
+    }
+
+    struct gpio_v2_line_values request;
+    request.bits = values & mask;
+    request.mask = mask;
+    return ioctl(fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &request) == 0;
+}
+
+void GpioLines::release() {
+    if (!chip) {
+        return;
+    }
+
+    if (fd >= 0) {
+        // Leave the pins as inputs; a released line otherwise keeps driving its last level
+        struct gpio_v2_line_config config;
+        memset(&config, 0, sizeof(config));
+        config.flags = GPIO_V2_LINE_FLAG_INPUT;
+        ioctl(fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config);
+        close(fd);
+        fd = -1;
+    } else {
+        for (size_t i = 0; i < pins.size(); i++) {
+            pinMode(pins[i], INPUT);
+        }
+    }
+
+    pins.clear();
+    chip.reset();
+}
+
+size_t GpioLines::size() const {
+    return pins.size();
+}
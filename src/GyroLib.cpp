@@ -1,88 +1,153 @@
 #include "../include/GyroLib.h"
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/ioctl.h>
-#include <linux/i2c-dev.h>
+#include "../include/RtLib.h"
 #include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <map>
+#include <algorithm>
 
-Gyro::Gyro() : i2c_fd(-1) {
-    // Initialize with an invalid file descriptor
+namespace {
+    // Low-pass filter bandwidths in Hz by DLPF_CFG value 1 to 6, for the gyroscope and the accelerometer
+    const double GYRO_BANDWIDTHS[] = { 184, 92, 41, 20, 10, 5 };
+    const double ACCEL_BANDWIDTHS[] = { 218.1, 99, 44.8, 21.2, 10.2, 5.05 };
+    const int BANDWIDTHS = 6;
+
+    // Widest filter below the Nyquist frequency of a rate; the narrowest one if none is
+    uint8_t filterFor(const double bandwidths[], double rateHz) {
+        for (int i = 0; i < BANDWIDTHS; i++) {
+            if (bandwidths[i] < rateHz / 2) {
+                return static_cast<uint8_t>(i + 1);
+            }
+        }
+        return BANDWIDTHS;
+    }
+
+    // Cycle mode wake-up rates in Hz by LP_ACCEL_ODR value 0 to 11
+    const double WAKE_RATES[] = { 0.24, 0.49, 0.98, 1.95, 3.91, 7.81, 15.63, 31.25, 62.5, 125, 250, 500 };
+    const int WAKE_RATE_COUNT = 12;
+}
+
+const int Gyro::MIN_RATE_HZ;
+const int Gyro::MAX_RATE_HZ;
+const int Gyro::WAKE_UP_MS;
+
+Gyro::Gyro(int bus, int address)
+    : busNumber(bus), address(static_cast<uint8_t>(address)), rateHz(0), standby(0) {
+    // The bus is opened by init()
 }
 
 Gyro::~Gyro() {
-    // Close the I2C device if it's open
-    if (i2c_fd >= 0) {
-        close(i2c_fd);
-    }
+    // The bus closes once no sensor uses it any more
 }
 
 void Gyro::init() {
-    // Open the I2C device
-    i2c_fd = open("/dev/i2c-1", O_RDWR);
-    if (i2c_fd < 0) {
-        std::cerr << "Failed to open I2C device" << std::endl;
-        return;
-    }
-
-    // Set the I2C slave address
-    if (ioctl(i2c_fd, I2C_SLAVE, MPU9250_ADDRESS) < 0) {
-        std::cerr << "Failed to set I2C slave address" << std::endl;
-        close(i2c_fd);
-        i2c_fd = -1;
+    // Open the I2C bus, or share it with sensors already on it
+    std::shared_ptr<I2cBus> shared = I2cBus::get(busNumber);
+    if (!shared) {
         return;
     }
 
     // Wake up the MPU9250 (Power management register)
-    uint8_t data[2] = {0x6B, 0x00};
-    if (write(i2c_fd, data, 2) != 2) {
-        std::cerr << "Failed to wake up the MPU9250" << std::endl;
-        close(i2c_fd);
-        i2c_fd = -1;
+    if (!shared->writeRegister(address, 0x6B, 0x00)) {
+        std::cerr << "Failed to wake up the MPU9250 at " << busNumber << ":0x" << std::hex
+                  << static_cast<int>(address) << std::dec << std::endl;
         return;
     }
 
     // Configure gyroscope range (± 250 degrees/s)
-    data[0] = 0x1B;
-    data[1] = 0x00;
-    if (write(i2c_fd, data, 2) != 2) {
+    if (!shared->writeRegister(address, 0x1B, 0x00)) {
         std::cerr << "Failed to configure gyroscope range" << std::endl;
-        close(i2c_fd);
-        i2c_fd = -1;
         return;
     }
 
     // Configure accelerometer range (± 2g)
-    data[0] = 0x1C;
-    data[1] = 0x00;
-    if (write(i2c_fd, data, 2) != 2) {
+    if (!shared->writeRegister(address, 0x1C, 0x00)) {
         std::cerr << "Failed to configure accelerometer range" << std::endl;
-        close(i2c_fd);
-        i2c_fd = -1;
         return;
     }
 
-    std::cout << "MPU9250 initialized successfully" << std::endl;
+    bus = shared;
+    if (!setSampleRate(DEFAULT_RATE_HZ)) {
+        std::cerr << "Failed to configure the sample rate" << std::endl;
+        bus.reset();
+        return;
+    }
+    std::cout << "MPU9250 initialized successfully at " << busNumber << ":0x" << std::hex
+              << static_cast<int>(address) << std::dec << std::endl;
+}
+
+bool Gyro::setSampleRate(int hz) {
+    if (!bus) {
+        return false;
+    }
+
+    // The filters only take effect, and the divider only applies, with DLPF_CFG 1 to 6
+    int divider = MAX_RATE_HZ / std::min(std::max(hz, MIN_RATE_HZ), MAX_RATE_HZ) - 1;
+    int rate = MAX_RATE_HZ / (divider + 1);
+    if (!bus->writeRegister(address, SMPLRT_DIV, static_cast<uint8_t>(divider)) ||
+        !bus->writeRegister(address, CONFIG, filterFor(GYRO_BANDWIDTHS, rate)) ||
+        !bus->writeRegister(address, ACCEL_CONFIG2, filterFor(ACCEL_BANDWIDTHS, rate))) {
+        return false;
+    }
+
+    // Leave cycle mode and turn the axes back on
+    if (rateHz == 0 && (!bus->writeRegister(address, PWR_MGMT_1, 0x00) ||
+                        !bus->writeRegister(address, PWR_MGMT_2, standby))) {
+        return false;
+    }
+    rateHz = rate;
+    return true;
+}
+
+bool Gyro::setStandby(uint8_t axes) {
+    if (!bus) {
+        return false;
+    }
+
+    // In low-power mode the gyroscope stays off; the axes take effect when it is left
+    if (rateHz != 0 && !bus->writeRegister(address, PWR_MGMT_2, axes)) {
+        return false;
+    }
+    standby = axes;
+    return true;
+}
+
+bool Gyro::setLowPower(int wakeHz) {
+    if (!bus) {
+        return false;
+    }
+
+    int odr = 0;
+    while (odr < WAKE_RATE_COUNT - 1 && WAKE_RATES[odr] < wakeHz) {
+        odr++;
+    }
+
+    // The sequence of the MPU9250 datasheet: gyroscope off, accelerometer filter bypassed, then cycle
+    if (!bus->writeRegister(address, PWR_MGMT_1, 0x00) ||
+        !bus->writeRegister(address, PWR_MGMT_2, static_cast<uint8_t>(standby | STANDBY_GYRO)) ||
+        !bus->writeRegister(address, ACCEL_CONFIG2, static_cast<uint8_t>(ACCEL_FCHOICE_B | 1)) ||
+        !bus->writeRegister(address, LP_ACCEL_ODR, static_cast<uint8_t>(odr)) ||
+        !bus->writeRegister(address, PWR_MGMT_1, CYCLE)) {
+        return false;
+    }
+    rateHz = 0;
+    return true;
+}
+
+int Gyro::getSampleRate() const {
+    return rateHz;
 }
 
 int16_t Gyro::readRawValue(int reg_addr) {
     // Check if the device is initialized
-    if (i2c_fd < 0) {
+    if (!bus) {
         std::cerr << "I2C device not initialized" << std::endl;
         return 0;
     }
 
-    // Set the register address
-    uint8_t reg = static_cast<uint8_t>(reg_addr);
-    if (write(i2c_fd, &reg, 1) != 1) {
-        std::cerr << "Failed to set register address" << std::endl;
-        return 0;
-    }
-
-    // Read 2 bytes (16-bit value)
+    // Select the register and read 2 bytes (16-bit value) in one transaction
     uint8_t data[2];
-    if (read(i2c_fd, data, 2) != 2) {
+    if (!bus->readRegisters(address, static_cast<uint8_t>(reg_addr), data, sizeof(data))) {
         std::cerr << "Failed to read register data" << std::endl;
         return 0;
     }
@@ -91,6 +156,92 @@ int16_t Gyro::readRawValue(int reg_addr) {
     return (data[0] << 8) | data[1];
 }
 
+bool Gyro::readSample(ImuSample& sample) {
+    // Check if the device is initialized
+    if (!bus) {
+        return false;
+    }
+
+    // Read accel (6 bytes), temperature (2 bytes) and gyro (6 bytes) in one go
+    uint8_t data[14];
+    if (!bus->readRegisters(address, ACCEL_XOUT_H, data, sizeof(data))) {
+        std::cerr << "Failed to read sample data" << std::endl;
+        return false;
+    }
+
+    decode(data, sample);
+    sample.timestampNs = Rt::monotonicNs();
+    return true;
+}
+
+size_t Gyro::readSamples(const std::vector<Gyro*>& gyros, std::vector<ImuSample>& samples,
+                         std::vector<bool>& valid) {
+    samples.resize(gyros.size());
+    valid.assign(gyros.size(), false);
+
+    // One batch per bus; buffers[14 * i] receives the output block of gyros[i]
+    std::vector<uint8_t> buffers(14 * gyros.size());
+    std::map<I2cBus*, std::vector<size_t> > byBus;
+    for (size_t i = 0; i < gyros.size(); i++) {
+        if (gyros[i]->bus) {
+            byBus[gyros[i]->bus.get()].push_back(i);
+        }
+    }
+
+    size_t succeeded = 0;
+    std::map<I2cBus*, std::vector<size_t> >::iterator it;
+    for (it = byBus.begin(); it != byBus.end(); ++it) {
+        const std::vector<size_t>& indices = it->second;
+        std::vector<I2cBus::Read> reads(indices.size());
+        for (size_t n = 0; n < indices.size(); n++) {
+            reads[n].address = gyros[indices[n]]->address;
+            reads[n].reg = ACCEL_XOUT_H;
+            reads[n].data = &buffers[14 * indices[n]];
+            reads[n].length = 14;
+            reads[n].ok = false;
+        }
+
+        it->first->readBatch(reads);
+        uint64_t readNs = Rt::monotonicNs();
+        for (size_t n = 0; n < indices.size(); n++) {
+            if (reads[n].ok) {
+                decode(reads[n].data, samples[indices[n]]);
+                samples[indices[n]].timestampNs = readNs;
+                valid[indices[n]] = true;
+                succeeded++;
+            }
+        }
+    }
+    return succeeded;
+}
+
+int Gyro::getBus() const {
+    return busNumber;
+}
+
+int Gyro::getAddress() const {
+    return address;
+}
+
+void Gyro::decode(const uint8_t data[14], ImuSample& sample) {
+    int16_t raw[IMU_RAW_VALUES];
+    for (int i = 0; i < IMU_RAW_VALUES; i++) {
+        raw[i] = static_cast<int16_t>((data[2 * i] << 8) | data[2 * i + 1]);
+    }
+    convert(raw, sample);
+}
+
+void Gyro::convert(const int16_t raw[IMU_RAW_VALUES], ImuSample& sample) {
+    std::memcpy(sample.raw, raw, sizeof(sample.raw));
+    sample.accX = raw[0] / ACCEL_SCALE * 9.81;
+    sample.accY = raw[1] / ACCEL_SCALE * 9.81;
+    sample.accZ = raw[2] / ACCEL_SCALE * 9.81;
+    sample.temp = raw[3] / 333.87 + 21.0;
+    sample.gyroX = raw[4] / GYRO_SCALE;
+    sample.gyroY = raw[5] / GYRO_SCALE;
+    sample.gyroZ = raw[6] / GYRO_SCALE;
+}
+
 double Gyro::getGyroX() {
     return readRawValue(GYRO_XOUT_H) / GYRO_SCALE;
 }
@@ -0,0 +1,122 @@
+#include "../include/I2cBusLib.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <cerrno>
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include <string>
+
+namespace {
+    // Each read takes two messages: the register select and the read itself
+    const size_t READS_PER_TRANSFER = I2C_RDWR_IOCTL_MAX_MSGS / 2;
+
+    // Buses opened so far; a bus closes when its last device is gone
+    std::mutex busesMutex;
+    std::map<int, std::weak_ptr<I2cBus> > buses;
+}
+
+std::shared_ptr<I2cBus> I2cBus::get(int number) {
+    std::lock_guard<std::mutex> lock(busesMutex);
+    std::shared_ptr<I2cBus> bus = buses[number].lock();
+    if (bus) {
+        return bus;
+    }
+
+    std::string path = "/dev/i2c-" + std::to_string(number);
+    int fd = open(path.c_str(), O_RDWR);
+    if (fd < 0) {
+        std::cerr << "Failed to open I2C device " << path << std::endl;
+        return nullptr;
+    }
+
+    bus.reset(new I2cBus(number, fd));
+    buses[number] = bus;
+    return bus;
+}
+
+I2cBus::I2cBus(int number, int fd) : number(number), fd(fd) {
+}
+
+I2cBus::~I2cBus() {
+    close(fd);
+}
+
+int I2cBus::getNumber() const {
+    return number;
+}
+
+bool I2cBus::writeRegister(uint8_t address, uint8_t reg, uint8_t value) {
+    uint8_t buffer[2] = { reg, value };
+    struct i2c_msg message;
+    message.addr = address;
+    message.flags = 0;
+    message.len = sizeof(buffer);
+    message.buf = buffer;
+
+    struct i2c_rdwr_ioctl_data transaction = { &message, 1 };
+    std::lock_guard<std::mutex> lock(mutex);
+    return ioctl(fd, I2C_RDWR, &transaction) == 1;
+}
+
+bool I2cBus::readRegisters(uint8_t address, uint8_t reg, uint8_t* data, uint16_t length) {
+    std::vector<Read> reads(1);
+    reads[0].address = address;
+    reads[0].reg = reg;
+    reads[0].data = data;
+    reads[0].length = length;
+    return readBatch(reads) == 1;
+}
+
+size_t I2cBus::readBatch(std::vector<Read>& reads) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t succeeded = 0;
+    for (size_t first = 0; first < reads.size(); first += READS_PER_TRANSFER) {
+        size_t count = std::min(READS_PER_TRANSFER, reads.size() - first);
+        if (transfer(reads, first, count)) {
+            succeeded += count;
+            continue;
+        }
+
+        // The kernel aborts the whole call at the first NACK; find out which reads can still succeed
+        for (size_t i = first; i < first + count; i++) {
+            if (count > 1 && transfer(reads, i, 1)) {
+                succeeded++;
+            }
+        }
+    }
+    return succeeded;
+}
+
+bool I2cBus::transfer(std::vector<Read>& reads, size_t first, size_t count) {
+    struct i2c_msg messages[I2C_RDWR_IOCTL_MAX_MSGS];
+    for (size_t i = 0; i < count; i++) {
+        Read& read = reads[first + i];
+
+        // Register select, then a repeated start into the read
+        messages[2 * i].addr = read.address;
+        messages[2 * i].flags = 0;
+        messages[2 * i].len = 1;
+        messages[2 * i].buf = &read.reg;
+
+        messages[2 * i + 1].addr = read.address;
+        messages[2 * i + 1].flags = I2C_M_RD;
+        messages[2 * i + 1].len = read.length;
+        messages[2 * i + 1].buf = read.data;
+    }
+
+    struct i2c_rdwr_ioctl_data transaction = { messages, static_cast<uint32_t>(2 * count) };
+    int result;
+    do {
+        result = ioctl(fd, I2C_RDWR, &transaction);
+    } while (result < 0 && errno == EINTR);
+
+    bool ok = (result == static_cast<int>(2 * count));
+    for (size_t i = 0; i < count; i++) {
+        reads[first + i].ok = ok;
+    }
+    return ok;
+}
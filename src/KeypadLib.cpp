@@ -1,12 +1,17 @@
 #include "../include/KeypadLib.h"
-#include <wiringPi.h>
 #include <iostream>
 #include <unistd.h>
+#include <thread>
+#include <chrono>
 
 // Define the static member variables
 const std::vector<int> Keypad::ROW_PINS = {16, 20, 21, 12};
 const std::vector<int> Keypad::COL_PINS = {6, 13, 19, 26};
 
+// Masks covering every row and every column
+const uint64_t Keypad::ALL_ROWS = (1ULL << 4) - 1;
+const uint64_t Keypad::ALL_COLS = (1ULL << 4) - 1;
+
 // Define the keypad layout
 const char Keypad::KEY_MAP[4][4] = {
     {'1', '2', '3', 'A'},
@@ -15,7 +20,7 @@ const char Keypad::KEY_MAP[4][4] = {
     {'*', '0', '#', 'D'}
 };
 
-Keypad::Keypad() : initialized(false), keyBuffer("") {
+Keypad::Keypad() : keyBuffer(""), initialized(false) {
     // Constructor implementation
 }
 
@@ -27,24 +32,14 @@ Keypad::~Keypad() {
 }
 
 void Keypad::init() {
-    // Initialize wiringPi library
-    if (wiringPiSetupGpio() == -1) {
-        std::cerr << "Failed to initialize wiringPi" << std::endl;
+    // Rows are outputs resting low; columns are inputs with pull-up resistors
+    if (!rows.request(ROW_PINS, GpioLines::Direction::OUT, GpioLines::Bias::NONE, 0) ||
+        !cols.request(COL_PINS, GpioLines::Direction::IN, GpioLines::Bias::PULL_UP)) {
+        std::cerr << "Failed to initialize keypad GPIO" << std::endl;
+        rows.release();
         return;
     }
     
-    // Configure row pins as output
-    for (int pin : ROW_PINS) {
-        pinMode(pin, OUTPUT);
-        digitalWrite(pin, HIGH); // Set to HIGH by default
-    }
-    
-    // Configure column pins as input with pull-up resistors
-    for (int pin : COL_PINS) {
-        pinMode(pin, INPUT);
-        pullUpDnControl(pin, PUD_UP); // Enable pull-up resistors
-    }
-    
     initialized = true;
     keyBuffer.clear();
     std::cout << "Keypad initialized successfully" << std::endl;
@@ -56,23 +51,16 @@ void Keypad::release() {
     }
     
     // Reset all pins to input mode (safe state)
-    for (int pin : ROW_PINS) {
-        pinMode(pin, INPUT);
-    }
-    
-    for (int pin : COL_PINS) {
-        pinMode(pin, INPUT);
-    }
+    rows.release();
+    cols.release();
     
     initialized = false;
     keyBuffer.clear();
     std::cout << "Keypad resources released" << std::endl;
 }
 
-void Keypad::setAllRowsHigh() {
-    for (int pin : ROW_PINS) {
-        digitalWrite(pin, HIGH);
-    }
+void Keypad::setAllRowsLow() {
+    rows.write(0, ALL_ROWS);
 }
 
 char Keypad::scanKeypad() {
@@ -81,31 +69,43 @@ char Keypad::scanKeypad() {
         return '\0';
     }
     
-    // Scan the keypad
+    // With every row low, a pressed key pulls its column low
+    uint64_t columns;
+    if (!cols.read(columns) || (columns & ALL_COLS) == ALL_COLS) {
+        // No key pressed
+        return '\0';
+    }
+    
+    // Find the row: drive one row low at a time
     for (size_t r = 0; r < ROW_PINS.size(); r++) {
-        // Set current row LOW
-        setAllRowsHigh();
-        digitalWrite(ROW_PINS[r], LOW);
+        rows.write(~(1ULL << r), ALL_ROWS);
+        if (!cols.read(columns)) {
+            break;
+        }
         
         // Check each column in the current row
         for (size_t c = 0; c < COL_PINS.size(); c++) {
             // If a key is pressed (column reads LOW)
-            if (digitalRead(COL_PINS[c]) == LOW) {
-                // Debounce
-                delay(20);
-                if (digitalRead(COL_PINS[c]) == LOW) {
-                    // Wait until key is released
-                    while (digitalRead(COL_PINS[c]) == LOW) {
-                        usleep(1000); // Sleep for 1ms
-                    }
-                    // Return the key character
-                    return KEY_MAP[r][c];
+            if ((columns >> c) & 1) {
+                continue;
+            }
+            
+            // Debounce
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            if (cols.read(columns) && !((columns >> c) & 1)) {
+                // Wait until key is released
+                while (cols.read(columns) && !((columns >> c) & 1)) {
+                    usleep(1000); // Sleep for 1ms
                 }
+                setAllRowsLow();
+                // Return the key character
+                return KEY_MAP[r][c];
             }
         }
     }
     
-    // No key pressed
+    // Released before it was located
+    setAllRowsLow();
     return '\0';
 }
 
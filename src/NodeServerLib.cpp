@@ -0,0 +1,160 @@
+#include "../include/NodeServerLib.h"
+#include "../include/ProtocolLib.h"
+#include <iostream>
+#include <csignal>
+
+namespace {
+    // Global flag for signal handling
+    volatile sig_atomic_t running = 1;
+
+    // Signal handler for graceful termination
+    void signalHandler(int signum) {
+        std::cout << "Signal " << signum << " received. Terminating..." << std::endl;
+        running = 0;
+    }
+
+    // Wait for a Server Node in slices, so a signal ends the node promptly
+    const int ACCEPT_TIMEOUT_MS = 200;
+}
+
+NodeServer::NodeServer(const std::string& nodeName, int nodePort, NodeService& nodeService)
+    : name(nodeName), port(nodePort), service(nodeService), connection(nullptr) {
+}
+
+void NodeServer::handleSignals() {
+    signal(SIGINT, signalHandler);
+    signal(SIGTERM, signalHandler);
+}
+
+void NodeServer::setWorkers(size_t threads, const DeviceMap& devices) {
+    workers.reset(new WorkerPool(threads));
+    devicesOf = devices;
+}
+
+void NodeServer::setDisconnectHandler(const std::function<void()>& handler) {
+    disconnected = handler;
+}
+
+bool NodeServer::send(const std::string& message) {
+    std::lock_guard<std::mutex> lock(connectionMutex);
+    return connection != nullptr && connection->send(message);
+}
+
+int NodeServer::run() {
+    // The service runs right away; events go to the Server Node once it is connected
+    service.start([this](const std::string& event) { send(event); });
+
+    SocketCon server(SocketCon::Mode::SERVER, "", port);
+
+    std::cout << name << " Node starting..." << std::endl;
+
+    // Start listening; the Server Node may connect now or later
+    if (!server.listen()) {
+        std::cerr << "Failed to initialize " << name << " Node socket server" << std::endl;
+        service.stop();
+        return 1;
+    }
+
+    std::cout << name << " Node started. Listening on port " << port << "..." << std::endl;
+
+    // Serve the Server Node, and wait for it to come back if it disconnects
+    while (running) {
+        std::unique_ptr<SocketCon> accepted = server.accept(ACCEPT_TIMEOUT_MS);
+        if (accepted) {
+            {
+                std::lock_guard<std::mutex> lock(connectionMutex);
+                connection = accepted.get();
+            }
+            serveConnection(*accepted);
+            {
+                std::lock_guard<std::mutex> lock(connectionMutex);
+                connection = nullptr;
+            }
+            if (disconnected) {
+                disconnected();
+            }
+            accepted->release();
+        }
+    }
+
+    // Stop the service and clean up resources
+    workers.reset();
+    service.stop();
+    server.release();
+
+    std::cout << name << " Node terminated" << std::endl;
+
+    return 0;
+}
+
+void NodeServer::execute(bool tagged, uint32_t tag, const std::string& command) {
+    std::string response = service.handle(command);
+    std::cout << "Sending response: " << response << std::endl;
+    send(tagged ? Protocol::makeTagged(tag, response) : response);
+}
+
+void NodeServer::serveConnection(SocketCon& link) {
+    // Streamed replies are sent with flow control, interleaved with the other replies
+    ReplyStreamer streamer([this](const std::string& message) { return send(message); });
+
+    while (running) {
+        // Wait for a command from the server
+        std::string command;
+        if (!link.receive(command)) {
+            // If receive failed, the connection might be closed
+            std::cout << "Server Node disconnected" << std::endl;
+            break;
+        }
+
+        uint32_t tag = 0;
+        std::string body;
+        bool tagged = Protocol::splitTagged(command, tag, body);
+        if (!tagged) {
+            body = command;
+        }
+
+        // Acknowledgements of streamed chunks are frequent, so they are not logged
+        if (tagged && streamer.control(tag, body)) {
+            continue;
+        }
+
+        std::cout << "Received command: " << command << std::endl;
+
+        std::unique_ptr<ReplyStream> stream = service.openStream(body);
+        if (stream && tagged) {
+            streamer.open(tag, std::move(stream));
+            continue;
+        }
+        if (stream) {
+            // Untagged requests get no acknowledgements; the socket's backpressure paces the stream
+            std::string chunk;
+            while (stream->next(chunk) && send(Protocol::makeChunk(chunk))) {
+            }
+            send(stream->end());
+            continue;
+        }
+
+        // With workers, a slow command holds up only commands for the same device
+        if (workers && tagged && body != "close:") {
+            workers->submit(devicesOf(body), [this, tag, body]() {
+                execute(true, tag, body);
+            });
+            continue;
+        }
+
+        // Untagged commands are answered in arrival order, and close: once the commands in flight are done
+        if (workers) {
+            workers->waitIdle();
+        }
+        execute(tagged, tag, body);
+
+        if (service.isClosing()) {
+            running = 0;
+        }
+    }
+
+    // Replies still being worked on belong to this connection
+    if (workers) {
+        workers->waitIdle();
+    }
+}
@@ -0,0 +1,926 @@
+#include "../include/NodeServiceLib.h"
+#include "../include/AttitudeLib.h"
+#include "../include/ProtocolLib.h"
+#include "../include/SampleStreamLib.h"
+#include "../include/CommandTableLib.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+
+namespace {
+    // Rates the sensors are sampled at, from the highest down; each divides the
+    // ones before it, so one sampler tick serves sensors at different rates
+    const int SAMPLE_RATES_HZ[] = { GyroService::MAX_RATE_HZ, 100, 50, 25 };
+    const int SAMPLE_RATES = 4;
+
+    // Accelerometer wake-ups per second of a sensor in low-power mode
+    const int LOW_POWER_WAKE_HZ = 1;
+
+    // Longest a command waits for a sensor to wake up from low power
+    const int WAKE_TIMEOUT_MS = 100;
+
+    // Pause before trying again to change the rate of a sensor that refused
+    const int RATE_RETRY_MS = 1000;
+
+    // Frames per block of the "imu" sample stream at the highest rate (20 blocks per second;
+    // fewer frames per block at lower rates) and frames from one keyframe to the next
+    const size_t STREAM_BLOCK_FRAMES = 10;
+    const uint32_t STREAM_KEYFRAME_INTERVAL = 200;
+
+    // Lowest of SAMPLE_RATES_HZ that satisfies a demand, or 0 for none
+    int sampleRateFor(int demandHz) {
+        if (demandHz <= 0) {
+            return 0;
+        }
+        int rate = SAMPLE_RATES_HZ[0];
+        for (int i = 1; i < SAMPLE_RATES && SAMPLE_RATES_HZ[i] >= demandHz; i++) {
+            rate = SAMPLE_RATES_HZ[i];
+        }
+        return rate;
+    }
+
+    // Interval at which the sensor is checked for edges
+    const int SENSOR_POLL_MS = 10;
+
+    // Interval at which the keypad is scanned
+    const int KEYPAD_POLL_MS = 50;
+}
+
+const size_t GyroService::HISTORY_SAMPLES;
+const int GyroService::MAX_RATE_HZ;
+const int GyroService::POLL_RATE_HZ;
+const int GyroService::POLL_HOLD_MS;
+
+GyroService::Imu::Imu(const ImuConfig& config, uint32_t keyframeInterval)
+    : gyro(config.bus, config.address), encoder(keyframeInterval), history(HISTORY_SAMPLES), recorded(0),
+      demandHz(0), available(false), rateHz(0), blockFrames(STREAM_BLOCK_FRAMES) {
+}
+
+/**
+ * Streams samples [cursor, last) of one sensor's history. Samples the sampler
+ * overwrote before they were sent are skipped and counted as lost.
+ */
+class GyroService::HistoryStream : public ReplyStream {
+public:
+    HistoryStream(GyroService& service, size_t index, uint64_t first, uint64_t end)
+        : service(service), index(index), cursor(first), last(end), sent(0), lost(0) {
+    }
+
+    bool next(std::string& chunk) override {
+        std::ostringstream out;
+        std::string line;
+        std::lock_guard<std::mutex> lock(service.mutex);
+        const Imu& imu = *service.imus[index];
+        if (imu.recorded > HISTORY_SAMPLES && cursor < imu.recorded - HISTORY_SAMPLES) {
+            lost += imu.recorded - HISTORY_SAMPLES - cursor;
+            cursor = imu.recorded - HISTORY_SAMPLES;
+        }
+
+        chunk.clear();
+        while (cursor < last) {
+            const ImuSample& sample = imu.history[cursor % HISTORY_SAMPLES];
+            out.str("");
+            out << cursor << " " << sample.gyroX << " " << sample.gyroY << " " << sample.gyroZ << " "
+                << sample.accX << " " << sample.accY << " " << sample.accZ << " " << sample.temp << " "
+                << sample.timestampNs << "\n";
+            line = out.str();
+            if (chunk.size() + line.size() > Protocol::CHUNK_SIZE) {
+                break;
+            }
+            chunk += line;
+            cursor++;
+            sent++;
+        }
+        return !chunk.empty();
+    }
+
+    std::string end() override {
+        return "history " + std::to_string(sent) + " " + std::to_string(lost) + ":";
+    }
+
+private:
+    GyroService& service;
+    size_t index;
+    uint64_t cursor;
+    uint64_t last;
+    uint64_t sent;
+    uint64_t lost;
+};
+
+GyroService::GyroService(const std::vector<ImuConfig>& configs) : running(false), minRateHz(0), demands(0), periodUs(0) {
+    std::vector<ImuConfig> sensors = configs;
+    if (sensors.empty()) {
+        ImuConfig standard = { Gyro::DEFAULT_BUS, Gyro::DEFAULT_ADDRESS };
+        sensors.push_back(standard);
+    }
+
+    for (size_t i = 0; i < sensors.size(); i++) {
+        imus.push_back(std::unique_ptr<Imu>(new Imu(sensors[i], STREAM_KEYFRAME_INTERVAL)));
+        imus.back()->topic = (i == 0) ? "imu" : "imu" + std::to_string(i);
+    }
+    latest.resize(imus.size(), Reading());
+}
+
+GyroService::~GyroService() {
+    stop();
+}
+
+bool GyroService::parseImu(const std::string& spec, ImuConfig& imu) {
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == spec.size()) {
+        return false;
+    }
+
+    char* end = NULL;
+    long bus = std::strtol(spec.c_str(), &end, 10);
+    if (end != spec.c_str() + colon || bus < 0) {
+        return false;
+    }
+    long address = std::strtol(spec.c_str() + colon + 1, &end, 0);
+    if (*end != '\0' || address < 0x03 || address > 0x77) {
+        return false;
+    }
+
+    imu.bus = static_cast<int>(bus);
+    imu.address = static_cast<int>(address);
+    return true;
+}
+
+void GyroService::start(const EventSink& eventSink) {
+    sink = eventSink;
+    for (size_t i = 0; i < imus.size(); i++) {
+        // init() leaves the sensor running at its default rate; the sampler takes it from there
+        imus[i]->gyro.init();
+        imus[i]->available = imus[i]->gyro.getSampleRate() > 0;
+        imus[i]->rateHz = imus[i]->gyro.getSampleRate();
+        latest[i].rateHz = imus[i]->rateHz;
+    }
+    if (!board.init()) {
+        std::cerr << "Latest values are not published in shared memory" << std::endl;
+    }
+
+    // Sample and estimate the orientations in a separate thread
+    running = true;
+    sampler = std::thread(&GyroService::samplingLoop, this);
+}
+
+void GyroService::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+        demands++;
+    }
+    demandChanged.notify_all();
+    if (sampler.joinable()) {
+        sampler.join();
+    }
+    board.release();
+}
+
+void GyroService::setMinRate(int hz) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        minRateHz = std::max(hz, 0);
+        demands++;
+    }
+    demandChanged.notify_all();
+}
+
+void GyroService::clearDemand() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < imus.size(); i++) {
+            imus[i]->demandHz = 0;
+        }
+        demands++;
+    }
+    demandChanged.notify_all();
+}
+
+bool GyroService::parseHistory(const std::string& command, uint64_t& count, size_t& index) {
+    std::optional<size_t> sensor;
+    if (!parseCommand(command, "history", count, sensor)) {
+        return false;
+    }
+    index = sensor.value_or(0);
+    return true;
+}
+
+std::unique_ptr<ReplyStream> GyroService::openStream(const std::string& command) {
+    // Invalid requests are answered by handle()
+    uint64_t count = 0;
+    size_t index = 0;
+    if (!parseHistory(command, count, index) || index >= imus.size()) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t end = imus[index]->recorded;
+    uint64_t available = std::min<uint64_t>(end, HISTORY_SAMPLES);
+    uint64_t first = end - std::min(count, available);
+    return std::unique_ptr<ReplyStream>(new HistoryStream(*this, index, first, end));
+}
+
+std::string GyroService::handle(const std::string& command) {
+    std::vector<size_t> polled;
+    sensorsRead(command, polled);
+
+    // Work on a copy so the sampler is never held up by formatting
+    std::vector<Reading> readings;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        // Reading a sensor keeps it sampled for a while; one in low power is woken up and read first
+        auto now = std::chrono::steady_clock::now();
+        uint64_t requestNs = Rt::monotonicNs();
+        std::vector<size_t> waking;
+        for (size_t i = 0; i < polled.size(); i++) {
+            if (polled[i] < imus.size()) {
+                imus[polled[i]]->polled = now;
+                if (imus[polled[i]]->available && latest[polled[i]].rateHz == 0) {
+                    waking.push_back(polled[i]);
+                }
+            }
+        }
+        if (!waking.empty()) {
+            demands++;
+            demandChanged.notify_all();
+            sampled.wait_for(lock, std::chrono::milliseconds(WAKE_TIMEOUT_MS), [&]() {
+                for (size_t i = 0; i < waking.size(); i++) {
+                    if (latest[waking[i]].sample.timestampNs < requestNs) {
+                        return !running;
+                    }
+                }
+                return true;
+            });
+        }
+        readings = latest;
+    }
+    return process(command, readings);
+}
+
+bool GyroService::mayBlock(const std::string& command) {
+    std::vector<size_t> polled;
+    sensorsRead(command, polled);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < polled.size(); i++) {
+        if (polled[i] < imus.size() && imus[polled[i]]->available && latest[polled[i]].rateHz == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void GyroService::sensorsRead(const std::string& command, std::vector<size_t>& indices) {
+    if (Protocol::isBatch(command)) {
+        std::vector<std::string> commands = Protocol::splitBatch(command);
+        for (size_t i = 0; i < commands.size(); i++) {
+            sensorsRead(commands[i], indices);
+        }
+        return;
+    }
+    size_t index = 0;
+    if (parseReading(Protocol::unstamped(command), index)) {
+        indices.push_back(index);
+    }
+}
+
+bool GyroService::parseReading(const std::string& command, size_t& index) {
+    std::string_view name = commandName(command);
+    std::optional<size_t> sensor;
+    if ((name != "gyro" && name != "acc" && name != "temp" && name != "attitude") ||
+        !parseCommand(command, name, sensor)) {
+        return false;
+    }
+    index = sensor.value_or(0);
+    return true;
+}
+
+int GyroService::adjustRates(uint64_t& seen, std::chrono::steady_clock::time_point& retry) {
+    auto now = std::chrono::steady_clock::now();
+    retry = std::chrono::steady_clock::time_point::max();
+    std::vector<int> targets(imus.size());
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        seen = demands;
+        for (size_t i = 0; i < imus.size(); i++) {
+            int demand = std::max(imus[i]->demandHz, minRateHz);
+            if (now - imus[i]->polled < std::chrono::milliseconds(POLL_HOLD_MS)) {
+                demand = std::max(demand, POLL_RATE_HZ);
+            }
+            targets[i] = sampleRateFor(demand);
+        }
+    }
+
+    int highest = 0;
+    for (size_t i = 0; i < imus.size(); i++) {
+        Imu& imu = *imus[i];
+        if (!imu.available) {
+            continue;
+        }
+        if (targets[i] != imu.rateHz && now >= imu.retry) {
+            bool ok = targets[i] == 0 ? imu.gyro.setLowPower(LOW_POWER_WAKE_HZ) : imu.gyro.setSampleRate(targets[i]);
+            if (!ok) {
+                // The sensor keeps its old rate, and the sampler and readers keep treating it as such;
+                // the change is tried again after a pause rather than on every tick
+                std::cerr << "Failed to change the rate of IMU " << i << ", retrying in "
+                          << RATE_RETRY_MS << " ms" << std::endl;
+                imu.retry = now + std::chrono::milliseconds(RATE_RETRY_MS);
+            } else {
+                changeRate(i, targets[i], now);
+            }
+        }
+        if (targets[i] != imu.rateHz) {
+            retry = std::min(retry, imu.retry);
+        }
+        highest = std::max(highest, imu.rateHz);
+    }
+    return highest;
+}
+
+void GyroService::changeRate(size_t i, int rateHz, std::chrono::steady_clock::time_point now) {
+    Imu& imu = *imus[i];
+
+    // Subscribers get the frames sampled at the old rate before the first one at the new rate
+    if (imu.encoder.size() > 0 && sink) {
+        sink(Protocol::makeEvent(imu.topic, imu.encoder.flush()));
+    }
+    if (imu.rateHz == 0) {
+        // The gyroscope needs a moment after low power, and the filter must not integrate over the pause
+        imu.settled = now + std::chrono::milliseconds(Gyro::WAKE_UP_MS);
+        imu.last = imu.settled;
+    }
+    std::cout << "IMU " << i << (rateHz == 0 ? " in low power" : " sampled at " +
+                                 std::to_string(rateHz) + " Hz") << std::endl;
+    imu.rateHz = rateHz;
+    imu.blockFrames = std::max<size_t>(1, STREAM_BLOCK_FRAMES * imu.rateHz / MAX_RATE_HZ);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    latest[i].rateHz = imu.rateHz;
+}
+
+void GyroService::samplingLoop() {
+    Rt::configureThread(realtime, "gyro-sampler");
+    PeriodicTimer timer(1000000 / MAX_RATE_HZ, &samplerJitter);
+    for (size_t i = 0; i < imus.size(); i++) {
+        imus[i]->last = std::chrono::steady_clock::now();
+    }
+
+    // The sampler ticks at the highest rate in force; sensors at lower rates are read on every n-th tick
+    int tickHz = 0;
+    uint64_t tick = 0;
+    uint64_t seen = 0;
+    std::vector<Gyro*> gyros;
+    std::vector<size_t> indices;
+    std::vector<ImuSample> samples;
+    std::vector<bool> valid;
+
+    while (running) {
+        // Rates change here, so only this thread configures the sensors
+        std::chrono::steady_clock::time_point retry;
+        int highest = adjustRates(seen, retry);
+        if (highest == 0) {
+            // Nothing to sample; sleep until the demand changes or a failed wake-up is due again
+            std::unique_lock<std::mutex> lock(mutex);
+            tickHz = 0;
+            periodUs = 0;
+            auto changed = [&]() {
+                return demands != seen || !running;
+            };
+            if (retry == std::chrono::steady_clock::time_point::max()) {
+                demandChanged.wait(lock, changed);
+            } else {
+                demandChanged.wait_until(lock, retry, changed);
+            }
+            continue;
+        }
+        if (highest != tickHz) {
+            tickHz = highest;
+            tick = 0;
+            periodUs = 1000000 / tickHz;
+            timer.setPeriod(periodUs);
+        }
+
+        gyros.clear();
+        indices.clear();
+        auto due = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < imus.size(); i++) {
+            const Imu& imu = *imus[i];
+            if (imu.rateHz > 0 && due >= imu.settled && tick % (tickHz / imu.rateHz) == 0) {
+                gyros.push_back(&imus[i]->gyro);
+                indices.push_back(i);
+            }
+        }
+        tick++;
+
+        // All due sensors are read in one pass, batched per bus
+        if (!gyros.empty() && Gyro::readSamples(gyros, samples, valid) > 0) {
+            auto now = std::chrono::steady_clock::now();
+            for (size_t n = 0; n < indices.size(); n++) {
+                if (!valid[n]) {
+                    continue;
+                }
+                size_t i = indices[n];
+                Imu& imu = *imus[i];
+                const ImuSample& sample = samples[n];
+
+                // Integrate over the actual elapsed time, not the nominal period
+                double dt = std::chrono::duration<double>(now - imu.last).count();
+                imu.last = now;
+                imu.attitude.update(sample.gyroX, sample.gyroY, sample.gyroZ,
+                                    sample.accX, sample.accY, sample.accZ, dt);
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    imu.history[imu.recorded % HISTORY_SAMPLES] = sample;
+                    imu.recorded++;
+                    latest[i].sample = sample;
+                    latest[i].roll = imu.attitude.getRoll();
+                    latest[i].pitch = imu.attitude.getPitch();
+                    latest[i].yaw = imu.attitude.getYaw();
+                }
+
+                // Every raw frame goes into the sensor's compressed stream
+                imu.encoder.add(sample.raw, sample.timestampNs);
+                if (imu.encoder.size() >= imu.blockFrames && sink) {
+                    sink(Protocol::makeEvent(imu.topic, imu.encoder.flush()));
+                }
+            }
+        }
+
+        // The sampler is the only writer of latest, so it reads it without the lock
+        boardRecord.timestampNs = Rt::monotonicNs();
+        boardRecord.samples++;
+        boardRecord.imuCount = static_cast<uint32_t>(std::min<size_t>(latest.size(), GyroBoard::MAX_IMUS));
+        for (uint32_t i = 0; i < boardRecord.imuCount; i++) {
+            const ImuSample& sample = latest[i].sample;
+            GyroBoard::Imu& imu = boardRecord.imus[i];
+            imu.gyro[0] = sample.gyroX;
+            imu.gyro[1] = sample.gyroY;
+            imu.gyro[2] = sample.gyroZ;
+            imu.acc[0] = sample.accX;
+            imu.acc[1] = sample.accY;
+            imu.acc[2] = sample.accZ;
+            imu.temperature = sample.temp;
+            imu.roll = latest[i].roll;
+            imu.pitch = latest[i].pitch;
+            imu.yaw = latest[i].yaw;
+        }
+        board.publish(boardRecord);
+        sampled.notify_all();
+
+        // Pace against absolute deadlines so processing time does not accumulate
+        timer.wait();
+    }
+
+    // Leave the sensors drawing as little as possible
+    for (size_t i = 0; i < imus.size(); i++) {
+        if (imus[i]->available) {
+            imus[i]->gyro.setLowPower(LOW_POWER_WAKE_HZ);
+        }
+    }
+}
+
+// Commands answered by process(); "history" is only answered here when it cannot be streamed
+struct GyroService::Commands : CommandTable<
+    Command<"imus", &GyroService::imusCommand>,
+    Command<"history", &GyroService::historyCommand>,
+    Command<"ping", &GyroService::pingCommand>,
+    Command<"gyroTiming", &GyroService::timingCommand>,
+    Command<"gyroRate", &GyroService::rateCommand>,
+    Command<"demand", &GyroService::demandCommand>,
+    Command<"close", &GyroService::closeCommand>,
+    Command<"gyro", &GyroService::gyroCommand>,
+    Command<"acc", &GyroService::accCommand>,
+    Command<"temp", &GyroService::tempCommand>,
+    Command<"attitude", &GyroService::attitudeCommand>
+> {};
+
+std::string GyroService::process(const std::string& command, const std::vector<Reading>& readings) {
+    std::stringstream response;
+
+    if (Protocol::isBatch(command)) {
+        // Answer every entry from the same readings
+        std::vector<std::string> commands = Protocol::splitBatch(command);
+        std::vector<std::string> responses;
+        for (size_t i = 0; i < commands.size(); i++) {
+            responses.push_back(process(commands[i], readings));
+        }
+        response << Protocol::makeBatch(responses);
+        return response.str();
+    }
+
+    if (Protocol::isStamped(command)) {
+        // Stamps apply to single commands; in a batch every entry carries its own
+        std::string inner = Protocol::unstamped(command);
+        if (Protocol::isBatch(inner) || Protocol::isStamped(inner)) {
+            return "error: unknown command:";
+        }
+        return Protocol::makeStamped(acquiredAt(inner, readings), process(inner, readings));
+    }
+
+    return Commands::handle(*this, command, readings);
+}
+
+std::string GyroService::imusCommand(const Readings& readings) {
+    return "imus " + std::to_string(readings.size()) + ":";
+}
+
+std::string GyroService::historyCommand(const Readings& readings, uint64_t count, std::optional<size_t> index) {
+    // Valid requests are answered by openStream(); a batch cannot carry a stream
+    (void)count;
+    if (index.value_or(0) >= readings.size()) {
+        return "error: no such imu:";
+    }
+    return "error: history must be requested on its own:";
+}
+
+std::string GyroService::pingCommand(const Readings& readings) {
+    (void)readings;
+    return "pong:";
+}
+
+std::string GyroService::timingCommand(const Readings& readings) {
+    (void)readings;
+    std::stringstream response;
+    response << "gyroTiming " << periodUs << " " << samplerJitter.format() << ":";
+    return response.str();
+}
+
+std::string GyroService::rateCommand(const Readings& readings) {
+    std::stringstream response;
+    response << "gyroRate";
+    for (size_t i = 0; i < readings.size(); i++) {
+        response << " " << readings[i].rateHz;
+    }
+    response << ":";
+    return response.str();
+}
+
+std::string GyroService::demandCommand(const Readings& readings, int hz, std::optional<size_t> index) {
+    // Sent by the Server Node whenever the subscriptions of a sensor change
+    (void)readings;
+    if (hz < 0) {
+        return "error: unknown command:";
+    }
+    if (index.value_or(0) >= imus.size()) {
+        return "error: no such imu:";
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        imus[index.value_or(0)]->demandHz = hz;
+        demands++;
+    }
+    demandChanged.notify_all();
+    return "demand ok:";
+}
+
+std::string GyroService::closeCommand(const Readings& readings) {
+    (void)readings;
+    closing = true;
+    return "close ok:";
+}
+
+const GyroService::Reading* GyroService::readingOf(const Readings& readings, std::optional<size_t> index) {
+    return index.value_or(0) < readings.size() ? &readings[index.value_or(0)] : NULL;
+}
+
+std::string GyroService::gyroCommand(const Readings& readings, std::optional<size_t> index) {
+    const Reading* reading = readingOf(readings, index);
+    if (reading == NULL) {
+        return "error: no such imu:";
+    }
+    std::stringstream response;
+    response << "gyro " << reading->sample.gyroX << " " << reading->sample.gyroY << " " << reading->sample.gyroZ << ":";
+    return response.str();
+}
+
+std::string GyroService::accCommand(const Readings& readings, std::optional<size_t> index) {
+    const Reading* reading = readingOf(readings, index);
+    if (reading == NULL) {
+        return "error: no such imu:";
+    }
+    std::stringstream response;
+    response << "acc " << reading->sample.accX << " " << reading->sample.accY << " " << reading->sample.accZ << ":";
+    return response.str();
+}
+
+std::string GyroService::tempCommand(const Readings& readings, std::optional<size_t> index) {
+    const Reading* reading = readingOf(readings, index);
+    if (reading == NULL) {
+        return "error: no such imu:";
+    }
+    std::stringstream response;
+    response << "temp " << reading->sample.temp << ":";
+    return response.str();
+}
+
+std::string GyroService::attitudeCommand(const Readings& readings, std::optional<size_t> index) {
+    const Reading* reading = readingOf(readings, index);
+    if (reading == NULL) {
+        return "error: no such imu:";
+    }
+    std::stringstream response;
+    response << "attitude " << reading->roll << " " << reading->pitch << " " << reading->yaw << ":";
+    return response.str();
+}
+
+uint64_t GyroService::acquiredAt(const std::string& command, const std::vector<Reading>& readings) {
+    // "<reading>:" or "<reading> <n>:" reports when the sensor's sample was taken
+    size_t index = 0;
+    if (parseReading(command, index) && index < readings.size()) {
+        return readings[index].sample.timestampNs;
+    }
+
+    // Everything else is answered from the current state
+    return Rt::monotonicNs();
+}
+
+DigitalIOService::DigitalIOService(const std::vector<int>& relayPins) : relay(relayPins), running(false) {
+}
+
+DigitalIOService::~DigitalIOService() {
+    stop();
+}
+
+void DigitalIOService::start(const EventSink& eventSink) {
+    sink = eventSink;
+    sensor.init();
+    relay.init();
+    keypad.init();
+    if (!board.init()) {
+        std::cerr << "Sensor and relay states are not published in shared memory" << std::endl;
+    }
+    publishBoard(false, relay.getStates(), Rt::monotonicNs());
+
+    // The monitors run right away; they do not depend on anyone listening
+    running = true;
+    keypadThread = std::thread(&DigitalIOService::keypadMonitor, this);
+    sensorThread = std::thread(&DigitalIOService::sensorMonitor, this);
+}
+
+void DigitalIOService::stop() {
+    if (!running) {
+        return;
+    }
+
+    // Signal the monitor threads to stop and wait for them to finish
+    running = false;
+    if (keypadThread.joinable()) {
+        keypadThread.join();
+    }
+    if (sensorThread.joinable()) {
+        sensorThread.join();
+    }
+
+    sensor.release();
+    relay.release();
+    keypad.release();
+    board.release();
+}
+
+void DigitalIOService::publish(const std::string& topic, const std::string& payload, uint64_t timestampNs) {
+    if (sink) {
+        sink(Protocol::makeEvent(topic, payload, timestampNs));
+    }
+}
+
+void DigitalIOService::publishBoard(bool poll, uint64_t states, uint64_t timestampNs) {
+    std::lock_guard<std::mutex> lock(boardMutex);
+    if (poll) {
+        boardRecord.timestampNs = timestampNs;
+        boardRecord.sensorOn = states != 0;
+    } else {
+        boardRecord.relayOn = (states & 1) != 0;
+        boardRecord.relays = states;
+        boardRecord.relayCount = static_cast<uint32_t>(relay.size());
+    }
+    board.publish(boardRecord);
+}
+
+void DigitalIOService::sensorMonitor() {
+    Rt::configureThread(realtime, "io-sensor");
+    PeriodicTimer timer(SENSOR_POLL_MS * 1000, &sensorJitter);
+    bool last = sensor.read();
+    while (running) {
+        timer.wait();
+        bool state = sensor.read();
+        uint64_t readNs = Rt::monotonicNs();
+        publishBoard(true, state, readNs);
+        if (state != last) {
+            last = state;
+            publish("sensor", state ? "1" : "0", readNs);
+        }
+    }
+}
+
+void DigitalIOService::keypadMonitor() {
+    Rt::configureThread(realtime, "io-keypad");
+    PeriodicTimer timer(KEYPAD_POLL_MS * 1000);
+    while (running) {
+        char key = keypad.getKey();
+        if (key != '\0') {
+            // Every key press is published on the "key" topic
+            publish("key", std::string(1, key), Rt::monotonicNs());
+        }
+        if (key == '#') {
+            std::cout << "Key sequence entered: " << keypad.getKeyBuffer() << std::endl;
+        }
+        // Scan at a fixed rate; holding a key down makes the timer skip the missed scans
+        timer.wait();
+    }
+}
+
+std::vector<std::string> DigitalIOService::devicesOf(const std::string& command) {
+    std::vector<std::string> devices;
+    if (Protocol::isStamped(command)) {
+        return devicesOf(Protocol::unstamped(command));
+    }
+    if (Protocol::isBatch(command)) {
+        std::vector<std::string> commands = Protocol::splitBatch(command);
+        for (size_t i = 0; i < commands.size(); i++) {
+            std::vector<std::string> used = devicesOf(commands[i]);
+            devices.insert(devices.end(), used.begin(), used.end());
+        }
+    } else if (command == "sensorState:" || command == "sensorType:") {
+        devices.push_back("sensor");
+    } else if (commandName(command) == "relayState" || command == "relaysState:" || Protocol::isWrite(command)) {
+        devices.push_back("relay");
+    } else if (command == "key:") {
+        devices.push_back("keypad");
+    }
+    return devices;
+}
+
+// Commands answered by handle(); a relay command whose state is not 0 or 1 fails
+struct DigitalIOService::Commands : CommandTable<
+    Command<"sensorState", &DigitalIOService::sensorStateCommand>,
+    Command<"sensorType", &DigitalIOService::sensorTypeCommand>,
+    Command<"relay", &DigitalIOService::relayCommand, "relay err:">,
+    Command<"relayState", &DigitalIOService::relayStateCommand>,
+    Command<"relays", &DigitalIOService::relaysCommand, "relays err:">,
+    Command<"relaysState", &DigitalIOService::relaysStateCommand>,
+    Command<"key", &DigitalIOService::keyCommand>,
+    Command<"ping", &DigitalIOService::pingCommand>,
+    Command<"ioTiming", &DigitalIOService::timingCommand>,
+    Command<"close", &DigitalIOService::closeCommand>
+> {};
+
+std::string DigitalIOService::handle(const std::string& command) {
+    std::stringstream response;
+
+    if (Protocol::isBatch(command)) {
+        // Run every entry in order and collect the responses
+        std::vector<std::string> commands = Protocol::splitBatch(command);
+        std::vector<std::string> responses;
+        for (size_t i = 0; i < commands.size(); i++) {
+            responses.push_back(handle(commands[i]));
+        }
+        response << Protocol::makeBatch(responses);
+    }
+    else if (Protocol::isStamped(command)) {
+        // Every device is read or set on demand, so the value is acquired right now
+        std::string inner = Protocol::unstamped(command);
+        if (Protocol::isBatch(inner) || Protocol::isStamped(inner)) {
+            response << "error: unknown command:";
+        } else {
+            uint64_t acquiredNs = Rt::monotonicNs();
+            response << Protocol::makeStamped(acquiredNs, handle(inner));
+        }
+    }
+    else {
+        response << Commands::handle(*this, command);
+    }
+
+    return response.str();
+}
+
+std::string DigitalIOService::sensorStateCommand() {
+    bool state = sensor.read();
+    return std::string("sensorState ") + (state ? "1" : "0") + ":";
+}
+
+std::string DigitalIOService::sensorTypeCommand() {
+    return "sensorType " + sensor.getType() + ":";
+}
+
+std::string DigitalIOService::relayCommand(bool on, std::optional<size_t> index) {
+    if (index.value_or(0) >= relay.size()) {
+        return "error: no such relay:";
+    }
+    uint64_t bit = 1ULL << index.value_or(0);
+    return switchRelays("relay", on ? bit : 0, bit);
+}
+
+std::string DigitalIOService::relayStateCommand(std::optional<size_t> index) {
+    if (index.value_or(0) >= relay.size()) {
+        return "error: no such relay:";
+    }
+    bool state = relay.getState(index.value_or(0));
+    return std::string("relay ") + (state ? "1" : "0") + ":";
+}
+
+std::string DigitalIOService::relaysCommand(std::string pattern) {
+    uint64_t values = 0;
+    uint64_t mask = 0;
+    if (!Relay::parsePattern(pattern, values, mask)) {
+        return "relays err:";
+    }
+    if (pattern.size() > relay.size()) {
+        return "error: no such relay:";
+    }
+    return switchRelays("relays", values, mask);
+}
+
+std::string DigitalIOService::relaysStateCommand() {
+    return "relays " + Relay::formatPattern(relay.getStates(), relay.size()) + ":";
+}
+
+std::string DigitalIOService::switchRelays(const std::string& name, uint64_t values, uint64_t mask) {
+    uint64_t previous = relay.getStates();
+    if (!relay.setMask(values, mask)) {
+        return name + " err:";
+    }
+    uint64_t states = relay.getStates();
+    uint64_t setNs = Rt::monotonicNs();
+    publishBoard(false, states, setNs);
+
+    // "relay" follows relay 0, as before there were banks; "relays" follows the whole bank
+    if ((states ^ previous) & 1) {
+        publish("relay", states & 1 ? "1" : "0", setNs);
+    }
+    if (states != previous) {
+        publish("relays", Relay::formatPattern(states, relay.size()), setNs);
+    }
+    return name + " ok:";
+}
+
+std::string DigitalIOService::keyCommand() {
+    std::string keyBuffer = keypad.getKeyBuffer();
+    // Clear the key buffer after sending
+    keypad.clearKeyBuffer();
+    return "key " + keyBuffer + ":";
+}
+
+std::string DigitalIOService::pingCommand() {
+    return "pong:";
+}
+
+std::string DigitalIOService::timingCommand() {
+    std::stringstream response;
+    response << "ioTiming " << SENSOR_POLL_MS * 1000 << " " << sensorJitter.format() << ":";
+    return response.str();
+}
+
+std::string DigitalIOService::closeCommand() {
+    closing = true;
+    return "close ok:";
+}
+
+ReplyStreamer::ReplyStreamer(const std::function<bool(const std::string&)>& sendMessage) : send(sendMessage) {
+}
+
+void ReplyStreamer::open(uint32_t tag, std::unique_ptr<ReplyStream> stream) {
+    streams[tag] = std::move(stream);
+    for (int i = 0; i < Protocol::STREAM_WINDOW && streams.count(tag) > 0; i++) {
+        advance(tag);
+    }
+}
+
+bool ReplyStreamer::control(uint32_t tag, const std::string& command) {
+    if (command != Protocol::STREAM_MORE && command != Protocol::STREAM_STOP) {
+        return false;
+    }
+
+    std::map<uint32_t, std::unique_ptr<ReplyStream> >::iterator found = streams.find(tag);
+    if (found == streams.end()) {
+        // The stream has already ended
+        return true;
+    }
+    if (command == Protocol::STREAM_STOP) {
+        send(Protocol::makeTagged(tag, found->second->end()));
+        streams.erase(found);
+    } else {
+        advance(tag);
+    }
+    return true;
+}
+
+void ReplyStreamer::clear() {
+    streams.clear();
+}
+
+void ReplyStreamer::advance(uint32_t tag) {
+    std::map<uint32_t, std::unique_ptr<ReplyStream> >::iterator found = streams.find(tag);
+    std::string chunk;
+    if (found->second->next(chunk)) {
+        send(Protocol::makeTagged(tag, Protocol::makeChunk(chunk)));
+    } else {
+        send(Protocol::makeTagged(tag, found->second->end()));
+        streams.erase(found);
+    }
+}
@@ -0,0 +1,215 @@
+#include "../include/ProtocolLib.h"
+#include <cstdlib>
+#include <algorithm>
+
+namespace Protocol {
+
+    Route routeOf(const std::string& command) {
+        if (isStamped(command)) {
+            return routeOf(unstamped(command));
+        }
+        
+        if (command == "gyro:" || 
+            command == "temp:" || 
+            command == "acc:" || 
+            command == "attitude:" ||
+            command == "imus:" ||
+            command == "gyroTiming:" ||
+            command == "gyroRate:") {
+            return Route::GYRO;
+        }
+        
+        // "<reading> <n>:" addresses the n-th IMU of the GyroSensor Node
+        size_t space = command.find(' ');
+        size_t last = command.size() - 1;
+        if (space != std::string::npos && space + 1 < last && command[last] == ':' &&
+            command.find_first_not_of("0123456789", space + 1) == last) {
+            std::string name = command.substr(0, space);
+            if (name == "gyro" || name == "temp" || name == "acc" || name == "attitude") {
+                return Route::GYRO;
+            }
+            // "relayState <n>:" reads the n-th relay of the DigitalIO Node
+            if (name == "relayState") {
+                return Route::DIGITAL_IO;
+            }
+        }
+        
+        if (isStreamed(command)) {
+            return Route::GYRO;
+        }
+        
+        if (command == "sensorState:" || 
+            command == "sensorType:" || 
+            command == "relayState:" || 
+            command == "relaysState:" || 
+            command == "key:" || 
+            command == "ioTiming:" || 
+            isWrite(command)) {
+            return Route::DIGITAL_IO;
+        }
+        
+        return Route::UNKNOWN;
+    }
+
+    Priority priorityOf(const std::string& command) {
+        if (isStamped(command)) {
+            return priorityOf(unstamped(command));
+        }
+        if (isBatch(command)) {
+            Priority priority = Priority::BULK;
+            std::vector<std::string> entries = splitBatch(command);
+            for (size_t i = 0; i < entries.size(); i++) {
+                priority = std::min(priority, priorityOf(entries[i]));
+            }
+            return priority;
+        }
+        
+        // "demand" changes how the GyroSensor Node samples, so it is not held up by reads
+        if (isWrite(command) || command == "close:" || command.compare(0, 7, "demand ") == 0) {
+            return Priority::CONTROL;
+        }
+        if (command == "gyroTiming:" || command == "ioTiming:" || isStreamed(command)) {
+            return Priority::BULK;
+        }
+        return Priority::STATUS;
+    }
+
+    bool isWrite(const std::string& command) {
+        std::string body = unstamped(command);
+        return body.compare(0, 6, "relay ") == 0 || body.compare(0, 7, "relays ") == 0;
+    }
+
+    bool isStreamed(const std::string& command) {
+        return command.compare(0, 8, "history ") == 0;
+    }
+
+    bool isChunk(const std::string& message) {
+        return message.compare(0, CHUNK_PREFIX.size(), CHUNK_PREFIX) == 0;
+    }
+
+    std::string makeChunk(const std::string& payload) {
+        return CHUNK_PREFIX + payload;
+    }
+
+    bool isStamped(const std::string& message) {
+        return message.compare(0, STAMP_PREFIX.size(), STAMP_PREFIX) == 0;
+    }
+
+    std::string unstamped(const std::string& command) {
+        return isStamped(command) ? command.substr(STAMP_PREFIX.size()) : command;
+    }
+
+    std::string makeStamped(uint64_t timestampNs, const std::string& reply) {
+        return STAMP_PREFIX + std::to_string(timestampNs) + " " + reply;
+    }
+
+    bool splitStamped(const std::string& message, uint64_t& timestampNs, std::string& reply) {
+        if (!isStamped(message)) {
+            return false;
+        }
+        size_t space = message.find(' ', STAMP_PREFIX.size());
+        if (space == std::string::npos || space == STAMP_PREFIX.size() ||
+            message.find_first_not_of("0123456789", STAMP_PREFIX.size()) != space) {
+            return false;
+        }
+        timestampNs = std::strtoull(message.c_str() + STAMP_PREFIX.size(), NULL, 10);
+        reply = message.substr(space + 1);
+        return true;
+    }
+
+    bool splitEventStamp(const std::string& payload, std::string& value, uint64_t& timestampNs) {
+        size_t stamp = payload.rfind(EVENT_STAMP);
+        size_t digits = stamp + EVENT_STAMP.size();
+        if (stamp == std::string::npos || digits == payload.size() ||
+            payload.find_first_not_of("0123456789", digits) != std::string::npos) {
+            return false;
+        }
+        timestampNs = std::strtoull(payload.c_str() + digits, NULL, 10);
+        value = payload.substr(0, stamp);
+        return true;
+    }
+
+    bool isBatch(const std::string& message) {
+        return message.compare(0, BATCH_PREFIX.size(), BATCH_PREFIX) == 0;
+    }
+
+    std::vector<std::string> splitBatch(const std::string& message) {
+        std::vector<std::string> entries;
+        
+        size_t start = BATCH_PREFIX.size();
+        while (start <= message.size()) {
+            size_t end = message.find(BATCH_SEPARATOR, start);
+            if (end == std::string::npos) {
+                end = message.size();
+            }
+            if (end > start) {
+                entries.push_back(message.substr(start, end - start));
+            }
+            start = end + 1;
+        }
+        
+        return entries;
+    }
+
+    std::string makeBatch(const std::vector<std::string>& entries) {
+        std::string message = BATCH_PREFIX;
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (i > 0) {
+                message += BATCH_SEPARATOR;
+            }
+            message += entries[i];
+        }
+        return message;
+    }
+
+    bool isEvent(const std::string& message) {
+        return message.compare(0, EVENT_PREFIX.size(), EVENT_PREFIX) == 0;
+    }
+
+    std::string makeEvent(const std::string& topic, const std::string& payload) {
+        return EVENT_PREFIX + topic + " " + payload + ":";
+    }
+
+    std::string makeEvent(const std::string& topic, const std::string& payload, uint64_t timestampNs) {
+        return EVENT_PREFIX + topic + " " + payload + EVENT_STAMP + std::to_string(timestampNs) + ":";
+    }
+
+    std::string topicOf(const std::string& message) {
+        if (!isEvent(message)) {
+            return "";
+        }
+        size_t end = message.find_first_of(" :", EVENT_PREFIX.size());
+        if (end == std::string::npos) {
+            return "";
+        }
+        return message.substr(EVENT_PREFIX.size(), end - EVENT_PREFIX.size());
+    }
+
+    bool imuOfTopic(const std::string& topic, size_t& index) {
+        // The first IMU's topic is "imu", not "imu0"
+        if (topic.compare(0, 3, "imu") != 0 || topic.find_first_not_of("0123456789", 3) != std::string::npos ||
+            (topic.size() > 3 && topic[3] == '0')) {
+            return false;
+        }
+        index = topic.size() == 3 ? 0 : std::strtoul(topic.c_str() + 3, NULL, 10);
+        return true;
+    }
+
+    std::string makeTagged(uint32_t tag, const std::string& message) {
+        return TAG_PREFIX + std::to_string(tag) + " " + message;
+    }
+
+    bool splitTagged(const std::string& message, uint32_t& tag, std::string& body) {
+        if (message.compare(0, TAG_PREFIX.size(), TAG_PREFIX) != 0) {
+            return false;
+        }
+        size_t space = message.find(' ', TAG_PREFIX.size());
+        if (space == std::string::npos || space == TAG_PREFIX.size() ||
+            message.find_first_not_of("0123456789", TAG_PREFIX.size()) != space) {
+            return false;
+        }
+        tag = static_cast<uint32_t>(std::strtoul(message.c_str() + TAG_PREFIX.size(), NULL, 10));
+        body = message.substr(space + 1);
+        return true;
+    }
+}
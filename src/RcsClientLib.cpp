@@ -0,0 +1,487 @@
+#include "../include/RcsClientLib.h"
+#include "../include/ProtocolLib.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+    // Extract the payload of a reply of the form "<name> <payload>:"
+    bool splitReply(const std::string& reply, const std::string& name, std::string& payload) {
+        if (reply.size() < name.size() + 2 || reply.compare(0, name.size() + 1, name + " ") != 0 ||
+            reply[reply.size() - 1] != ':') {
+            return false;
+        }
+        payload = reply.substr(name.size() + 1, reply.size() - name.size() - 2);
+        return true;
+    }
+
+    bool decodeVector(const std::string& payload, RcsClient::Vector3& value) {
+        std::istringstream iss(payload);
+        return static_cast<bool>(iss >> value.x >> value.y >> value.z);
+    }
+
+    bool decodeNumber(const std::string& payload, double& value) {
+        std::istringstream iss(payload);
+        return static_cast<bool>(iss >> value);
+    }
+
+    bool decodeAttitude(const std::string& payload, RcsClient::Attitude& value) {
+        std::istringstream iss(payload);
+        return static_cast<bool>(iss >> value.roll >> value.pitch >> value.yaw);
+    }
+
+    bool decodeSwitch(const std::string& payload, bool& value) {
+        if (payload != "0" && payload != "1") {
+            return false;
+        }
+        value = (payload == "1");
+        return true;
+    }
+
+    bool decodeText(const std::string& payload, std::string& value) {
+        value = payload;
+        return true;
+    }
+
+    bool decodeAck(const std::string& payload, bool& value) {
+        value = (payload == "ok");
+        return value;
+    }
+
+    bool decodeCount(const std::string& payload, uint64_t& value) {
+        std::istringstream iss(payload);
+        return static_cast<bool>(iss >> value);
+    }
+
+    // Ask for the acquisition time of a command, or of every entry of a batch, that a node answers
+    std::string stampCommand(const std::string& command) {
+        if (Protocol::isBatch(command)) {
+            std::vector<std::string> entries = Protocol::splitBatch(command);
+            for (size_t i = 0; i < entries.size(); i++) {
+                entries[i] = stampCommand(entries[i]);
+            }
+            return Protocol::makeBatch(entries);
+        }
+        if (Protocol::routeOf(command) == Protocol::Route::UNKNOWN || Protocol::isStreamed(command)) {
+            return command;
+        }
+        return Protocol::STAMP_PREFIX + command;
+    }
+
+    // Remove the stamps from a reply, keeping the oldest one
+    std::string unstampReply(const std::string& reply, uint64_t& timestampNs) {
+        uint64_t stamp = 0;
+        std::string body;
+        if (Protocol::splitStamped(reply, stamp, body)) {
+            timestampNs = (timestampNs == 0) ? stamp : std::min(timestampNs, stamp);
+            return body;
+        }
+        if (Protocol::isBatch(reply)) {
+            std::vector<std::string> entries = Protocol::splitBatch(reply);
+            for (size_t i = 0; i < entries.size(); i++) {
+                entries[i] = unstampReply(entries[i], timestampNs);
+            }
+            return Protocol::makeBatch(entries);
+        }
+        return reply;
+    }
+
+    bool decodeHistory(const std::string& payload, RcsClient::History& value) {
+        std::istringstream iss(payload);
+        return static_cast<bool>(iss >> value.sent >> value.lost);
+    }
+
+    // Entries of the dashboard batch, in request order
+    const char* const DASHBOARD_COMMANDS[] = { "gyro:", "acc:", "temp:", "sensorState:", "relayState:" };
+
+    bool decodeDashboard(const std::string& payload, RcsClient::Dashboard& value) {
+        std::vector<std::string> replies = Protocol::splitBatch(Protocol::BATCH_PREFIX + payload);
+        std::string entry;
+        return replies.size() == 5 &&
+               splitReply(replies[0], "gyro", entry) && decodeVector(entry, value.gyro) &&
+               splitReply(replies[1], "acc", entry) && decodeVector(entry, value.acc) &&
+               splitReply(replies[2], "temp", entry) && decodeNumber(entry, value.temperature) &&
+               splitReply(replies[3], "sensorState", entry) && decodeSwitch(entry, value.sensorOn) &&
+               splitReply(replies[4], "relay", entry) && decodeSwitch(entry, value.relayOn);
+    }
+}
+
+void ClockSync::add(int64_t sentNs, uint64_t remoteNs, int64_t receivedNs) {
+    int64_t rtt = receivedNs - sentNs;
+    if (samples == 0 || rtt < rttNs) {
+        rttNs = rtt;
+        offsetNs = static_cast<int64_t>(remoteNs) - (sentNs + rtt / 2);
+    }
+    samples++;
+}
+
+int64_t ClockSync::toLocalNs(uint64_t remoteNs) const {
+    return static_cast<int64_t>(remoteNs) - offsetNs;
+}
+
+int64_t ClockSync::localNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+RcsClient::RcsClient() : stamped(false), connected(false) {
+    // Not connected until connect() is called
+}
+
+RcsClient::~RcsClient() {
+    disconnect();
+}
+
+bool RcsClient::connect(const std::string& host, int port, int timeoutMs) {
+    disconnect();
+
+    std::unique_ptr<SocketCon> candidate(new SocketCon(SocketCon::Mode::CLIENT, host, port));
+    bool ok = (timeoutMs == 0) ? candidate->init() : candidate->connect(timeoutMs);
+    if (!ok) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    socket = std::move(candidate);
+    connected = true;
+    reader = std::thread(&RcsClient::readLoop, this);
+    return true;
+}
+
+void RcsClient::disconnect() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!socket) {
+            return;
+        }
+        // Wake up the reader; it fails whatever is still pending
+        connected = false;
+        socket->shutdown();
+    }
+
+    if (reader.joinable()) {
+        reader.join();
+    }
+
+    // A sender may still be writing to the shut down socket
+    std::lock_guard<std::mutex> sendLock(sendMutex);
+    std::lock_guard<std::mutex> lock(mutex);
+    socket->release();
+    socket.reset();
+}
+
+bool RcsClient::isConnected() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return connected;
+}
+
+void RcsClient::send(const std::string& command, const Completion& completion, const ChunkHandler& onChunk) {
+    // Keeps requests in the same order in pending and on the socket
+    std::unique_lock<std::mutex> sendLock(sendMutex);
+    bool queued = false;
+    {
+        // Queue before sending so the reply always finds its request
+        std::lock_guard<std::mutex> lock(mutex);
+        if (connected) {
+            Pending request = { completion, onChunk };
+            pending.push_back(request);
+            queued = true;
+        }
+    }
+    if (!queued) {
+        sendLock.unlock();
+        completion(false, "");
+        return;
+    }
+
+    // The write may block until the server has read earlier requests, which it only does
+    // once their replies are read; the reader must therefore never wait for a sender
+    if (!socket->send(command)) {
+        // The reader notices the broken connection and fails the request
+        std::lock_guard<std::mutex> lock(mutex);
+        connected = false;
+        socket->shutdown();
+    }
+}
+
+void RcsClient::readLoop() {
+    std::string reply;
+    while (socket->receive(reply)) {
+        if (Protocol::isEvent(reply)) {
+            // Events are not replies; pass "event <topic> <payload>[ @<ns>]:" to the topic's handler
+            std::string topic = Protocol::topicOf(reply);
+            std::string payload;
+            splitReply(reply, Protocol::EVENT_PREFIX + topic, payload);
+
+            // "imu" payloads are binary, and their frames carry their own times
+            uint64_t timestampNs = 0;
+            std::string value;
+            if (topic.compare(0, 3, "imu") != 0 && Protocol::splitEventStamp(payload, value, timestampNs)) {
+                payload = value;
+            }
+
+            StampedEventHandler onEvent;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::map<std::string, StampedEventHandler>::iterator found = eventHandlers.find(topic);
+                if (found != eventHandlers.end()) {
+                    onEvent = found->second;
+                }
+            }
+            if (onEvent) {
+                onEvent(topic, payload, timestampNs);
+            }
+            continue;
+        }
+
+        if (Protocol::isChunk(reply)) {
+            // Chunks belong to the oldest request, which stays pending until its final reply
+            ChunkHandler onChunk;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!pending.empty()) {
+                    onChunk = pending.front().onChunk;
+                }
+            }
+            if (onChunk) {
+                onChunk(reply.substr(Protocol::CHUNK_PREFIX.size()));
+            }
+            continue;
+        }
+
+        Completion completion;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pending.empty()) {
+                std::cerr << "Unexpected reply from server: " << reply << std::endl;
+                continue;
+            }
+            completion = pending.front().completion;
+            pending.pop_front();
+        }
+        completion(true, reply);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        connected = false;
+    }
+    failPending("connection lost");
+}
+
+void RcsClient::failPending(const std::string& reason) {
+    std::deque<Pending> failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        failed.swap(pending);
+    }
+    for (size_t i = 0; i < failed.size(); i++) {
+        failed[i].completion(false, reason);
+    }
+}
+
+template <typename T>
+std::future<RcsClient::Result<T> > RcsClient::call(const std::string& command, const std::string& name,
+                                                   const std::function<bool(const std::string&, T&)>& decode,
+                                                   const Handler<T>& handler, const ChunkHandler& onChunk) {
+    std::shared_ptr<std::promise<Result<T> > > promise = std::make_shared<std::promise<Result<T> > >();
+    std::future<Result<T> > future = promise->get_future();
+
+    bool stamp;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stamp = stamped;
+    }
+
+    send(stamp ? stampCommand(command) : command, [promise, name, decode, handler](bool ok, const std::string& reply) {
+        Result<T> result;
+        std::string payload;
+        if (!ok) {
+            result.error = reply.empty() ? "not connected" : reply;
+        } else {
+            result.raw = reply;
+            std::string unstamped = unstampReply(reply, result.timestampNs);
+            if (unstamped.compare(0, 5, "error") == 0) {
+                result.error = unstamped;
+            } else if (splitReply(unstamped, name, payload) && decode(payload, result.value)) {
+                result.ok = true;
+            } else {
+                result.error = "unexpected reply: " + reply;
+            }
+        }
+
+        if (handler) {
+            handler(result);
+        }
+        promise->set_value(result);
+    }, onChunk);
+
+    return future;
+}
+
+void RcsClient::requestTimestamps(bool enable) {
+    std::lock_guard<std::mutex> lock(mutex);
+    stamped = enable;
+}
+
+std::future<RcsClient::Result<ClockSync> > RcsClient::syncClock(int rounds, const Handler<ClockSync>& handler) {
+    std::shared_ptr<ClockRounds> state = std::make_shared<ClockRounds>();
+    state->left = std::max(rounds, 1);
+    state->handler = handler;
+    std::future<Result<ClockSync> > future = state->promise.get_future();
+    clockRound(state);
+    return future;
+}
+
+void RcsClient::clockRound(const std::shared_ptr<ClockRounds>& rounds) {
+    rounds->sentNs = ClockSync::localNowNs();
+    send("clock:", [this, rounds](bool ok, const std::string& reply) {
+        int64_t receivedNs = ClockSync::localNowNs();
+        Result<ClockSync>& result = rounds->result;
+        std::string payload;
+        uint64_t remoteNs = 0;
+        if (!ok) {
+            result.error = reply.empty() ? "not connected" : reply;
+        } else if (!splitReply(reply, "clock", payload) || !decodeCount(payload, remoteNs)) {
+            result.error = reply.compare(0, 5, "error") == 0 ? reply : "unexpected reply: " + reply;
+        } else {
+            result.value.add(rounds->sentNs, remoteNs, receivedNs);
+            if (--rounds->left > 0) {
+                // One exchange at a time, so they do not queue behind each other
+                clockRound(rounds);
+                return;
+            }
+            result.ok = true;
+        }
+        result.raw = reply;
+
+        if (rounds->handler) {
+            rounds->handler(result);
+        }
+        rounds->promise.set_value(result);
+    });
+}
+
+std::future<RcsClient::Result<std::string> > RcsClient::request(const std::string& command,
+                                                               const Handler<std::string>& handler) {
+    std::shared_ptr<std::promise<Result<std::string> > > promise = std::make_shared<std::promise<Result<std::string> > >();
+    std::future<Result<std::string> > future = promise->get_future();
+
+    send(command, [promise, handler](bool ok, const std::string& reply) {
+        Result<std::string> result;
+        if (!ok) {
+            result.error = reply.empty() ? "not connected" : reply;
+        } else {
+            // Any reply counts; interpreting it is up to the caller
+            result.ok = true;
+            result.value = reply;
+            result.raw = reply;
+        }
+
+        if (handler) {
+            handler(result);
+        }
+        promise->set_value(result);
+    });
+
+    return future;
+}
+
+std::future<RcsClient::Result<RcsClient::Vector3> > RcsClient::getGyro(const Handler<Vector3>& handler) {
+    return call<Vector3>("gyro:", "gyro", decodeVector, handler);
+}
+
+std::future<RcsClient::Result<RcsClient::Vector3> > RcsClient::getAcc(const Handler<Vector3>& handler) {
+    return call<Vector3>("acc:", "acc", decodeVector, handler);
+}
+
+std::future<RcsClient::Result<double> > RcsClient::getTemperature(const Handler<double>& handler) {
+    return call<double>("temp:", "temp", decodeNumber, handler);
+}
+
+std::future<RcsClient::Result<RcsClient::Attitude> > RcsClient::getAttitude(const Handler<Attitude>& handler) {
+    return call<Attitude>("attitude:", "attitude", decodeAttitude, handler);
+}
+
+std::future<RcsClient::Result<bool> > RcsClient::getSensorState(const Handler<bool>& handler) {
+    return call<bool>("sensorState:", "sensorState", decodeSwitch, handler);
+}
+
+std::future<RcsClient::Result<std::string> > RcsClient::getSensorType(const Handler<std::string>& handler) {
+    return call<std::string>("sensorType:", "sensorType", decodeText, handler);
+}
+
+std::future<RcsClient::Result<bool> > RcsClient::getRelayState(const Handler<bool>& handler) {
+    // The node answers relayState: with "relay <0|1>:"
+    return call<bool>("relayState:", "relay", decodeSwitch, handler);
+}
+
+std::future<RcsClient::Result<bool> > RcsClient::setRelay(bool on, const Handler<bool>& handler) {
+    return call<bool>(on ? "relay 1:" : "relay 0:", "relay", decodeAck, handler);
+}
+
+std::future<RcsClient::Result<std::string> > RcsClient::getRelays(const Handler<std::string>& handler) {
+    // The node answers relaysState: with "relays <pattern>:"
+    return call<std::string>("relaysState:", "relays", decodeText, handler);
+}
+
+std::future<RcsClient::Result<bool> > RcsClient::setRelays(const std::string& pattern, const Handler<bool>& handler) {
+    return call<bool>("relays " + pattern + ":", "relays", decodeAck, handler);
+}
+
+std::future<RcsClient::Result<std::string> > RcsClient::getKeys(const Handler<std::string>& handler) {
+    return call<std::string>("key:", "key", decodeText, handler);
+}
+
+std::future<RcsClient::Result<RcsClient::Dashboard> > RcsClient::getDashboard(const Handler<Dashboard>& handler) {
+    std::vector<std::string> commands(DASHBOARD_COMMANDS, DASHBOARD_COMMANDS + 5);
+
+    // The batch reply "batch a:|b:" has the form "<name> <payload>:" with name "batch"
+    std::string name = Protocol::BATCH_PREFIX.substr(0, Protocol::BATCH_PREFIX.size() - 1);
+    return call<Dashboard>(Protocol::makeBatch(commands), name,
+                           [](const std::string& payload, Dashboard& value) {
+                               return decodeDashboard(payload + ":", value);
+                           }, handler);
+}
+
+std::future<RcsClient::Result<RcsClient::History> > RcsClient::getHistory(size_t count, const ChunkHandler& onSamples,
+                                                                        int imu, const Handler<History>& handler) {
+    std::string command = "history " + std::to_string(count);
+    if (imu != 0) {
+        command += " " + std::to_string(imu);
+    }
+    return call<History>(command + ":", "history", decodeHistory, handler, onSamples);
+}
+
+std::future<RcsClient::Result<bool> > RcsClient::subscribe(const std::string& topic, const EventHandler& onEvent,
+                                                          const std::string& policy, const Handler<bool>& handler) {
+    return subscribe(topic, StampedEventHandler([onEvent](const std::string& eventTopic, const std::string& payload,
+                                                          uint64_t timestampNs) {
+        (void)timestampNs;
+        onEvent(eventTopic, payload);
+    }), policy, handler);
+}
+
+std::future<RcsClient::Result<bool> > RcsClient::subscribe(const std::string& topic, const StampedEventHandler& onEvent,
+                                                          const std::string& policy, const Handler<bool>& handler) {
+    // Register first so no event sent right after the subscription is missed
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        eventHandlers[topic] = onEvent;
+    }
+    return call<bool>("subscribe " + topic + " " + policy + ":", "subscribe", decodeAck, handler);
+}
+
+std::future<RcsClient::Result<bool> > RcsClient::unsubscribe(const std::string& topic, const Handler<bool>& handler) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        eventHandlers.erase(topic);
+    }
+    return call<bool>("unsubscribe " + topic + ":", "unsubscribe", decodeAck, handler);
+}
+
+std::future<RcsClient::Result<std::string> > RcsClient::close(const Handler<std::string>& handler) {
+    return call<std::string>("close:", "close", decodeText, handler);
+}
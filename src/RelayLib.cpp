@@ -1,9 +1,15 @@
 #include "../include/RelayLib.h"
-#include <wiringPi.h>
 #include <iostream>
+#include <cstdlib>
+#include <algorithm>
 
-Relay::Relay() : initialized(false), currentState(false) {
-    // Constructor implementation
+const int Relay::DEFAULT_PIN;
+const size_t Relay::MAX_RELAYS;
+
+Relay::Relay(const std::vector<int>& relayPins) : pins(relayPins), currentStates(0), initialized(false) {
+    if (pins.empty()) {
+        pins.push_back(DEFAULT_PIN);
+    }
 }
 
 Relay::~Relay() {
@@ -13,22 +19,60 @@ Relay::~Relay() {
     }
 }
 
+bool Relay::parsePins(const std::string& spec, std::vector<int>& parsed) {
+    parsed.clear();
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = std::min(spec.find(',', start), spec.size());
+        char* last = NULL;
+        long pin = std::strtol(spec.c_str() + start, &last, 10);
+        if (end == start || last != spec.c_str() + end || pin < 0 || pin > 63 ||
+            std::find(parsed.begin(), parsed.end(), pin) != parsed.end()) {
+            return false;
+        }
+        parsed.push_back(static_cast<int>(pin));
+        start = end + 1;
+    }
+    return parsed.size() <= MAX_RELAYS;
+}
+
+bool Relay::parsePattern(const std::string& pattern, uint64_t& values, uint64_t& mask) {
+    if (pattern.empty() || pattern.size() > MAX_RELAYS) {
+        return false;
+    }
+    values = 0;
+    mask = 0;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        if (pattern[i] == '1') {
+            values |= 1ULL << i;
+        } else if (pattern[i] != '0' && pattern[i] != '-') {
+            return false;
+        }
+        if (pattern[i] != '-') {
+            mask |= 1ULL << i;
+        }
+    }
+    return true;
+}
+
+std::string Relay::formatPattern(uint64_t states, size_t count) {
+    std::string pattern;
+    for (size_t i = 0; i < count && i < MAX_RELAYS; i++) {
+        pattern += (states >> i) & 1 ? '1' : '0';
+    }
+    return pattern;
+}
+
 void Relay::init() {
-    // Initialize wiringPi library if not already initialized
-    if (wiringPiSetupGpio() == -1) {
-        std::cerr << "Failed to initialize wiringPi" << std::endl;
+    // Configure the relay pins as outputs, starting in the OFF state
+    if (!line.request(pins, GpioLines::Direction::OUT, GpioLines::Bias::NONE, 0)) {
+        std::cerr << "Failed to initialize relay GPIO" << std::endl;
         return;
     }
-    
-    // Configure the relay pin as output
-    pinMode(RELAY_PIN, OUTPUT);
-    
-    // Initialize the relay to OFF state
-    digitalWrite(RELAY_PIN, LOW);
-    currentState = false;
+    currentStates = 0;
     
     initialized = true;
-    std::cout << "Relay initialized successfully" << std::endl;
+    std::cout << "Relay initialized successfully (" << pins.size() << " relays)" << std::endl;
 }
 
 void Relay::release() {
@@ -36,31 +80,54 @@ void Relay::release() {
         return;
     }
     
-    // Turn off the relay before releasing
-    digitalWrite(RELAY_PIN, LOW);
+    // Turn off the relays before releasing
+    line.write(0, ~0ULL);
     
-    // Reset pin to input mode (safe state)
-    pinMode(RELAY_PIN, INPUT);
+    // Reset pins to input mode (safe state)
+    line.release();
     
     initialized = false;
-    currentState = false;
+    currentStates = 0;
     std::cout << "Relay resources released" << std::endl;
 }
 
-bool Relay::set(bool state) {
+bool Relay::set(bool state, size_t index) {
+    if (index >= pins.size()) {
+        std::cerr << "No relay " << index << std::endl;
+        return false;
+    }
+    return setMask(state ? 1ULL << index : 0, 1ULL << index);
+}
+
+bool Relay::setMask(uint64_t values, uint64_t mask) {
     if (!initialized) {
         std::cerr << "Relay not initialized" << std::endl;
         return false;
     }
     
-    // Set the relay state
-    digitalWrite(RELAY_PIN, state ? HIGH : LOW);
-    currentState = state;
+    // Set all changed relays in one write
+    mask &= pins.size() >= 64 ? ~0ULL : (1ULL << pins.size()) - 1;
+    if (mask == 0) {
+        return true;
+    }
+    if (!line.write(values, mask)) {
+        std::cerr << "Failed to set relay" << std::endl;
+        return false;
+    }
+    currentStates = (currentStates & ~mask) | (values & mask);
     
-    std::cout << "Relay set to " << (state ? "ON" : "OFF") << std::endl;
+    std::cout << "Relay set to " << formatPattern(currentStates, pins.size()) << std::endl;
     return true;
 }
 
-bool Relay::getState() const {
-    return currentState;
-}
\ No newline at end of file
+bool Relay::getState(size_t index) const {
+    return index < pins.size() && ((currentStates >> index) & 1) != 0;
+}
+
+uint64_t Relay::getStates() const {
+    return currentStates;
+}
+
+size_t Relay::size() const {
+    return pins.size();
+}
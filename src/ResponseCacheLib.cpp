@@ -0,0 +1,89 @@
+#include "../include/ResponseCacheLib.h"
+
+ResponseCache::ResponseCache() {
+    // Every command is uncached until a TTL is configured
+}
+
+void ResponseCache::setTtl(const std::string& command, int ttlMs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ttls[command] = ttlMs;
+    entries.erase(command);
+}
+
+int ResponseCache::getTtl(const std::string& command) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, int>::const_iterator it = ttls.find(command);
+    return it == ttls.end() ? NO_CACHE : it->second;
+}
+
+ResponseCache::Lookup ResponseCache::acquire(const std::string& command, std::string& response,
+                                             const Waiter& waiter) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::map<std::string, int>::const_iterator ttl = ttls.find(command);
+    if (ttl == ttls.end() || ttl->second == NO_CACHE) {
+        return Lookup::BYPASS;
+    }
+
+    Entry& entry = entries[command];
+
+    // Serve a fresh response directly
+    if (entry.valid && (ttl->second == FOREVER || Clock::now() < entry.expires)) {
+        response = entry.response;
+        return Lookup::HIT;
+    }
+
+    // Join a fetch that is already on its way
+    if (entry.inFlight) {
+        entry.waiters.push_back(waiter);
+        return Lookup::PENDING;
+    }
+
+    // This caller becomes responsible for fetching
+    entry.inFlight = true;
+    entry.stale = false;
+    return Lookup::FETCH;
+}
+
+void ResponseCache::complete(const std::string& command, const std::string& response, bool store) {
+    std::vector<Waiter> waiters;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::map<std::string, Entry>::iterator it = entries.find(command);
+        if (it == entries.end()) {
+            return;
+        }
+
+        Entry& entry = it->second;
+        if (store && !entry.stale) {
+            std::map<std::string, int>::const_iterator ttl = ttls.find(command);
+            int ttlMs = ttl == ttls.end() ? NO_CACHE : ttl->second;
+            entry.response = response;
+            entry.expires = Clock::now() + std::chrono::milliseconds(ttlMs > 0 ? ttlMs : 0);
+            entry.valid = true;
+        }
+        entry.inFlight = false;
+        entry.stale = false;
+        waiters.swap(entry.waiters);
+    }
+
+    // Call waiters outside the lock so they may use the cache again
+    for (size_t i = 0; i < waiters.size(); i++) {
+        waiters[i](response);
+    }
+}
+
+void ResponseCache::invalidate(const std::string& command) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::map<std::string, Entry>::iterator it = entries.find(command);
+    if (it == entries.end()) {
+        return;
+    }
+
+    it->second.valid = false;
+    if (it->second.inFlight) {
+        it->second.stale = true;
+    }
+}
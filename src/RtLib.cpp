@@ -0,0 +1,162 @@
+#include "../include/RtLib.h"
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+namespace {
+    // Shortest period of a PeriodicTimer; a period of 0 or less has no next deadline
+    const int64_t MIN_PERIOD_US = 1;
+}
+
+namespace Rt {
+
+    bool configureProcess(const RtConfig& config) {
+        if (config.priority <= 0) {
+            return true;
+        }
+
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            std::cerr << "Failed to lock memory: " << strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool configureThread(const RtConfig& config, const std::string& name) {
+        pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+        bool ok = true;
+
+        if (config.cpu >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(config.cpu, &cpus);
+            int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+            if (result != 0) {
+                std::cerr << "Failed to pin " << name << " to CPU " << config.cpu << ": "
+                          << strerror(result) << std::endl;
+                ok = false;
+            }
+        }
+
+        if (config.priority > 0) {
+            struct sched_param param;
+            memset(&param, 0, sizeof(param));
+            param.sched_priority = config.priority;
+            int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (result != 0) {
+                // Usually missing privileges; the thread keeps running at normal priority
+                std::cerr << "Failed to set SCHED_FIFO priority " << config.priority << " for " << name
+                          << ": " << strerror(result) << std::endl;
+                ok = false;
+            }
+        }
+        return ok;
+    }
+
+    uint64_t monotonicNs() {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+    }
+
+    bool parseOption(const std::string& option, const std::string& value, RtConfig& config) {
+        char* end = NULL;
+        long number = std::strtol(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0') {
+            return false;
+        }
+
+        if (option == "--rt-priority" && number >= 1 && number <= 99) {
+            config.priority = static_cast<int>(number);
+            return true;
+        }
+        if (option == "--rt-cpu" && number >= 0 && number < sysconf(_SC_NPROCESSORS_CONF)) {
+            config.cpu = static_cast<int>(number);
+            return true;
+        }
+        return false;
+    }
+
+}
+
+const int64_t JitterHistogram::BOUNDS_US[JitterHistogram::BUCKETS - 1] = {
+    10, 20, 50, 100, 200, 500, 1000, 2000, 5000
+};
+
+JitterHistogram::JitterHistogram() : count(0), overruns(0), maxNs(0) {
+    for (int i = 0; i < BUCKETS; i++) {
+        buckets[i] = 0;
+    }
+}
+
+void JitterHistogram::record(int64_t latenessNs) {
+    if (latenessNs < 0) {
+        latenessNs = 0;
+    }
+
+    int bucket = 0;
+    while (bucket < BUCKETS - 1 && latenessNs >= BOUNDS_US[bucket] * 1000) {
+        bucket++;
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+
+    int64_t previous = maxNs.load(std::memory_order_relaxed);
+    while (latenessNs > previous && !maxNs.compare_exchange_weak(previous, latenessNs, std::memory_order_relaxed)) {
+    }
+}
+
+void JitterHistogram::recordOverruns(uint64_t missed) {
+    overruns.fetch_add(missed, std::memory_order_relaxed);
+}
+
+std::string JitterHistogram::format() const {
+    std::ostringstream out;
+    out << count.load(std::memory_order_relaxed) << " " << maxNs.load(std::memory_order_relaxed) / 1000 << " "
+        << overruns.load(std::memory_order_relaxed);
+    for (int i = 0; i < BUCKETS; i++) {
+        out << " " << buckets[i].load(std::memory_order_relaxed);
+    }
+    return out.str();
+}
+
+PeriodicTimer::PeriodicTimer(int64_t periodUs, JitterHistogram* histogram)
+    : periodNs(std::max(periodUs, MIN_PERIOD_US) * 1000), deadlineNs(static_cast<int64_t>(Rt::monotonicNs())),
+      histogram(histogram) {
+}
+
+void PeriodicTimer::wait() {
+    deadlineNs += periodNs;
+
+    struct timespec deadline;
+    deadline.tv_sec = static_cast<time_t>(deadlineNs / 1000000000);
+    deadline.tv_nsec = static_cast<long>(deadlineNs % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+    }
+
+    int64_t latenessNs = static_cast<int64_t>(Rt::monotonicNs()) - deadlineNs;
+    if (histogram != NULL) {
+        histogram->record(latenessNs);
+    }
+
+    // Skip the deadlines that already passed instead of running them back to back
+    if (latenessNs >= periodNs) {
+        int64_t missed = latenessNs / periodNs;
+        deadlineNs += missed * periodNs;
+        if (histogram != NULL) {
+            histogram->recordOverruns(static_cast<uint64_t>(missed));
+        }
+    }
+}
+
+void PeriodicTimer::setPeriod(int64_t periodUs) {
+    periodNs = std::max(periodUs, MIN_PERIOD_US) * 1000;
+    deadlineNs = static_cast<int64_t>(Rt::monotonicNs());
+}
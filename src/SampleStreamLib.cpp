@@ -0,0 +1,182 @@
+#include "../include/SampleStreamLib.h"
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+namespace {
+    const uint8_t VERSION = 2;
+
+    // Blocks without frame times
+    const uint8_t VERSION_UNTIMED = 1;
+
+    void putVarint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out += static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    bool getVarint(const std::string& in, size_t& pos, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 70 && pos < in.size(); shift += 7) {
+            uint8_t byte = static_cast<uint8_t>(in[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool getVarint(const std::string& in, size_t& pos, uint32_t& value) {
+        uint64_t wide;
+        if (!getVarint(in, pos, wide) || wide > UINT32_MAX) {
+            return false;
+        }
+        value = static_cast<uint32_t>(wide);
+        return true;
+    }
+
+    // Map small negative and positive numbers to small unsigned ones: 0, -1, 1, -2 ... -> 0, 1, 2, 3 ...
+    uint32_t zigZag(int16_t value) {
+        return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 15);
+    }
+
+    int16_t unZigZag(uint32_t value) {
+        return static_cast<int16_t>((value >> 1) ^ (~(value & 1) + 1));
+    }
+}
+
+SampleEncoder::SampleEncoder(uint32_t keyframeInterval)
+    : keyframeInterval(keyframeInterval > 0 ? keyframeInterval : 1), sequence(0), blockStart(0),
+      blockStartNs(0), previousUs(0), count(0) {
+    std::memset(previous, 0, sizeof(previous));
+}
+
+void SampleEncoder::add(const int16_t raw[IMU_RAW_VALUES], uint64_t timestampNs) {
+    if (count == 0) {
+        blockStart = sequence;
+        blockStartNs = timestampNs;
+        previousUs = 0;
+    }
+
+    // Times are kept relative to the block start, so rounding to microseconds does not add up
+    uint64_t sinceStartUs = timestampNs > blockStartNs ? (timestampNs - blockStartNs) / 1000 : 0;
+    putVarint(body, sinceStartUs > previousUs ? sinceStartUs - previousUs : 0);
+    previousUs = std::max(previousUs, sinceStartUs);
+
+    bool keyframe = (sequence % keyframeInterval == 0);
+    for (int i = 0; i < IMU_RAW_VALUES; i++) {
+        // The difference wraps like the 16-bit values, so it always fits in an int16_t
+        int16_t value = keyframe ? raw[i] : static_cast<int16_t>(static_cast<uint16_t>(raw[i] - previous[i]));
+        putVarint(body, zigZag(value));
+        previous[i] = raw[i];
+    }
+
+    sequence++;
+    count++;
+}
+
+size_t SampleEncoder::size() const {
+    return count;
+}
+
+std::string SampleEncoder::flush() {
+    std::string block(1, static_cast<char>(VERSION));
+    putVarint(block, blockStart);
+    putVarint(block, keyframeInterval);
+    putVarint(block, static_cast<uint32_t>(count));
+    putVarint(block, blockStartNs);
+    block += body;
+
+    body.clear();
+    count = 0;
+    return block;
+}
+
+SampleDecoder::SampleDecoder() {
+    reset();
+}
+
+bool SampleDecoder::decode(const std::string& block, std::vector<ImuRawFrame>& frames) {
+    size_t pos = 1;
+    uint32_t first, interval, count;
+    uint64_t startNs = 0;
+    bool timed = !block.empty() && static_cast<uint8_t>(block[0]) == VERSION;
+    if (block.empty() || (!timed && static_cast<uint8_t>(block[0]) != VERSION_UNTIMED) ||
+        !getVarint(block, pos, first) || !getVarint(block, pos, interval) ||
+        !getVarint(block, pos, count) || interval == 0 || (timed && !getVarint(block, pos, startNs))) {
+        return false;
+    }
+
+    if (started && first != expected) {
+        // Frames were lost, or the encoder restarted; either way the reference is gone
+        int32_t ahead = static_cast<int32_t>(first - expected);
+        if (ahead > 0) {
+            lost += static_cast<uint32_t>(ahead);
+        }
+        synchronized = false;
+    }
+    started = true;
+
+    uint64_t sinceStartUs = 0;
+    for (uint32_t n = 0; n < count; n++) {
+        uint32_t sequence = first + n;
+        bool keyframe = (sequence % interval == 0);
+
+        ImuRawFrame frame;
+        frame.sequence = sequence;
+        frame.timestampNs = 0;
+        if (timed) {
+            uint64_t deltaUs;
+            if (!getVarint(block, pos, deltaUs)) {
+                synchronized = false;
+                return false;
+            }
+            sinceStartUs += deltaUs;
+            frame.timestampNs = startNs + sinceStartUs * 1000;
+        }
+        for (int i = 0; i < IMU_RAW_VALUES; i++) {
+            uint32_t value;
+            if (!getVarint(block, pos, value)) {
+                synchronized = false;
+                return false;
+            }
+            int16_t decoded = unZigZag(value);
+            frame.values[i] = keyframe ? decoded
+                                       : static_cast<int16_t>(static_cast<uint16_t>(previous[i] + decoded));
+        }
+        expected = sequence + 1;
+
+        if (keyframe) {
+            synchronized = true;
+        }
+        if (!synchronized) {
+            skipped++;
+            continue;
+        }
+
+        std::memcpy(previous, frame.values, sizeof(previous));
+        frames.push_back(frame);
+    }
+
+    return pos == block.size();
+}
+
+uint64_t SampleDecoder::getLost() const {
+    return lost;
+}
+
+uint64_t SampleDecoder::getSkipped() const {
+    return skipped;
+}
+
+void SampleDecoder::reset() {
+    synchronized = false;
+    started = false;
+    expected = 0;
+    lost = 0;
+    skipped = 0;
+    std::memset(previous, 0, sizeof(previous));
+}
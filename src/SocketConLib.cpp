@@ -1,4 +1,6 @@
 #include "../include/SocketConLib.h"
+#include "../include/EventLoopLib.h"
+#include "../include/CaptureLib.h"
 #include <iostream>
 #include <cstring>
 #include <unistd.h>
@@ -6,20 +8,75 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <sys/uio.h>
+#include <climits>
+#include <cstdlib>
+#include <netinet/tcp.h>
+#include <linux/errqueue.h>
+#include <deque>
+#include <utility>
+
+struct SocketCon::Mailbox {
+    std::deque<std::string> messages;
+    std::deque<std::unique_ptr<SocketCon> > clients;
+    bool started = false;
+    bool closed = false;
+    std::coroutine_handle<> waiter;
+    
+    // Resume the coroutine waiting for a message or client, if any
+    void wake() {
+        if (waiter) {
+            std::exchange(waiter, std::coroutine_handle<>()).resume();
+        }
+    }
+};
+
+struct SocketCon::SendAwaiter::State {
+    bool done = false;
+    bool ok = false;
+    bool suspended = false;
+    std::coroutine_handle<> handle;
+};
 
 SocketCon::SocketCon(Mode mode, const std::string& host, int port) 
-    : mode(mode), host(host), port(port), sockfd(-1), clientfd(-1), connected(false) {
+    : sockfd(-1), clientfd(-1), mode(mode), host(host), port(port), connected(false),
+      zeroCopyEnabled(false), zeroCopySent(0), zeroCopyDone(0), eventLoop(NULL), capture(NULL), captureId(0) {
     // Constructor implementation
 }
 
+SocketCon::SocketCon(int fd) 
+    : sockfd(-1), clientfd(fd), mode(Mode::SERVER), host(""), port(0), connected(true),
+      zeroCopyEnabled(false), zeroCopySent(0), zeroCopyDone(0), eventLoop(NULL), capture(NULL), captureId(0) {
+    // Connection accepted by a listening SocketCon
+    configureConnection();
+}
+
 SocketCon::~SocketCon() {
-    // Clean up if connected
-    if (connected) {
-        release();
-    }
+    // Clean up, including connections already closed by the peer
+    release();
 }
 
-bool SocketCon::init() {
+void SocketCon::configureConnection() {
+    rxBuffer.clear();
+    zeroCopySent = 0;
+    zeroCopyDone = 0;
+    
+    // Request/response traffic must not wait for Nagle's algorithm
+    setNoDelay(true);
+    
+#ifdef SO_ZEROCOPY
+    // Allow MSG_ZEROCOPY for large messages if the kernel supports it
+    int opt = 1;
+    zeroCopyEnabled = (setsockopt(clientfd, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt)) == 0);
+#endif
+}
+
+bool SocketCon::openListener() {
     // Create socket
     sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd < 0) {
@@ -36,39 +93,46 @@ bool SocketCon::init() {
         return false;
     }
     
+    // Bind the socket to the specified port
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+    
+    if (bind(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        std::cerr << "Failed to bind socket to port " << port << std::endl;
+        close(sockfd);
+        sockfd = -1;
+        return false;
+    }
+    
+    // Listen for incoming connections
+    if (::listen(sockfd, 5) < 0) {
+        std::cerr << "Failed to listen on socket" << std::endl;
+        close(sockfd);
+        sockfd = -1;
+        return false;
+    }
+    
+    std::cout << "Server listening on port " << port << std::endl;
+    return true;
+}
+
+bool SocketCon::init() {
     // Handle SERVER or CLIENT mode
     if (mode == Mode::SERVER) {
-        // Bind the socket to the specified port
-        struct sockaddr_in server_addr;
-        memset(&server_addr, 0, sizeof(server_addr));
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_addr.s_addr = INADDR_ANY;
-        server_addr.sin_port = htons(port);
-        
-        if (bind(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-            std::cerr << "Failed to bind socket to port " << port << std::endl;
-            close(sockfd);
-            sockfd = -1;
+        if (!openListener()) {
             return false;
         }
         
-        // Listen for incoming connections
-        if (listen(sockfd, 5) < 0) {
-            std::cerr << "Failed to listen on socket" << std::endl;
-            close(sockfd);
-            sockfd = -1;
-            return false;
-        }
-        
-        std::cout << "Server listening on port " << port << std::endl;
-        
         // Accept the first incoming connection
         struct sockaddr_in client_addr;
         socklen_t client_len = sizeof(client_addr);
         
         std::cout << "Waiting for client connection..." << std::endl;
         
-        clientfd = accept(sockfd, (struct sockaddr *)&client_addr, &client_len);
+        clientfd = ::accept(sockfd, (struct sockaddr *)&client_addr, &client_len);
         if (clientfd < 0) {
             std::cerr << "Failed to accept client connection" << std::endl;
             close(sockfd);
@@ -77,8 +141,16 @@ bool SocketCon::init() {
         }
         
         std::cout << "Client connected from " << inet_ntoa(client_addr.sin_addr) << ":" << ntohs(client_addr.sin_port) << std::endl;
+        configureConnection();
         
     } else if (mode == Mode::CLIENT) {
+        // Create socket
+        sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (sockfd < 0) {
+            std::cerr << "Failed to create socket" << std::endl;
+            return false;
+        }
+        
         // Connect to the server
         struct sockaddr_in server_addr;
         memset(&server_addr, 0, sizeof(server_addr));
@@ -88,7 +160,7 @@ bool SocketCon::init() {
         
         std::cout << "Connecting to server at " << host << ":" << port << std::endl;
         
-        if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        if (::connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
             std::cerr << "Failed to connect to server at " << host << ":" << port << std::endl;
             close(sockfd);
             sockfd = -1;
@@ -99,22 +171,160 @@ bool SocketCon::init() {
         
         // Use sockfd as the client file descriptor in client mode
         clientfd = sockfd;
+        configureConnection();
+    }
+    
+    connected = true;
+    return true;
+}
+
+bool SocketCon::listen() {
+    if (mode != Mode::SERVER) {
+        std::cerr << "listen() is only available in SERVER mode" << std::endl;
+        return false;
+    }
+    
+    if (!openListener()) {
+        return false;
     }
     
     connected = true;
     return true;
 }
 
+bool SocketCon::tryConnect(int timeoutMs) {
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) {
+        std::cerr << "Failed to create socket" << std::endl;
+        return false;
+    }
+    
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = inet_addr(host.c_str());
+    server_addr.sin_port = htons(port);
+    
+    // Connect without blocking so the handshake can be bounded by the timeout
+    int flags = fcntl(sockfd, F_GETFL, 0);
+    fcntl(sockfd, F_SETFL, flags | O_NONBLOCK);
+    
+    int result = ::connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr));
+    if (result < 0 && errno == EINPROGRESS) {
+        struct pollfd pfd;
+        pfd.fd = sockfd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        
+        int error = ETIMEDOUT;
+        socklen_t len = sizeof(error);
+        if (poll(&pfd, 1, timeoutMs) > 0) {
+            getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &len);
+        }
+        result = (error == 0) ? 0 : -1;
+    }
+    
+    if (result < 0) {
+        close(sockfd);
+        sockfd = -1;
+        return false;
+    }
+    
+    // Back to blocking mode for send() and receive()
+    fcntl(sockfd, F_SETFL, flags);
+    return true;
+}
+
+bool SocketCon::connect(int timeoutMs) {
+    if (mode != Mode::CLIENT) {
+        std::cerr << "connect() is only available in CLIENT mode" << std::endl;
+        return false;
+    }
+    
+    if (connected) {
+        return true;
+    }
+    
+    const auto start = std::chrono::steady_clock::now();
+    int backoffMs = 20;
+    
+    while (true) {
+        // Limit each attempt to the time that is left
+        int remainingMs = -1;
+        if (timeoutMs >= 0) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            remainingMs = timeoutMs - static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count());
+            if (remainingMs <= 0) {
+                break;
+            }
+        }
+        
+        if (tryConnect(remainingMs)) {
+            // Use sockfd as the client file descriptor in client mode
+            clientfd = sockfd;
+            configureConnection();
+            connected = true;
+            std::cout << "Connected to server at " << host << ":" << port << std::endl;
+            return true;
+        }
+        
+        // The server is not up yet; wait a little longer each time
+        int sleepMs = (remainingMs < 0) ? backoffMs : std::min(backoffMs, remainingMs);
+        std::this_thread::sleep_for(std::chrono::milliseconds(sleepMs));
+        backoffMs = std::min(backoffMs * 2, 500);
+    }
+    
+    return false;
+}
+
+std::unique_ptr<SocketCon> SocketCon::accept(int timeoutMs) {
+    if (mode != Mode::SERVER || sockfd < 0) {
+        std::cerr << "Socket not listening" << std::endl;
+        return nullptr;
+    }
+    
+    // Wait for a pending connection so callers can check for shutdown in between
+    struct pollfd pfd;
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, timeoutMs) <= 0) {
+        return nullptr;
+    }
+    
+    struct sockaddr_in client_addr;
+    socklen_t client_len = sizeof(client_addr);
+    
+    int fd = ::accept(sockfd, (struct sockaddr *)&client_addr, &client_len);
+    if (fd < 0) {
+        std::cerr << "Failed to accept client connection" << std::endl;
+        return nullptr;
+    }
+    
+    std::cout << "Client connected from " << inet_ntoa(client_addr.sin_addr) << ":" << ntohs(client_addr.sin_port) << std::endl;
+    
+    return std::unique_ptr<SocketCon>(new SocketCon(fd));
+}
+
+void SocketCon::shutdown() {
+    if (clientfd >= 0) {
+        ::shutdown(clientfd, SHUT_RDWR);
+    }
+}
+
 void SocketCon::release() {
-    if (!connected) {
+    if (sockfd < 0 && clientfd < 0) {
         return;
     }
     
+    // The loop must forget the descriptors before they are closed and reused
+    removeFromLoop();
+    
     // Close client socket if in server mode
     if (mode == Mode::SERVER && clientfd >= 0 && clientfd != sockfd) {
         close(clientfd);
-        clientfd = -1;
     }
+    clientfd = -1;
     
     // Close server socket
     if (sockfd >= 0) {
@@ -124,33 +334,190 @@ void SocketCon::release() {
     
     connected = false;
     std::cout << "Socket connection closed" << std::endl;
+    
+    if (capture != NULL) {
+        capture->record(captureId, CaptureRecord::Type::CLOSE, "");
+        capture = NULL;
+    }
+    
+    // Last, since the woken coroutine may destroy this socket
+    wakeWaiters();
 }
 
 bool SocketCon::send(const std::string& message) {
+    Segment segment = { message.data(), message.size() };
+    return sendv(std::vector<Segment>(1, segment));
+}
+
+bool SocketCon::sendv(const std::vector<Segment>& segments) {
     if (!connected || clientfd < 0) {
         std::cerr << "Socket not connected" << std::endl;
         return false;
     }
     
-    ssize_t bytes_sent = write(clientfd, message.c_str(), message.length());
-    if (bytes_sent < 0) {
-        std::cerr << "Failed to send message" << std::endl;
+    size_t total = 0;
+    for (size_t i = 0; i < segments.size(); i++) {
+        total += segments[i].length;
+    }
+    if (total > MAX_MESSAGE_SIZE) {
+        std::cerr << "Message too large to send" << std::endl;
+        return false;
+    }
+    
+    if (capture != NULL) {
+        // Only the recording needs the message in one piece
+        std::string message;
+        message.reserve(total);
+        for (size_t i = 0; i < segments.size(); i++) {
+            message.append(static_cast<const char*>(segments[i].data), segments[i].length);
+        }
+        capture->record(captureId, CaptureRecord::Type::SENT, message);
+    }
+    
+    // Frame header: payload length in network byte order
+    uint32_t length = htonl(static_cast<uint32_t>(total));
+    std::vector<struct iovec> iov;
+    iov.reserve(segments.size() + 1);
+    struct iovec header = { &length, HEADER_SIZE };
+    iov.push_back(header);
+    for (size_t i = 0; i < segments.size(); i++) {
+        if (segments[i].length > 0) {
+            struct iovec entry = { const_cast<void*>(segments[i].data), segments[i].length };
+            iov.push_back(entry);
+        }
+    }
+    
+    int flags = MSG_NOSIGNAL;
+#ifdef MSG_ZEROCOPY
+    bool zeroCopy = zeroCopyEnabled && total >= ZEROCOPY_THRESHOLD;
+    if (zeroCopy) {
+        flags |= MSG_ZEROCOPY;
+    }
+#else
+    bool zeroCopy = false;
+#endif
+    
+    // Keep going until every byte is out, resuming after partial writes
+    size_t first = 0;
+    while (first < iov.size()) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov[first];
+        msg.msg_iovlen = std::min(iov.size() - first, static_cast<size_t>(IOV_MAX));
+        
+        ssize_t sent = sendmsg(clientfd, &msg, flags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+#ifdef MSG_ZEROCOPY
+            if (errno == ENOBUFS && zeroCopy) {
+                // The completion notifications use up the socket's option memory, and only
+                // reading them frees it; waiting for POLLOUT would spin. Reap the completions of
+                // the parts already sent, or copy the rest if there are none
+                if (zeroCopyDone == zeroCopySent || !reapZeroCopy()) {
+                    flags &= ~MSG_ZEROCOPY;
+                    zeroCopy = false;
+                }
+                continue;
+            }
+#endif
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                // Wait until the socket can take more data
+                struct pollfd pfd;
+                pfd.fd = clientfd;
+                pfd.events = POLLOUT;
+                pfd.revents = 0;
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            std::cerr << "Failed to send message" << std::endl;
+            return false;
+        }
+        
+        if (zeroCopy && sent > 0) {
+            zeroCopySent++;
+        }
+        
+        // Skip the fully written segments and trim the partially written one
+        size_t remaining = static_cast<size_t>(sent);
+        while (first < iov.size() && remaining >= iov[first].iov_len) {
+            remaining -= iov[first].iov_len;
+            first++;
+        }
+        if (first < iov.size()) {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + remaining;
+            iov[first].iov_len -= remaining;
+        }
+    }
+    
+    // The caller owns the segments, so hand them back only once the kernel is done with them
+    if (zeroCopyDone != zeroCopySent && !reapZeroCopy()) {
+        std::cerr << "Failed to complete zero-copy send" << std::endl;
         return false;
     }
     
     return true;
 }
 
-bool SocketCon::receive(std::string& message) {
-    if (!connected || clientfd < 0) {
-        std::cerr << "Socket not connected" << std::endl;
-        return false;
+bool SocketCon::reapZeroCopy() {
+#ifdef MSG_ZEROCOPY
+    while (zeroCopyDone != zeroCopySent) {
+        // Completions arrive on the error queue, which poll() reports as POLLERR
+        struct pollfd pfd;
+        pfd.fd = clientfd;
+        pfd.events = 0;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            return false;
+        }
+        
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        
+        if (recvmsg(clientfd, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err* err = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cm));
+            if (err->ee_errno == 0 && err->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                // ee_data is the id of the last completed send in this notification
+                zeroCopyDone = err->ee_data + 1;
+            }
+        }
     }
+#endif
+    return true;
+}
+
+bool SocketCon::setNoDelay(bool enable) {
+    int opt = enable ? 1 : 0;
+    return clientfd >= 0 && setsockopt(clientfd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) == 0;
+}
+
+bool SocketCon::setCork(bool enable) {
+    int opt = enable ? 1 : 0;
+    return clientfd >= 0 && setsockopt(clientfd, IPPROTO_TCP, TCP_CORK, &opt, sizeof(opt)) == 0;
+}
+
+bool SocketCon::fillBuffer(size_t count) {
+    size_t used = rxBuffer.size();
+    rxBuffer.resize(used + count);
+    
+    ssize_t bytes_received;
+    do {
+        bytes_received = read(clientfd, &rxBuffer[used], count);
+    } while (bytes_received < 0 && errno == EINTR);
     
-    char buffer[BUFFER_SIZE];
-    memset(buffer, 0, BUFFER_SIZE);
+    rxBuffer.resize(used + (bytes_received > 0 ? bytes_received : 0));
     
-    ssize_t bytes_received = read(clientfd, buffer, BUFFER_SIZE - 1);
     if (bytes_received < 0) {
         std::cerr << "Failed to receive message" << std::endl;
         return false;
@@ -161,15 +528,320 @@ bool SocketCon::receive(std::string& message) {
         return false;
     }
     
-    // Ensure null termination
-    buffer[bytes_received] = '\0';
+    return true;
+}
+
+bool SocketCon::peekFrame(uint32_t& length) const {
+    if (rxBuffer.size() < HEADER_SIZE) {
+        return false;
+    }
+    memcpy(&length, rxBuffer.data(), HEADER_SIZE);
+    length = ntohl(length);
+    return true;
+}
+
+bool SocketCon::receive(std::string& message) {
+    if (!connected || clientfd < 0) {
+        std::cerr << "Socket not connected" << std::endl;
+        return false;
+    }
+    
+    // Read the frame header; one read usually brings the whole frame along
+    uint32_t length;
+    while (!peekFrame(length)) {
+        if (!fillBuffer(BUFFER_SIZE)) {
+            return false;
+        }
+    }
+    
+    if (length > MAX_MESSAGE_SIZE) {
+        std::cerr << "Received frame too large" << std::endl;
+        return false;
+    }
+    
+    // Read the rest of the payload, in one go for large messages
+    size_t frameSize = HEADER_SIZE + length;
+    while (rxBuffer.size() < frameSize) {
+        if (!fillBuffer(std::max(static_cast<size_t>(BUFFER_SIZE), frameSize - rxBuffer.size()))) {
+            return false;
+        }
+    }
     
-    // Update the output parameter
-    message = std::string(buffer);
+    // Update the output parameter and keep any bytes of the next frame
+    message.assign(rxBuffer, HEADER_SIZE, length);
+    rxBuffer.erase(0, frameSize);
+    
+    if (capture != NULL) {
+        capture->record(captureId, CaptureRecord::Type::RECEIVED, message);
+    }
     
     return true;
 }
 
 bool SocketCon::isConnected() const {
     return connected;
+}
+
+void SocketCon::setCapture(CaptureWriter* writer, const std::string& label) {
+    capture = writer;
+    captureId = (writer != NULL) ? writer->openConnection(label) : 0;
+}
+
+bool SocketCon::attach(EventLoop& target) {
+    if (eventLoop != NULL && eventLoop != &target) {
+        std::cerr << "Socket already attached to another event loop" << std::endl;
+        return false;
+    }
+    if (eventLoop == NULL) {
+        eventLoop = &target;
+        attached = std::make_shared<bool>(true);
+    }
+    return true;
+}
+
+void SocketCon::detach() {
+    removeFromLoop();
+    wakeWaiters();
+}
+
+void SocketCon::removeFromLoop() {
+    if (eventLoop == NULL) {
+        return;
+    }
+    if (clientfd >= 0) {
+        std::vector<SendHandler> dropped = eventLoop->remove(clientfd);
+        unsent.insert(unsent.end(), dropped.begin(), dropped.end());
+    }
+    if (sockfd >= 0 && sockfd != clientfd) {
+        eventLoop->remove(sockfd);
+    }
+    *attached = false;
+    attached.reset();
+    eventLoop = NULL;
+}
+
+void SocketCon::wakeWaiters() {
+    // Anything woken may destroy this socket, so work on local copies only
+    std::vector<SendHandler> failed;
+    failed.swap(unsent);
+    
+    // A coroutine still waiting on this socket gets false or nullptr
+    if (mailbox && !mailbox->closed) {
+        std::shared_ptr<Mailbox> box = mailbox;
+        box->closed = true;
+        box->wake();
+    }
+    
+    for (size_t i = 0; i < failed.size(); i++) {
+        failed[i](false);
+    }
+}
+
+void SocketCon::receiveAsync(EventLoop& loop, const MessageHandler& handler) {
+    if (!connected || clientfd < 0 || !attach(loop)) {
+        handler(false, "");
+        return;
+    }
+    
+    std::shared_ptr<bool> alive = attached;
+    EventLoop::DataHandler onData = [this, alive, handler](const char* data, size_t length) {
+        if (length == 0) {
+            connected = false;
+            handler(false, "");
+            return;
+        }
+        rxBuffer.append(data, length);
+        
+        // Hand out every complete frame; the handler may detach or destroy this socket
+        uint32_t payload;
+        while (*alive && peekFrame(payload)) {
+            if (payload > MAX_MESSAGE_SIZE) {
+                std::cerr << "Received frame too large" << std::endl;
+                std::vector<SendHandler> dropped = eventLoop->remove(clientfd);
+                unsent.insert(unsent.end(), dropped.begin(), dropped.end());
+                connected = false;
+                handler(false, "");
+                return;
+            }
+            if (rxBuffer.size() < HEADER_SIZE + payload) {
+                break;
+            }
+            std::string message(rxBuffer, HEADER_SIZE, payload);
+            rxBuffer.erase(0, HEADER_SIZE + payload);
+            if (capture != NULL) {
+                capture->record(captureId, CaptureRecord::Type::RECEIVED, message);
+            }
+            handler(true, message);
+        }
+    };
+    
+    // Deliver what receive() has already buffered, then wait for more
+    std::string buffered;
+    buffered.swap(rxBuffer);
+    loop.receive(clientfd, onData);
+    if (!buffered.empty()) {
+        onData(buffered.data(), buffered.size());
+    }
+}
+
+void SocketCon::sendAsync(EventLoop& loop, const std::string& message, const SendHandler& handler) {
+    if (!connected || clientfd < 0 || message.size() > MAX_MESSAGE_SIZE || !attach(loop)) {
+        if (handler) {
+            handler(false);
+        }
+        return;
+    }
+    
+    if (capture != NULL) {
+        capture->record(captureId, CaptureRecord::Type::SENT, message);
+    }
+    
+    // Header and payload go to the loop as one buffer
+    uint32_t length = htonl(static_cast<uint32_t>(message.size()));
+    std::string frame(reinterpret_cast<const char*>(&length), HEADER_SIZE);
+    frame += message;
+    loop.send(clientfd, frame, handler);
+}
+
+void SocketCon::acceptAsync(EventLoop& loop, const AcceptHandler& handler) {
+    if (mode != Mode::SERVER || sockfd < 0 || !attach(loop)) {
+        std::cerr << "Socket not listening" << std::endl;
+        handler(nullptr);
+        return;
+    }
+    
+    loop.accept(sockfd, [handler](int fd) {
+        if (fd < 0) {
+            std::cerr << "Failed to accept client connection" << std::endl;
+            handler(nullptr);
+            return;
+        }
+        handler(std::unique_ptr<SocketCon>(new SocketCon(fd)));
+    });
+}
+
+SocketCon::ReceiveAwaiter SocketCon::receive(EventLoop& loop, std::string& message) {
+    return ReceiveAwaiter(*this, loop, message);
+}
+
+SocketCon::SendAwaiter SocketCon::send(EventLoop& loop, const std::string& message) {
+    return SendAwaiter(*this, loop, message);
+}
+
+SocketCon::AcceptAwaiter SocketCon::accept(EventLoop& loop) {
+    return AcceptAwaiter(*this, loop);
+}
+
+SocketCon::ReceiveAwaiter::ReceiveAwaiter(SocketCon& socket, EventLoop& loop, std::string& message)
+    : socket(socket), loop(loop), message(message) {
+}
+
+bool SocketCon::ReceiveAwaiter::await_ready() {
+    if (!socket.mailbox) {
+        socket.mailbox = std::make_shared<Mailbox>();
+    }
+    std::shared_ptr<Mailbox> box = socket.mailbox;
+    
+    // The first receive starts queueing messages for this and later awaits
+    if (!box->started) {
+        box->started = true;
+        socket.receiveAsync(loop, [box](bool ok, const std::string& incoming) {
+            if (ok) {
+                box->messages.push_back(incoming);
+            } else {
+                box->closed = true;
+            }
+            box->wake();
+        });
+    }
+    
+    return !box->messages.empty() || box->closed;
+}
+
+void SocketCon::ReceiveAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    socket.mailbox->waiter = handle;
+}
+
+bool SocketCon::ReceiveAwaiter::await_resume() {
+    Mailbox& box = *socket.mailbox;
+    if (box.messages.empty()) {
+        return false;
+    }
+    message.swap(box.messages.front());
+    box.messages.pop_front();
+    return true;
+}
+
+SocketCon::SendAwaiter::SendAwaiter(SocketCon& socket, EventLoop& loop, const std::string& message)
+    : socket(socket), loop(loop), message(message), state(std::make_shared<State>()) {
+}
+
+bool SocketCon::SendAwaiter::await_ready() {
+    return false;
+}
+
+bool SocketCon::SendAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    state->handle = handle;
+    std::shared_ptr<State> current = state;
+    socket.sendAsync(loop, message, [current](bool ok) {
+        current->ok = ok;
+        current->done = true;
+        if (current->suspended) {
+            current->handle.resume();
+        }
+    });
+    
+    // Keep running if the send already failed
+    if (state->done) {
+        return false;
+    }
+    state->suspended = true;
+    return true;
+}
+
+bool SocketCon::SendAwaiter::await_resume() {
+    return state->ok;
+}
+
+SocketCon::AcceptAwaiter::AcceptAwaiter(SocketCon& socket, EventLoop& loop)
+    : socket(socket), loop(loop) {
+}
+
+bool SocketCon::AcceptAwaiter::await_ready() {
+    if (!socket.mailbox) {
+        socket.mailbox = std::make_shared<Mailbox>();
+    }
+    std::shared_ptr<Mailbox> box = socket.mailbox;
+    
+    if (!box->started) {
+        box->started = true;
+        if (socket.mode != Mode::SERVER || socket.sockfd < 0) {
+            std::cerr << "Socket not listening" << std::endl;
+            box->closed = true;
+        } else {
+            // Failed accepts are reported by acceptAsync() and otherwise skipped
+            socket.acceptAsync(loop, [box](std::unique_ptr<SocketCon> client) {
+                if (client) {
+                    box->clients.push_back(std::move(client));
+                    box->wake();
+                }
+            });
+        }
+    }
+    
+    return !box->clients.empty() || box->closed;
+}
+
+void SocketCon::AcceptAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    socket.mailbox->waiter = handle;
+}
+
+std::unique_ptr<SocketCon> SocketCon::AcceptAwaiter::await_resume() {
+    Mailbox& box = *socket.mailbox;
+    if (box.clients.empty()) {
+        return nullptr;
+    }
+    std::unique_ptr<SocketCon> client = std::move(box.clients.front());
+    box.clients.pop_front();
+    return client;
 }
\ No newline at end of file
@@ -0,0 +1,314 @@
+#include "../include/TelemetryLib.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <random>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+namespace {
+    const uint8_t MAGIC[2] = { 'R', 'T' };
+    const uint8_t VERSION = 1;
+
+    // Bits of the flags byte
+    const uint8_t FLAG_IMU_VALID = 0x01;
+    const uint8_t FLAG_DIGITAL_IO_VALID = 0x02;
+    const uint8_t FLAG_SENSOR_ON = 0x04;
+    const uint8_t FLAG_RELAY_ON = 0x08;
+
+    void put32(uint8_t* p, uint32_t value) {
+        p[0] = static_cast<uint8_t>(value >> 24);
+        p[1] = static_cast<uint8_t>(value >> 16);
+        p[2] = static_cast<uint8_t>(value >> 8);
+        p[3] = static_cast<uint8_t>(value);
+    }
+
+    uint32_t get32(const uint8_t* p) {
+        return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+               (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+    }
+
+    void putFloat(uint8_t* p, float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        put32(p, bits);
+    }
+
+    float getFloat(const uint8_t* p) {
+        uint32_t bits = get32(p);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // Fill in an IPv4 address; an empty string means any interface
+    bool parseAddress(const std::string& text, struct in_addr& address) {
+        if (text.empty()) {
+            address.s_addr = htonl(INADDR_ANY);
+            return true;
+        }
+        return inet_pton(AF_INET, text.c_str(), &address) == 1;
+    }
+}
+
+namespace Telemetry {
+    void encode(const TelemetryFrame& frame, uint8_t* buffer) {
+        uint8_t flags = 0;
+        if (frame.imuValid) flags |= FLAG_IMU_VALID;
+        if (frame.digitalIOValid) flags |= FLAG_DIGITAL_IO_VALID;
+        if (frame.sensorOn) flags |= FLAG_SENSOR_ON;
+        if (frame.relayOn) flags |= FLAG_RELAY_ON;
+
+        buffer[0] = MAGIC[0];
+        buffer[1] = MAGIC[1];
+        buffer[2] = VERSION;
+        buffer[3] = flags;
+        put32(buffer + 4, frame.source);
+        put32(buffer + 8, frame.sequence);
+        put32(buffer + 12, static_cast<uint32_t>(frame.timestampMs >> 32));
+        put32(buffer + 16, static_cast<uint32_t>(frame.timestampMs));
+        for (int i = 0; i < 3; i++) {
+            putFloat(buffer + 20 + 4 * i, frame.gyro[i]);
+            putFloat(buffer + 32 + 4 * i, frame.acc[i]);
+        }
+        putFloat(buffer + 44, frame.temperature);
+    }
+
+    bool decode(const uint8_t* buffer, size_t size, TelemetryFrame& frame) {
+        if (size < FRAME_SIZE || buffer[0] != MAGIC[0] || buffer[1] != MAGIC[1] || buffer[2] != VERSION) {
+            return false;
+        }
+
+        uint8_t flags = buffer[3];
+        frame.imuValid = (flags & FLAG_IMU_VALID) != 0;
+        frame.digitalIOValid = (flags & FLAG_DIGITAL_IO_VALID) != 0;
+        frame.sensorOn = (flags & FLAG_SENSOR_ON) != 0;
+        frame.relayOn = (flags & FLAG_RELAY_ON) != 0;
+        frame.source = get32(buffer + 4);
+        frame.sequence = get32(buffer + 8);
+        frame.timestampMs = (static_cast<uint64_t>(get32(buffer + 12)) << 32) | get32(buffer + 16);
+        for (int i = 0; i < 3; i++) {
+            frame.gyro[i] = getFloat(buffer + 20 + 4 * i);
+            frame.acc[i] = getFloat(buffer + 32 + 4 * i);
+        }
+        frame.temperature = getFloat(buffer + 44);
+        return true;
+    }
+}
+
+TelemetryPublisher::TelemetryPublisher(const std::string& group, int port, const std::string& interfaceAddress)
+    : group(group), port(port), interfaceAddress(interfaceAddress), sockfd(-1), source(0), nextSequence(0) {
+    std::memset(&destination, 0, sizeof(destination));
+}
+
+TelemetryPublisher::~TelemetryPublisher() {
+    release();
+}
+
+bool TelemetryPublisher::init(int ttl) {
+    release();
+
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(port);
+    if (inet_pton(AF_INET, group.c_str(), &destination.sin_addr) != 1 ||
+        !IN_MULTICAST(ntohl(destination.sin_addr.s_addr))) {
+        std::cerr << "Invalid multicast group " << group << std::endl;
+        return false;
+    }
+
+    struct in_addr interface;
+    if (!parseAddress(interfaceAddress, interface)) {
+        std::cerr << "Invalid interface address " << interfaceAddress << std::endl;
+        return false;
+    }
+
+    sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        std::cerr << "Failed to create socket" << std::endl;
+        return false;
+    }
+
+    // Monitors running on this host receive the frames too
+    unsigned char hops = static_cast<unsigned char>(ttl);
+    unsigned char loop = 1;
+    if (setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops)) < 0 ||
+        setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0 ||
+        (!interfaceAddress.empty() &&
+         setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) < 0)) {
+        std::cerr << "Failed to set socket options" << std::endl;
+        release();
+        return false;
+    }
+
+    // A fresh id lets receivers tell a restart from a jump in the sequence
+    std::random_device random;
+    source = random();
+    nextSequence = 0;
+    return true;
+}
+
+bool TelemetryPublisher::publish(TelemetryFrame& frame) {
+    if (sockfd < 0) {
+        return false;
+    }
+
+    frame.source = source;
+    frame.sequence = nextSequence++;
+
+    uint8_t buffer[Telemetry::FRAME_SIZE];
+    Telemetry::encode(frame, buffer);
+
+    // A frame that cannot go out now is lost; receivers see the gap
+    return sendto(sockfd, buffer, sizeof(buffer), 0,
+                  reinterpret_cast<struct sockaddr*>(&destination), sizeof(destination)) == sizeof(buffer);
+}
+
+void TelemetryPublisher::release() {
+    if (sockfd >= 0) {
+        close(sockfd);
+        sockfd = -1;
+    }
+}
+
+TelemetryReceiver::TelemetryReceiver(const std::string& group, int port, const std::string& interfaceAddress)
+    : group(group), port(port), interfaceAddress(interfaceAddress), sockfd(-1),
+      synchronized(false), source(0), expected(0), gap(0) {
+}
+
+TelemetryReceiver::~TelemetryReceiver() {
+    release();
+}
+
+bool TelemetryReceiver::init() {
+    release();
+
+    struct ip_mreq membership;
+    if (inet_pton(AF_INET, group.c_str(), &membership.imr_multiaddr) != 1 ||
+        !IN_MULTICAST(ntohl(membership.imr_multiaddr.s_addr))) {
+        std::cerr << "Invalid multicast group " << group << std::endl;
+        return false;
+    }
+    if (!parseAddress(interfaceAddress, membership.imr_interface)) {
+        std::cerr << "Invalid interface address " << interfaceAddress << std::endl;
+        return false;
+    }
+
+    sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        std::cerr << "Failed to create socket" << std::endl;
+        return false;
+    }
+
+    // Several monitors on one host may listen on the same port
+    int opt = 1;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        std::cerr << "Failed to set socket options" << std::endl;
+        release();
+        return false;
+    }
+
+    // Bind to the group address so datagrams for other groups on this port are not delivered
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr = membership.imr_multiaddr;
+    address.sin_port = htons(port);
+    if (bind(sockfd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0) {
+        std::cerr << "Failed to bind socket to port " << port << std::endl;
+        release();
+        return false;
+    }
+
+    if (setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0) {
+        std::cerr << "Failed to join multicast group " << group << std::endl;
+        release();
+        return false;
+    }
+
+    synchronized = false;
+    gap = 0;
+    stats = Stats();
+    return true;
+}
+
+bool TelemetryReceiver::receive(TelemetryFrame& frame, int timeoutMs) {
+    if (sockfd < 0) {
+        return false;
+    }
+
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    while (true) {
+        int waitMs = -1;
+        if (timeoutMs >= 0) {
+            waitMs = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count());
+            if (waitMs < 0) {
+                waitMs = 0;
+            }
+        }
+
+        struct pollfd pfd = { sockfd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, waitMs);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            return false;
+        }
+
+        uint8_t buffer[Telemetry::FRAME_SIZE + 16];
+        ssize_t size = recv(sockfd, buffer, sizeof(buffer), 0);
+        if (size < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            return false;
+        }
+        if (!Telemetry::decode(buffer, static_cast<size_t>(size), frame)) {
+            continue;
+        }
+
+        if (!synchronized || frame.source != source) {
+            // First frame, or the publisher restarted: follow the new sequence
+            if (synchronized) {
+                stats.restarts++;
+            }
+            synchronized = true;
+            source = frame.source;
+            gap = 0;
+        } else {
+            // Serial number arithmetic keeps working when the sequence wraps
+            int32_t ahead = static_cast<int32_t>(frame.sequence - expected);
+            if (ahead < 0) {
+                stats.late++;
+                continue;
+            }
+            gap = static_cast<uint32_t>(ahead);
+            stats.lost += gap;
+        }
+
+        expected = frame.sequence + 1;
+        stats.received++;
+        return true;
+    }
+}
+
+uint32_t TelemetryReceiver::getGap() const {
+    return gap;
+}
+
+TelemetryReceiver::Stats TelemetryReceiver::getStats() const {
+    return stats;
+}
+
+void TelemetryReceiver::release() {
+    if (sockfd >= 0) {
+        close(sockfd);
+        sockfd = -1;
+    }
+}
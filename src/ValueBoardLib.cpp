@@ -0,0 +1,208 @@
+#include "../include/ValueBoardLib.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+namespace {
+    const uint32_t MAGIC = 0x42534352;   // "RCSB"
+    const uint32_t VERSION = 1;
+
+    // Words of the segment header; the record follows it
+    const size_t MAGIC_WORD = 0;
+    const size_t VERSION_WORD = 1;
+    const size_t SIZE_WORD = 2;
+    const size_t SEQUENCE_WORD = 3;
+    const size_t HEADER_WORDS = 4;
+
+    // Retries of a read that keeps overlapping an update; the writer updates in well under a microsecond
+    const int READ_ATTEMPTS = 10000;
+
+    // Retries before the reader yields the CPU, in case it took it from a writer in the middle of an update
+    const int SPINS_BEFORE_YIELD = 100;
+
+    // Every shared word is accessed atomically, so a read that overlaps an update is not a data race
+    uint32_t loadWord(const uint32_t* word, std::memory_order order) {
+        return std::atomic_ref<uint32_t>(*const_cast<uint32_t*>(word)).load(order);
+    }
+
+    void storeWord(uint32_t* word, uint32_t value, std::memory_order order) {
+        std::atomic_ref<uint32_t>(*word).store(value, order);
+    }
+}
+
+SharedBoard::SharedBoard(const std::string& boardName, size_t recordSize)
+    : name(boardName), size(recordSize), fd(-1), words(NULL) {
+}
+
+SharedBoard::~SharedBoard() {
+    release();
+}
+
+bool SharedBoard::create() {
+    release();
+
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open shared memory " << name << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    // A second writer would break the sequence counter
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+        std::cerr << "Shared memory " << name << " is already written by another process" << std::endl;
+        release();
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size == 0) {
+        return createFresh();
+    }
+    if (!map(PROT_READ | PROT_WRITE)) {
+        // Left by a different version; readers still mapping it keep the old segment
+        release();
+        shm_unlink(name.c_str());
+        fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0 || flock(fd, LOCK_EX | LOCK_NB) < 0) {
+            std::cerr << "Failed to recreate shared memory " << name << ": " << std::strerror(errno) << std::endl;
+            release();
+            return false;
+        }
+        return createFresh();
+    }
+
+    // The previous writer may have stopped in the middle of an update
+    uint32_t sequence = loadWord(&words[SEQUENCE_WORD], std::memory_order_relaxed);
+    if (sequence % 2 != 0) {
+        storeWord(&words[SEQUENCE_WORD], sequence + 1, std::memory_order_release);
+    }
+    return true;
+}
+
+bool SharedBoard::createFresh() {
+    if (ftruncate(fd, HEADER_WORDS * sizeof(uint32_t) + size) < 0) {
+        std::cerr << "Failed to size shared memory " << name << ": " << std::strerror(errno) << std::endl;
+        release();
+        return false;
+    }
+    void* address = mmap(NULL, HEADER_WORDS * sizeof(uint32_t) + size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        std::cerr << "Failed to map shared memory " << name << ": " << std::strerror(errno) << std::endl;
+        release();
+        return false;
+    }
+    words = static_cast<uint32_t*>(address);
+
+    // The new segment is zero-filled; readers accept it once the magic number is in place
+    words[VERSION_WORD] = VERSION;
+    words[SIZE_WORD] = static_cast<uint32_t>(size);
+    storeWord(&words[SEQUENCE_WORD], 0, std::memory_order_relaxed);
+    storeWord(&words[MAGIC_WORD], MAGIC, std::memory_order_release);
+    return true;
+}
+
+bool SharedBoard::open() {
+    release();
+
+    fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = map(PROT_READ);
+
+    // The mapping stays valid without the descriptor
+    close(fd);
+    fd = -1;
+    return ok;
+}
+
+bool SharedBoard::map(int prot) {
+    size_t total = HEADER_WORDS * sizeof(uint32_t) + size;
+    struct stat info;
+    if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) != total) {
+        return false;
+    }
+    void* address = mmap(NULL, total, prot, MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+
+    uint32_t* mapped = static_cast<uint32_t*>(address);
+    if (loadWord(&mapped[MAGIC_WORD], std::memory_order_acquire) != MAGIC ||
+        mapped[VERSION_WORD] != VERSION || mapped[SIZE_WORD] != size) {
+        munmap(address, total);
+        return false;
+    }
+    words = mapped;
+    return true;
+}
+
+bool SharedBoard::isOpen() const {
+    return words != NULL;
+}
+
+void SharedBoard::write(const void* record) {
+    uint32_t* data = words + HEADER_WORDS;
+    const uint8_t* bytes = static_cast<const uint8_t*>(record);
+
+    // Odd while the record changes
+    uint32_t sequence = loadWord(&words[SEQUENCE_WORD], std::memory_order_relaxed);
+    storeWord(&words[SEQUENCE_WORD], sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (size_t i = 0; i < size / sizeof(uint32_t); i++) {
+        uint32_t word;
+        std::memcpy(&word, bytes + i * sizeof(uint32_t), sizeof(word));
+        storeWord(&data[i], word, std::memory_order_relaxed);
+    }
+
+    storeWord(&words[SEQUENCE_WORD], sequence + 2, std::memory_order_release);
+}
+
+bool SharedBoard::read(void* record) const {
+    const uint32_t* data = words + HEADER_WORDS;
+    uint8_t* bytes = static_cast<uint8_t*>(record);
+
+    for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++) {
+        uint32_t before = loadWord(&words[SEQUENCE_WORD], std::memory_order_acquire);
+        if (before == 0) {
+            return false;
+        }
+        if (before % 2 != 0) {
+            if (attempt >= SPINS_BEFORE_YIELD) {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+
+        for (size_t i = 0; i < size / sizeof(uint32_t); i++) {
+            uint32_t word = loadWord(&data[i], std::memory_order_relaxed);
+            std::memcpy(bytes + i * sizeof(uint32_t), &word, sizeof(word));
+        }
+
+        // The copy must be complete before the counter is checked again
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (loadWord(&words[SEQUENCE_WORD], std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SharedBoard::release() {
+    if (words != NULL) {
+        munmap(words, HEADER_WORDS * sizeof(uint32_t) + size);
+        words = NULL;
+    }
+    if (fd >= 0) {
+        // Closing also drops the writer's lock
+        close(fd);
+        fd = -1;
+    }
+}
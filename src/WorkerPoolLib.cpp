@@ -0,0 +1,97 @@
+#include "../include/WorkerPoolLib.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(size_t count) : outstanding(0), stopping(false) {
+    if (count == 0) {
+        count = 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        threads.push_back(std::thread(&WorkerPool::work, this));
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    waitIdle();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+}
+
+void WorkerPool::submit(const std::vector<std::string>& keys, std::function<void()> task) {
+    std::shared_ptr<Job> job(new Job());
+    job->keys = keys;
+    // A key named twice would make the job wait for itself
+    std::sort(job->keys.begin(), job->keys.end());
+    job->keys.erase(std::unique(job->keys.begin(), job->keys.end()), job->keys.end());
+    job->task = task;
+    job->queued = false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    outstanding++;
+    for (size_t i = 0; i < job->keys.size(); i++) {
+        lines[job->keys[i]].push_back(job);
+    }
+    makeReadyIfFirst(job);
+}
+
+void WorkerPool::waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (outstanding > 0) {
+        idle.wait(lock);
+    }
+}
+
+void WorkerPool::makeReadyIfFirst(const std::shared_ptr<Job>& job) {
+    if (job->queued) {
+        return;
+    }
+    for (size_t i = 0; i < job->keys.size(); i++) {
+        if (lines[job->keys[i]].front() != job) {
+            return;
+        }
+    }
+    job->queued = true;
+    ready.push_back(job);
+    wake.notify_one();
+}
+
+void WorkerPool::work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        if (ready.empty()) {
+            if (stopping) {
+                return;
+            }
+            wake.wait(lock);
+            continue;
+        }
+
+        std::shared_ptr<Job> job = ready.front();
+        ready.pop_front();
+
+        lock.unlock();
+        job->task();
+        lock.lock();
+
+        // Let the next job of every key go, unless it still waits for another key
+        for (size_t i = 0; i < job->keys.size(); i++) {
+            std::map<std::string, std::deque<std::shared_ptr<Job> > >::iterator line = lines.find(job->keys[i]);
+            line->second.pop_front();
+            if (line->second.empty()) {
+                lines.erase(line);
+            } else {
+                makeReadyIfFirst(line->second.front());
+            }
+        }
+
+        outstanding--;
+        if (outstanding == 0) {
+            idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,133 @@
+#include "../include/BrokerLib.h"
+#include "TestLib.h"
+#include <vector>
+#include <string>
+
+namespace {
+    std::vector<std::string> drain(const std::shared_ptr<Broker::Subscriber>& subscriber) {
+        std::vector<std::string> messages;
+        std::string message;
+        while (subscriber->next(message)) {
+            messages.push_back(message);
+        }
+        return messages;
+    }
+
+    void testDropOldest() {
+        Broker broker(3);
+        std::shared_ptr<Broker::Subscriber> subscriber = broker.attach(nullptr, nullptr);
+        broker.subscribe(subscriber, "key", Broker::Overflow::DROP_OLDEST);
+        broker.subscribe(subscriber, "sensor", Broker::Overflow::DROP_OLDEST);
+
+        broker.publish("sensor", "s1");
+        broker.publish("key", "k1");
+        broker.publish("key", "k2");
+        broker.publish("key", "k3");      // drops k1, not s1
+        broker.publish("sensor", "s2");   // drops s1
+
+        std::vector<std::string> expected = { "k2", "k3", "s2" };
+        CHECK(drain(subscriber) == expected);
+        CHECK(subscriber->getDropped() == 2);
+
+        // With none of its own queued, the new event is dropped instead of another topic's
+        broker.publish("key", "k4");
+        broker.publish("key", "k5");
+        broker.publish("key", "k6");
+        broker.publish("sensor", "s3");
+        expected = { "k4", "k5", "k6" };
+        CHECK(drain(subscriber) == expected);
+        CHECK(subscriber->getDropped() == 3);
+    }
+
+    void testConflate() {
+        Broker broker(3);
+        std::shared_ptr<Broker::Subscriber> subscriber = broker.attach(nullptr, nullptr);
+        broker.subscribe(subscriber, "imu", Broker::Overflow::CONFLATE);
+        broker.subscribe(subscriber, "key", Broker::Overflow::DROP_OLDEST);
+
+        // Replacing the pending event is a conflation, not a drop
+        broker.publish("imu", "i1");
+        broker.publish("imu", "i2");
+        CHECK(subscriber->getConflated() == 1);
+        CHECK(subscriber->getDropped() == 0);
+        std::vector<std::string> expected = { "i2" };
+        CHECK(drain(subscriber) == expected);
+
+        // A queue full of other topics still takes the latest value of a conflated topic
+        broker.publish("key", "k1");
+        broker.publish("key", "k2");
+        broker.publish("key", "k3");
+        broker.publish("imu", "i3");
+        broker.publish("imu", "i4");
+        CHECK(subscriber->getDropped() == 0);
+        CHECK(subscriber->getConflated() == 2);
+
+        // The conflated event does not take a slot from the other topics either
+        broker.publish("key", "k4");
+        expected = { "k2", "k3", "i4", "k4" };
+        CHECK(drain(subscriber) == expected);
+        CHECK(subscriber->getDropped() == 1);
+
+        // Once delivered, the room is free for the next value
+        broker.publish("key", "k5");
+        broker.publish("key", "k6");
+        broker.publish("key", "k7");
+        broker.publish("imu", "i5");
+        expected = { "k5", "k6", "k7", "i5" };
+        CHECK(drain(subscriber) == expected);
+    }
+
+    void testDisconnect() {
+        Broker broker(2);
+        int overflows = 0;
+        std::shared_ptr<Broker::Subscriber> subscriber = broker.attach(nullptr,
+            [&overflows](const std::shared_ptr<Broker::Subscriber>&) { overflows++; });
+        broker.subscribe(subscriber, "relay", Broker::Overflow::DISCONNECT);
+        broker.subscribe(subscriber, "imu", Broker::Overflow::CONFLATE);
+
+        broker.publish("imu", "i1");
+        broker.publish("relay", "r1");
+        broker.publish("relay", "r2");
+        CHECK(!subscriber->hasOverflowed());
+        broker.publish("relay", "r3");
+        CHECK(subscriber->hasOverflowed());
+        CHECK(overflows == 1);
+        CHECK(subscriber->getDropped() == 4);
+        CHECK(drain(subscriber).empty());
+
+        // Nothing is queued for a subscriber that was given up
+        broker.publish("relay", "r4");
+        CHECK(overflows == 1);
+        CHECK(drain(subscriber).empty());
+    }
+
+    void testReady() {
+        Broker broker(4);
+        int ready = 0;
+        std::shared_ptr<Broker::Subscriber> subscriber = broker.attach(
+            [&ready](const std::shared_ptr<Broker::Subscriber>&) { ready++; }, nullptr);
+        broker.subscribe(subscriber, "key", Broker::Overflow::DROP_OLDEST, 50);
+
+        // The owner is told once until it finds the queue empty again
+        broker.publish("key", "k1");
+        broker.publish("key", "k2");
+        CHECK(ready == 1);
+        CHECK(drain(subscriber).size() == 2);
+        broker.publish("key", "k3");
+        CHECK(ready == 2);
+
+        CHECK(broker.requestedRate("key") == 50);
+        CHECK(broker.unsubscribe(subscriber, "key"));
+        CHECK(!broker.unsubscribe(subscriber, "key"));
+        CHECK(broker.requestedRate("key") == 0);
+        CHECK(broker.publish("key", "k4") == 0);
+    }
+}
+
+int main() {
+    testDropOldest();
+    testConflate();
+    testDisconnect();
+    testReady();
+    return testResult();
+}
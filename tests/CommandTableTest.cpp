@@ -0,0 +1,79 @@
+#include "../include/CommandTableLib.h"
+#include "TestLib.h"
+#include <string>
+#include <optional>
+#include <cstdint>
+
+namespace {
+    struct Service {
+        std::string relay(bool on) {
+            return on ? "relay 1:" : "relay 0:";
+        }
+
+        std::string history(uint64_t count, std::optional<size_t> sensor) {
+            return "history " + std::to_string(count) + " " + std::to_string(sensor.value_or(0)) + ":";
+        }
+
+        // Takes a context ahead of its arguments
+        std::string scaled(const int& factor, int value) const {
+            return "scaled " + std::to_string(factor * value) + ":";
+        }
+    };
+
+    typedef CommandTable<
+        Command<"relay", &Service::relay, "relay err:">,
+        Command<"history", &Service::history>
+    > Commands;
+
+    typedef CommandTable<
+        Command<"scaled", &Service::scaled>
+    > ContextCommands;
+
+    void testParseCommand() {
+        uint64_t count = 0;
+        std::optional<size_t> sensor;
+        CHECK(parseCommand("history 2000 1:", "history", count, sensor));
+        CHECK(count == 2000 && sensor && *sensor == 1);
+        CHECK(parseCommand("history 5:", "history", count, sensor));
+        CHECK(count == 5 && !sensor);
+
+        // Wrong name, missing colon, signs on unsigned, junk, extra arguments
+        CHECK(!parseCommand("histories 5:", "history", count, sensor));
+        CHECK(!parseCommand("history 5", "history", count, sensor));
+        CHECK(!parseCommand("history -5:", "history", count, sensor));
+        CHECK(!parseCommand("history 5x:", "history", count, sensor));
+        CHECK(!parseCommand("history 5 1 2:", "history", count, sensor));
+        CHECK(!parseCommand("history:", "history", count, sensor));
+
+        bool on = false;
+        CHECK(parseCommand("relay 1:", "relay", on) && on);
+        CHECK(!parseCommand("relay 2:", "relay", on));
+
+        CHECK(commandName("gyro 1:") == "gyro");
+        CHECK(commandName("gyro:") == "gyro");
+        CHECK(commandName("gyro") == "");
+    }
+
+    void testTable() {
+        Service service;
+        CHECK(Commands::handle(service, "relay 1:") == "relay 1:");
+        CHECK(Commands::handle(service, "relay 0:") == "relay 0:");
+        CHECK(Commands::handle(service, "relay 2:") == "relay err:");
+        CHECK(Commands::handle(service, "history 10 3:") == "history 10 3:");
+        CHECK(Commands::handle(service, "history x:") == "error: unknown command:");
+        CHECK(Commands::handle(service, "gyro:") == "error: unknown command:");
+        CHECK(Commands::handle(service, "relay 1") == "error: unknown command:");
+
+        static_assert(Commands::has("relay") && Commands::has("history") && !Commands::has("gyro"));
+
+        int factor = 3;
+        CHECK(ContextCommands::handle(service, "scaled 4:", factor) == "scaled 12:");
+        CHECK(ContextCommands::handle(service, "scaled -4:", factor) == "scaled -12:");
+    }
+}
+
+int main() {
+    testParseCommand();
+    testTable();
+    return testResult();
+}
@@ -0,0 +1,75 @@
+#include "../include/ProtocolLib.h"
+#include "TestLib.h"
+#include <vector>
+#include <string>
+
+namespace {
+    void testTagged() {
+        uint32_t tag = 0;
+        std::string body;
+        CHECK(Protocol::splitTagged(Protocol::makeTagged(4294967295u, "gyro 1:"), tag, body));
+        CHECK(tag == 4294967295u && body == "gyro 1:");
+
+        // The body may itself contain spaces, tags and chunks
+        CHECK(Protocol::splitTagged(Protocol::makeTagged(7, Protocol::makeChunk("tag 1 x")), tag, body));
+        CHECK(tag == 7 && Protocol::isChunk(body) && body == "chunk tag 1 x");
+
+        CHECK(!Protocol::splitTagged("gyro:", tag, body));
+        CHECK(!Protocol::splitTagged("tag gyro:", tag, body));
+        CHECK(!Protocol::splitTagged("tag  gyro:", tag, body));
+        CHECK(!Protocol::splitTagged("tag 12x gyro:", tag, body));
+    }
+
+    void testBatch() {
+        std::vector<std::string> entries;
+        entries.push_back("gyro:");
+        entries.push_back("relay 1:");
+        entries.push_back("stamped acc 2:");
+        std::string batch = Protocol::makeBatch(entries);
+        CHECK(Protocol::isBatch(batch));
+        CHECK(Protocol::splitBatch(batch) == entries);
+
+        // Empty entries are dropped
+        std::vector<std::string> split = Protocol::splitBatch("batch |gyro:||acc:|");
+        CHECK(split.size() == 2 && split[0] == "gyro:" && split[1] == "acc:");
+        CHECK(Protocol::splitBatch("batch ").empty());
+    }
+
+    void testStamped() {
+        uint64_t timestampNs = 0;
+        std::string reply;
+        CHECK(Protocol::splitStamped(Protocol::makeStamped(18446744073709551615ull, "gyro 0 0 0:"), timestampNs, reply));
+        CHECK(timestampNs == 18446744073709551615ull && reply == "gyro 0 0 0:");
+        CHECK(Protocol::unstamped("stamped gyro:") == "gyro:");
+        CHECK(Protocol::unstamped("gyro:") == "gyro:");
+        CHECK(!Protocol::splitStamped("stamped gyro 0 0 0:", timestampNs, reply));
+
+        std::string value;
+        std::string event = Protocol::makeEvent("sensor", "1", 84532123456ull);
+        CHECK(Protocol::isEvent(event) && Protocol::topicOf(event) == "sensor");
+        std::string prefix = Protocol::EVENT_PREFIX + "sensor ";
+        CHECK(event.compare(0, prefix.size(), prefix) == 0 && event[event.size() - 1] == ':');
+        std::string payload = event.substr(prefix.size(), event.size() - prefix.size() - 1);
+        CHECK(Protocol::splitEventStamp(payload, value, timestampNs));
+        CHECK(value == "1" && timestampNs == 84532123456ull);
+        CHECK(!Protocol::splitEventStamp("1", value, timestampNs));
+    }
+
+    void testTopics() {
+        size_t index = 99;
+        CHECK(Protocol::imuOfTopic("imu", index) && index == 0);
+        CHECK(Protocol::imuOfTopic("imu2", index) && index == 2);
+        CHECK(!Protocol::imuOfTopic("imu0", index));
+        CHECK(!Protocol::imuOfTopic("imux", index));
+        CHECK(Protocol::topicOf("event key 5:") == "key");
+        CHECK(Protocol::topicOf("key 5:") == "");
+    }
+}
+
+int main() {
+    testTagged();
+    testBatch();
+    testStamped();
+    testTopics();
+    return testResult();
+}
@@ -0,0 +1,162 @@
+#include "../include/SampleStreamLib.h"
+#include "TestLib.h"
+#include <vector>
+#include <cstring>
+
+namespace {
+    const uint32_t KEYFRAME_INTERVAL = 25;
+    const size_t BLOCK_FRAMES = 10;
+
+    // A frame of plausible register values: slow drift, noise of a few counts, and a wrap at the 16-bit limit
+    void makeFrame(uint32_t n, int16_t raw[IMU_RAW_VALUES]) {
+        for (int i = 0; i < IMU_RAW_VALUES; i++) {
+            raw[i] = static_cast<int16_t>(1000 * i + static_cast<int>(n % 7) - 3 + static_cast<int>(n) * (i - 3));
+        }
+        raw[6] = static_cast<int16_t>(32760 + n);
+    }
+
+    uint64_t timeOf(uint32_t n) {
+        return 1000000000ULL + n * 5000000ULL + (n % 3) * 1000;
+    }
+
+    // Encode frames [first, first + count) as blocks of BLOCK_FRAMES
+    std::vector<std::string> encode(SampleEncoder& encoder, uint32_t first, uint32_t count) {
+        std::vector<std::string> blocks;
+        int16_t raw[IMU_RAW_VALUES];
+        for (uint32_t n = first; n < first + count; n++) {
+            makeFrame(n, raw);
+            encoder.add(raw, timeOf(n));
+            if (encoder.size() == BLOCK_FRAMES) {
+                blocks.push_back(encoder.flush());
+            }
+        }
+        if (encoder.size() > 0) {
+            blocks.push_back(encoder.flush());
+        }
+        return blocks;
+    }
+
+    bool matches(const ImuRawFrame& frame, uint32_t n) {
+        int16_t raw[IMU_RAW_VALUES];
+        makeFrame(n, raw);
+        return std::memcmp(frame.values, raw, sizeof(raw)) == 0 && frame.timestampNs / 1000 == timeOf(n) / 1000;
+    }
+
+    void testRoundTrip() {
+        SampleEncoder encoder(KEYFRAME_INTERVAL);
+        SampleDecoder decoder;
+        std::vector<std::string> blocks = encode(encoder, 0, 95);
+        CHECK(blocks.size() == 10);
+
+        std::vector<ImuRawFrame> frames;
+        for (size_t i = 0; i < blocks.size(); i++) {
+            CHECK(decoder.decode(blocks[i], frames));
+        }
+        CHECK(frames.size() == 95);
+        for (size_t n = 0; n < frames.size(); n++) {
+            CHECK(frames[n].sequence == n);
+            CHECK(matches(frames[n], static_cast<uint32_t>(n)));
+        }
+        CHECK(decoder.getLost() == 0);
+        CHECK(decoder.getSkipped() == 0);
+
+        // Noise of a few counts takes a byte per value instead of two
+        CHECK(blocks[1].size() < BLOCK_FRAMES * (1 + 2 * IMU_RAW_VALUES));
+    }
+
+    void testGap() {
+        SampleEncoder encoder(KEYFRAME_INTERVAL);
+        SampleDecoder decoder;
+        std::vector<std::string> blocks = encode(encoder, 0, 60);
+
+        // Frames 10 to 19 never arrive; 20 to 24 have no reference until keyframe 25
+        std::vector<ImuRawFrame> frames;
+        for (size_t i = 0; i < blocks.size(); i++) {
+            if (i != 1) {
+                CHECK(decoder.decode(blocks[i], frames));
+            }
+        }
+        CHECK(decoder.getLost() == 10);
+        CHECK(decoder.getSkipped() == 5);
+        CHECK(frames.size() == 10 + 35);
+        CHECK(frames[9].sequence == 9);
+        CHECK(frames[10].sequence == 25);
+        for (size_t i = 0; i < frames.size(); i++) {
+            CHECK(matches(frames[i], frames[i].sequence));
+        }
+    }
+
+    void testLateJoin() {
+        SampleEncoder encoder(KEYFRAME_INTERVAL);
+        std::vector<std::string> blocks = encode(encoder, 0, 80);
+
+        // A decoder that starts in the middle counts nothing as lost, only what it had to skip
+        SampleDecoder decoder;
+        std::vector<ImuRawFrame> frames;
+        CHECK(decoder.decode(blocks[5], frames));
+        CHECK(decoder.decode(blocks[6], frames));
+        CHECK(decoder.getLost() == 0);
+        CHECK(decoder.getSkipped() == 0);
+        CHECK(frames.size() == 20);
+        CHECK(frames.front().sequence == 50 && matches(frames.front(), 50));
+
+        SampleDecoder middle;
+        frames.clear();
+        CHECK(middle.decode(blocks[1], frames));
+        CHECK(middle.getSkipped() == 10);
+        CHECK(frames.empty());
+    }
+
+    void testEncoderRestart() {
+        SampleEncoder before(KEYFRAME_INTERVAL);
+        SampleDecoder decoder;
+        std::vector<ImuRawFrame> frames;
+        std::vector<std::string> blocks = encode(before, 0, 40);
+        for (size_t i = 0; i < blocks.size(); i++) {
+            CHECK(decoder.decode(blocks[i], frames));
+        }
+
+        // A restarted encoder begins again at sequence 0, a keyframe: nothing is lost or skipped
+        SampleEncoder after(KEYFRAME_INTERVAL);
+        blocks = encode(after, 0, 20);
+        frames.clear();
+        for (size_t i = 0; i < blocks.size(); i++) {
+            CHECK(decoder.decode(blocks[i], frames));
+        }
+        CHECK(decoder.getLost() == 0);
+        CHECK(decoder.getSkipped() == 0);
+        CHECK(frames.size() == 20);
+        for (size_t n = 0; n < frames.size(); n++) {
+            CHECK(frames[n].sequence == n && matches(frames[n], static_cast<uint32_t>(n)));
+        }
+
+        // After reset() the counters start over too
+        decoder.reset();
+        CHECK(decoder.getLost() == 0);
+    }
+
+    void testMalformed() {
+        SampleEncoder encoder(KEYFRAME_INTERVAL);
+        SampleDecoder decoder;
+        std::vector<std::string> blocks = encode(encoder, 0, 20);
+        std::vector<ImuRawFrame> frames;
+
+        CHECK(!decoder.decode("", frames));
+        CHECK(!decoder.decode(std::string(1, '\x07') + blocks[0].substr(1), frames));
+        CHECK(!decoder.decode(blocks[0].substr(0, blocks[0].size() - 3), frames));
+
+        // A truncated block breaks the reference: the next block waits for a keyframe
+        frames.clear();
+        CHECK(decoder.decode(blocks[1], frames));
+        CHECK(frames.empty());
+    }
+}
+
+int main() {
+    testRoundTrip();
+    testGap();
+    testLateJoin();
+    testEncoderRestart();
+    testMalformed();
+    return testResult();
+}
@@ -0,0 +1,41 @@
+#ifndef TEST_LIB_H
+#define TEST_LIB_H
+
+#include <iostream>
+
+/**
+ * @brief Minimal checks for the unit tests run by ctest
+ *
+ * A failed CHECK reports the file, line and expression and lets the test go
+ * on, so one run shows every failure. A test program ends with
+ * `return testResult();`, which makes ctest fail it if any check failed.
+ */
+namespace TestLib {
+    inline int& failures() {
+        static int count = 0;
+        return count;
+    }
+}
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #expression << std::endl; \
+            TestLib::failures()++; \
+        } \
+    } while (0)
+
+/**
+ * @brief Report the outcome of a test program
+ *
+ * @return int Exit code: 0 if every check passed, 1 otherwise
+ */
+inline int testResult() {
+    if (TestLib::failures() > 0) {
+        std::cerr << TestLib::failures() << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+#endif // TEST_LIB_H
@@ -0,0 +1,95 @@
+#include "../include/WorkerPoolLib.h"
+#include "TestLib.h"
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+    void testOrderPerKey() {
+        WorkerPool pool(4);
+        std::mutex mutex;
+        std::vector<int> order[3];
+        std::atomic<int> running[3] = { {0}, {0}, {0} };
+        std::atomic<bool> overlapped(false);
+
+        // Tasks of one key run one at a time and in submission order, whatever the other keys do
+        for (int n = 0; n < 300; n++) {
+            int key = n % 3;
+            pool.submit(std::vector<std::string>(1, "device" + std::to_string(key)), [&, key, n]() {
+                if (running[key]++ > 0) {
+                    overlapped = true;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    order[key].push_back(n);
+                }
+                running[key]--;
+            });
+        }
+        pool.waitIdle();
+
+        CHECK(!overlapped);
+        for (int key = 0; key < 3; key++) {
+            CHECK(order[key].size() == 100);
+            for (size_t i = 1; i < order[key].size(); i++) {
+                CHECK(order[key][i] > order[key][i - 1]);
+            }
+        }
+    }
+
+    void testSeveralKeys() {
+        WorkerPool pool(4);
+        std::mutex mutex;
+        std::vector<std::string> order;
+        auto record = [&](const std::string& name) {
+            return [&, name]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                std::lock_guard<std::mutex> lock(mutex);
+                order.push_back(name);
+            };
+        };
+
+        // The batch touching both devices runs after the tasks before it on either, and before those after it
+        pool.submit(std::vector<std::string>(1, "gyro"), record("gyro before"));
+        pool.submit(std::vector<std::string>(1, "relay"), record("relay before"));
+        pool.submit({ "gyro", "relay" }, record("batch"));
+        pool.submit(std::vector<std::string>(1, "relay"), record("relay after"));
+        pool.submit(std::vector<std::string>(1, "gyro"), record("gyro after"));
+        pool.waitIdle();
+
+        CHECK(order.size() == 5);
+        if (order.size() == 5) {
+            CHECK(order[2] == "batch");
+        }
+    }
+
+    void testParallel() {
+        // Tasks without a common key do not wait for each other
+        WorkerPool pool(2);
+        std::atomic<int> running(0);
+        std::atomic<int> peak(0);
+        for (int n = 0; n < 2; n++) {
+            pool.submit(std::vector<std::string>(1, "device" + std::to_string(n)), [&]() {
+                int now = ++running;
+                int seen = peak;
+                while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                running--;
+            });
+        }
+        pool.waitIdle();
+        CHECK(peak == 2);
+    }
+}
+
+int main() {
+    testOrderPerKey();
+    testSeveralKeys();
+    testParallel();
+    return testResult();
+}